@@ -14,846 +14,3325 @@
 #include <pthread.h>
 #include <limits.h>
 #include <sys/time.h>
-int handleVmem(char*);
+#include <stdint.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "vmem_internal.h"
+int handleVmem(char**,int);
 int handleMCalc(char**,int);
 int handleAdd(char**,int);
 void* addition(void*);
 void* sub(void*);
 int handleSub(char**,int);
-typedef struct {
-    int V;
-    int D;
-    int P;
-    int frame_swap;
-} page_descriptor;
+// Targets of the "print" script command, in binary trace encoding order
+static const char* print_targets[] = {"ram", "swap", "table", "tlb", "stats"};
+#define NUM_PRINT_TARGETS ((int)(sizeof(print_targets) / sizeof(print_targets[0])))
 
+// Binary trace format: "VMTR", version byte, u16 init line length, init line,
+// then records of an op byte followed by its operands
+#define TRACE_MAGIC     "VMTR"
+#define TRACE_VERSION   1
+#define TRACE_OP_LOAD   1    // zigzag varint address
+#define TRACE_OP_STORE  2    // zigzag varint address, value byte
+#define TRACE_OP_PRINT  3    // print target index
+#define TRACE_OP_SWITCH 4    // zigzag varint ASID
+#define TRACE_OP_SPAWN  5    // length byte, "spawn" arguments as text
+#define TRACE_OP_LOADRANGE  6    // zigzag varint address, length
+#define TRACE_OP_STORERANGE 7    // zigzag varint address, length byte, bytes
+#define TRACE_OP_MEMSET     8    // zigzag varint address, value byte, zigzag varint length
+#define TRACE_OP_MEMCPY     9    // zigzag varint destination, source, length
+#define TRACE_OP_CHECKPOINT 10   // length byte, image path
+#define TRACE_OP_RESTORE    11   // length byte, image path
 
-typedef struct {
-    int page_number;
-    int frame_number;
-    int valid;
-    int timestamp;
-} tlb_entry;
-typedef struct sim_database {
-    page_descriptor* page_table;  
-    int swapfile_fd;
-    int program_fd;
-    char* main_memory;            
-    int text_size;
-    int data_size;
-    int bss_size;
-    int heap_stack_size;
-    
-    tlb_entry* tlb;                
-    
-    int page_size;
-    int num_pages;
-    int memory_size;
-    int swap_size;
-    int num_frames;
-    int tlb_size;
-} sim_database;
+// Bytes of a range read that are echoed back
+#define RANGE_PREVIEW 64
 
-#include <stdio.h>
-#include <unistd.h>
-#include <string.h>
-sim_database* init_system(char* script_path);
-char load(sim_database* mem_sim, int address);
-void store(sim_database* mem_sim, int address, char value);
-void clear_system(sim_database* mem_sim);
-void update_page_access_time(int page_num);
-int find_free_frame(sim_database* mem_sim);
-int find_free_swap_slot(sim_database* mem_sim);
-void save_page_to_swap(sim_database* mem_sim, int page_num);
-int evict_page_lru(sim_database* mem_sim);
-void load_page_from_program(sim_database* mem_sim, int page_num, char* dest, int base_offset);
-void load_page_from_swap(sim_database* mem_sim, int page_num, char* dest);
-int check_tlb(sim_database* mem_sim, int page_num);
-void add_to_tlb(sim_database* mem_sim, int page_num, int frame_num);
-void remove_from_tlb(sim_database* mem_sim, int page_num);
-/**
- * print_memory - Prints the contents of the main memory (RAM)
- * Shows each frame with its contents in both hex and character format
- */
-void print_memory(sim_database* mem_sim) {
-    if (!mem_sim || !mem_sim->main_memory) {
-        printf("Error: Invalid memory simulation structure\n");
+// Script-level load: translate and report the value read
+static void script_load(sim_database* mem_sim, int64_t address) {
+    char result = load(mem_sim, address);
+    if (result != '\0') {
+        vmem_log(mem_sim, "Value at address %lld = %c\n", (long long)address, result);
+    }
+}
+
+// Script-level store: write and report success (store() prints any error)
+static void script_store(sim_database* mem_sim, int64_t address, char value) {
+    if (store(mem_sim, address, value) == 0) {
+        vmem_log(mem_sim, "Stored value '%c' at address %lld\n", value, (long long)address);
+    }
+}
+
+// Script-level range read: report the first RANGE_PREVIEW bytes, unprintable ones as '.'
+static void script_loadrange(sim_database* mem_sim, int64_t address, int64_t length) {
+    // Ranges larger than the address space are refused by load_range()
+    int64_t space = mem_sim->proc->num_pages * mem_sim->page_size;
+    char* data = NULL;
+    if (length > 0 && length <= space && !(data = (char*)malloc(length))) {
+        perror("Error allocating range buffer");
         return;
     }
-    
-    printf("=== MAIN MEMORY CONTENTS ===\n");
-    printf("Memory size: %d bytes, Page size: %d bytes, Number of frames: %d\n", 
-           mem_sim->memory_size, mem_sim->page_size, mem_sim->num_frames);
-    
-    for (int frame = 0; frame < mem_sim->num_frames; frame++) {
-        printf("Frame %d: ", frame);
-        
-        // Print hex values
-        for (int i = 0; i < mem_sim->page_size; i++) {
-            int addr = frame * mem_sim->page_size + i;
-            printf("%02X ", (unsigned char)mem_sim->main_memory[addr]);
-        }
-        
-        printf("| ");
-        
-        // Print character representation
-        for (int i = 0; i < mem_sim->page_size; i++) {
-            int addr = frame * mem_sim->page_size + i;
-            char c = mem_sim->main_memory[addr];
-            if (c >= 32 && c <= 126) {  // Printable ASCII
-                printf("%c", c);
-            } else {
-                printf(".");
-            }
+    if (load_range(mem_sim, address, data, length) == 0 && length > 0) {
+        char preview[RANGE_PREVIEW + 1];
+        int shown = length < RANGE_PREVIEW ? (int)length : RANGE_PREVIEW;
+        for (int i = 0; i < shown; i++) {
+            preview[i] = isprint((unsigned char)data[i]) ? data[i] : '.';
         }
-        printf("\n");
+        preview[shown] = '\0';
+        vmem_log(mem_sim, "Values at addresses %lld-%lld = %s%s\n", (long long)address,
+                 (long long)(address + length - 1), preview, length > shown ? "..." : "");
+    }
+    free(data);
+}
+
+static void script_storerange(sim_database* mem_sim, int64_t address, const char* data, int length) {
+    if (store_range(mem_sim, address, data, length) == 0) {
+        vmem_log(mem_sim, "Stored %d bytes at address %lld\n", length, (long long)address);
+    }
+}
+
+static void script_memset(sim_database* mem_sim, int64_t address, char value, int64_t length) {
+    if (memset_range(mem_sim, address, value, length) == 0) {
+        vmem_log(mem_sim, "Set %lld bytes at address %lld to '%c'\n",
+                 (long long)length, (long long)address, value);
+    }
+}
+
+static void script_memcpy(sim_database* mem_sim, int64_t dest, int64_t src, int64_t length) {
+    if (copy_range(mem_sim, dest, src, length) == 0) {
+        vmem_log(mem_sim, "Copied %lld bytes from address %lld to %lld\n",
+                 (long long)length, (long long)src, (long long)dest);
+    }
+}
+
+static void script_print(sim_database* mem_sim, int target) {
+    vmem_flush(mem_sim);
+    switch (target) {
+        case 0: print_memory(mem_sim); break;
+        case 1: print_swap(mem_sim); break;
+        case 2: print_page_table(mem_sim); break;
+        case 3: print_tlb(mem_sim); break;
+        case 4: print_stats(mem_sim); break;
     }
-    printf("=============================\n\n");
 }
 
 /**
- * print_swap - Prints the contents of the swap file
- * Shows each page slot in the swap file
+ * script_spawn - Adds a process from "<program> <text> <data> <bss> <heap_stack> <num_pages>"
+ * Pages are the same size as in process 0; main memory and swap are shared.
  */
-void print_swap(sim_database* mem_sim) {
-    if (!mem_sim || mem_sim->swapfile_fd < 0) {
-        printf("Error: Invalid swap file\n");
+static void script_spawn(sim_database* mem_sim, const char* args) {
+    char exe_file_name[256];
+    int text_size, data_size, bss_size;
+    long long heap_stack_size, num_pages;
+    
+    if (sscanf(args, "%255s %d %d %d %lld %lld", exe_file_name, &text_size, &data_size,
+               &bss_size, &heap_stack_size, &num_pages) != 6) {
+        fprintf(stderr, "Error: Usage: spawn <program> <text> <data> <bss> <heap_stack> <num_pages>\n");
         return;
     }
     
-    printf("=== SWAP FILE CONTENTS ===\n");
-    printf("Swap size: %d bytes, Page size: %d bytes, Number of swap pages: %d\n", 
-           mem_sim->swap_size, mem_sim->page_size, mem_sim->swap_size / mem_sim->page_size);
+    vmem_process* proc = create_process(mem_sim, exe_file_name, text_size, data_size,
+                                        bss_size, heap_stack_size, num_pages);
+    if (!proc) return;
     
-    int num_swap_pages = mem_sim->swap_size / mem_sim->page_size;
-    char* buffer = malloc(mem_sim->page_size);
-    
-    if (!buffer) {
-        perror("Error allocating buffer for swap reading");
-        return;
+    vmem_flush(mem_sim);
+    printf("Loaded program \"%s\" as process %d with text=%d, data=%d, bss=%d, heap_stack=%lld.\n",
+           exe_file_name, proc->asid, text_size, data_size, bss_size, heap_stack_size);
+}
+
+static void script_switch(sim_database* mem_sim, int asid) {
+    if (switch_process(mem_sim, asid) == 0) {
+        vmem_log(mem_sim, "Switched to process %d\n", asid);
+    }
+}
+
+static void script_checkpoint(sim_database* mem_sim, const char* path) {
+    if (checkpoint_system(mem_sim, path) == 0) {
+        vmem_log(mem_sim, "Checkpoint written to %s\n", path);
+    }
+}
+
+static void script_restore(sim_database* mem_sim, const char* path) {
+    if (restore_system(mem_sim, path) == 0) {
+        vmem_log(mem_sim, "Restored %s, current process %d\n", path, mem_sim->proc->asid);
     }
+}
+
+static int find_print_target(const char* name) {
+    for (int i = 0; i < NUM_PRINT_TARGETS; i++) {
+        if (strcmp(print_targets[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+// Run the commands of a text script (the init line was already consumed)
+static void run_text_script(sim_database* mem_sim, FILE* script) {
+    char line[256];
     
-    for (int page = 0; page < num_swap_pages; page++) {
-        // Seek to the beginning of this page in swap file
-        if (lseek(mem_sim->swapfile_fd, page * mem_sim->page_size, SEEK_SET) == -1) {
-            perror("Error seeking in swap file");
-            free(buffer);
-            return;
-        }
+    while (fgets(line, sizeof(line), script)) {
+        // Remove newline
+        line[strcspn(line, "\n")] = '\0';
         
-        // Read the page
-        ssize_t bytes_read = read(mem_sim->swapfile_fd, buffer, mem_sim->page_size);
-        if (bytes_read != mem_sim->page_size) {
-            printf("Swap Page %d: [Error reading]\n", page);
-            continue;
-        }
+        // Skip empty lines
+        if (strlen(line) == 0) continue;
         
-        printf("Swap Page %d: ", page);
+        // Parse the command
+        char command[20];
+        long long address, source, length;
+        char value;
         
-        // Print hex values
-        for (int i = 0; i < mem_sim->page_size; i++) {
-            printf("%02X ", (unsigned char)buffer[i]);
-        }
+        if (sscanf(line, "%19s", command) < 1) continue;
         
-        printf("| ");
+        if (strcmp(command, "load") == 0) {
+            if (sscanf(line, "load %lld", &address) == 1) {
+                script_load(mem_sim, address);
+            }
+        }
+        else if (strcmp(command, "store") == 0) {
+            if (sscanf(line, "store %lld %c", &address, &value) == 2) {
+                script_store(mem_sim, address, value);
+            }
+        }
+        else if (strcmp(command, "loadrange") == 0) {
+            if (sscanf(line, "loadrange %lld %lld", &address, &length) == 2) {
+                script_loadrange(mem_sim, address, length);
+            }
+        }
+        else if (strcmp(command, "storerange") == 0) {
+            // The bytes are the rest of the line after the address
+            int data_start = 0;
+            if (sscanf(line, "storerange %lld %n", &address, &data_start) == 1 && line[data_start]) {
+                script_storerange(mem_sim, address, line + data_start, strlen(line + data_start));
+            }
+        }
+        else if (strcmp(command, "memset") == 0) {
+            if (sscanf(line, "memset %lld %c %lld", &address, &value, &length) == 3) {
+                script_memset(mem_sim, address, value, length);
+            }
+        }
+        else if (strcmp(command, "memcpy") == 0) {
+            if (sscanf(line, "memcpy %lld %lld %lld", &address, &source, &length) == 3) {
+                script_memcpy(mem_sim, address, source, length);
+            }
+        }
+        else if (strcmp(command, "print") == 0) {
+            char target[20];
+            if (sscanf(line, "print %19s", target) == 1) {
+                int id = find_print_target(target);
+                if (id != -1) script_print(mem_sim, id);
+            }
+        }
+        else if (strcmp(command, "spawn") == 0) {
+            script_spawn(mem_sim, strstr(line, "spawn") + strlen("spawn"));
+        }
+        else if (strcmp(command, "switch") == 0) {
+            int asid;
+            if (sscanf(line, "switch %d", &asid) == 1) {
+                script_switch(mem_sim, asid);
+            }
+        }
+        else if (strcmp(command, "checkpoint") == 0 || strcmp(command, "restore") == 0) {
+            char path[256];
+            if (sscanf(line, "%*s %255s", path) == 1) {
+                if (command[0] == 'c') script_checkpoint(mem_sim, path);
+                else script_restore(mem_sim, path);
+            }
+        }
+    }
+}
+
+// Decode a zigzag LEB128 varint; returns NULL on a truncated record
+static const unsigned char* decode_varint(const unsigned char* p, const unsigned char* end,
+                                          int64_t* out) {
+    uint64_t value = 0;
+    int shift = 0;
+    while (p < end && shift < 64) {
+        unsigned char byte = *p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *out = (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+            return p;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+static void encode_varint(FILE* out, int64_t v) {
+    uint64_t value = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7F) | 0x80, out);
+        value >>= 7;
+    }
+    fputc((int)value, out);
+}
+
+// Replay binary trace records in a tight decode loop
+static int run_binary_trace(sim_database* mem_sim, const unsigned char* p,
+                            const unsigned char* end) {
+    const unsigned char* start = p;
+    
+    while (p < end) {
+        const unsigned char* record = p;
+        int op = *p++;
+        int64_t address, source, length;
         
-        // Print character representation
-        for (int i = 0; i < mem_sim->page_size; i++) {
-            char c = buffer[i];
-            if (c >= 32 && c <= 126) {  // Printable ASCII
-                printf("%c", c);
-            } else {
-                printf(".");
+        switch (op) {
+            case TRACE_OP_LOAD:
+                if (!(p = decode_varint(p, end, &address))) break;
+                script_load(mem_sim, address);
+                continue;
+            case TRACE_OP_STORE:
+                if (!(p = decode_varint(p, end, &address)) || p >= end) {
+                    p = NULL;
+                    break;
+                }
+                script_store(mem_sim, address, (char)*p++);
+                continue;
+            case TRACE_OP_PRINT:
+                if (p >= end) {
+                    p = NULL;
+                    break;
+                }
+                script_print(mem_sim, *p++);
+                continue;
+            case TRACE_OP_SWITCH:
+                if (!(p = decode_varint(p, end, &address))) break;
+                script_switch(mem_sim, (int)address);
+                continue;
+            case TRACE_OP_SPAWN: {
+                if (p >= end || p + 1 + *p > end) {
+                    p = NULL;
+                    break;
+                }
+                char args[256];
+                int len = *p++;
+                memcpy(args, p, len);
+                args[len] = '\0';
+                p += len;
+                script_spawn(mem_sim, args);
+                continue;
+            }
+            case TRACE_OP_LOADRANGE:
+                if (!(p = decode_varint(p, end, &address)) || !(p = decode_varint(p, end, &length))) break;
+                script_loadrange(mem_sim, address, length);
+                continue;
+            case TRACE_OP_STORERANGE:
+                if (!(p = decode_varint(p, end, &address)) || p >= end || p + 1 + *p > end) {
+                    p = NULL;
+                    break;
+                }
+                script_storerange(mem_sim, address, (const char*)p + 1, *p);
+                p += 1 + *p;
+                continue;
+            case TRACE_OP_MEMSET: {
+                if (!(p = decode_varint(p, end, &address)) || p >= end) {
+                    p = NULL;
+                    break;
+                }
+                char value = (char)*p++;
+                if (!(p = decode_varint(p, end, &length))) break;
+                script_memset(mem_sim, address, value, length);
+                continue;
+            }
+            case TRACE_OP_MEMCPY:
+                if (!(p = decode_varint(p, end, &address)) || !(p = decode_varint(p, end, &source)) ||
+                    !(p = decode_varint(p, end, &length))) break;
+                script_memcpy(mem_sim, address, source, length);
+                continue;
+            case TRACE_OP_CHECKPOINT:
+            case TRACE_OP_RESTORE: {
+                if (p >= end || p + 1 + *p > end) {
+                    p = NULL;
+                    break;
+                }
+                char path[256];
+                int len = *p++;
+                memcpy(path, p, len);
+                path[len] = '\0';
+                p += len;
+                if (op == TRACE_OP_CHECKPOINT) script_checkpoint(mem_sim, path);
+                else script_restore(mem_sim, path);
+                continue;
             }
+            default:
+                fprintf(stderr, "Error: Unknown trace op %d at offset %ld\n",
+                        op, (long)(record - start));
+                return -1;
         }
-        printf("\n");
+        fprintf(stderr, "Error: Truncated trace record at offset %ld\n", (long)(record - start));
+        return -1;
     }
-    
-    free(buffer);
-    printf("===========================\n\n");
+    return 0;
 }
 
 /**
- * print_page_table - Prints the page table contents
- * Shows all page descriptors with their flags and frame/swap locations
+ * handleVmemConvert - Converts a text vmem script into the binary trace format
+ * Usage: vmem convert <script.txt> <trace.bin>
  */
-void print_page_table(sim_database* mem_sim) {
-    if (!mem_sim || !mem_sim->page_table) {
-        printf("Error: Invalid page table\n");
-        return;
+int handleVmemConvert(char** tokens, int tokenCount) {
+    if (tokenCount != 4) {
+        fprintf(stderr, "Usage: vmem convert <script.txt> <trace.bin>\n");
+        return -1;
     }
     
-    printf("=== PAGE TABLE ===\n");
-    printf("Number of pages: %d\n", mem_sim->num_pages);
-    printf("Page | V | D | P | Frame/Swap | Segment\n");
-    printf("-----|---|---|---|------------|--------\n");
+    FILE* script = fopen(tokens[2], "r");
+    if (!script) {
+        fprintf(stderr, "Error: Cannot open script file %s\n", tokens[2]);
+        return -1;
+    }
     
-    // Calculate segment boundaries in pages
-    int text_pages = (mem_sim->text_size + mem_sim->page_size - 1) / mem_sim->page_size;
-    int data_pages = (mem_sim->data_size + mem_sim->page_size - 1) / mem_sim->page_size;
-    int bss_pages = (mem_sim->bss_size + mem_sim->page_size - 1) / mem_sim->page_size;
+    char line[256];
+    if (!fgets(line, sizeof(line), script)) {
+        fprintf(stderr, "Error: Invalid script format\n");
+        fclose(script);
+        return -1;
+    }
+    line[strcspn(line, "\n")] = '\0';
     
-    for (int page = 0; page < mem_sim->num_pages; page++) {
-        page_descriptor* pd = &mem_sim->page_table[page];
-        
-        // Determine segment type
-        const char* segment;
-        if (page < text_pages) {
-            segment = "TEXT";
-        } else if (page < text_pages + data_pages) {
-            segment = "DATA";
-        } else if (page < text_pages + data_pages + bss_pages) {
-            segment = "BSS";
-        } else {
-            segment = "H/S";  // Heap/Stack
-        }
-        
-        printf("%4d | %d | %d | %d |", page, pd->V, pd->D, pd->P);
+    FILE* out = fopen(tokens[3], "wb");
+    if (!out) {
+        perror("Error creating trace file");
+        fclose(script);
+        return -1;
+    }
+    
+    // Header: magic, version and the init line
+    size_t init_len = strlen(line);
+    fwrite(TRACE_MAGIC, 1, 4, out);
+    fputc(TRACE_VERSION, out);
+    fputc((int)(init_len & 0xFF), out);
+    fputc((int)(init_len >> 8), out);
+    fwrite(line, 1, init_len, out);
+    
+    long records = 0;
+    while (fgets(line, sizeof(line), script)) {
+        long long address, source, length;
+        char value;
+        char target[20];
+        char target_path[256];
+        int data_start = 0;
         
-        if (pd->frame_swap == -1) {
-            printf("      -    |");
+        if (sscanf(line, "load %lld", &address) == 1) {
+            fputc(TRACE_OP_LOAD, out);
+            encode_varint(out, address);
+        } else if (sscanf(line, "store %lld %c", &address, &value) == 2) {
+            fputc(TRACE_OP_STORE, out);
+            encode_varint(out, address);
+            fputc((unsigned char)value, out);
+        } else if (sscanf(line, "loadrange %lld %lld", &address, &length) == 2) {
+            fputc(TRACE_OP_LOADRANGE, out);
+            encode_varint(out, address);
+            encode_varint(out, length);
+        } else if (sscanf(line, "storerange %lld %n", &address, &data_start) == 1 &&
+                   line[data_start] && line[data_start] != '\n') {
+            size_t len = strcspn(line + data_start, "\n");
+            if (len > 255) len = 255;
+            fputc(TRACE_OP_STORERANGE, out);
+            encode_varint(out, address);
+            fputc((int)len, out);
+            fwrite(line + data_start, 1, len, out);
+        } else if (sscanf(line, "memset %lld %c %lld", &address, &value, &length) == 3) {
+            fputc(TRACE_OP_MEMSET, out);
+            encode_varint(out, address);
+            fputc((unsigned char)value, out);
+            encode_varint(out, length);
+        } else if (sscanf(line, "memcpy %lld %lld %lld", &address, &source, &length) == 3) {
+            fputc(TRACE_OP_MEMCPY, out);
+            encode_varint(out, address);
+            encode_varint(out, source);
+            encode_varint(out, length);
+        } else if (sscanf(line, "print %19s", target) == 1 && find_print_target(target) != -1) {
+            fputc(TRACE_OP_PRINT, out);
+            fputc(find_print_target(target), out);
+        } else if (sscanf(line, "switch %lld", &address) == 1) {
+            fputc(TRACE_OP_SWITCH, out);
+            encode_varint(out, address);
+        } else if (strncmp(line, "spawn ", 6) == 0) {
+            const char* args = line + 6;
+            size_t len = strcspn(args, "\n");
+            if (len > 255) len = 255;
+            fputc(TRACE_OP_SPAWN, out);
+            fputc((int)len, out);
+            fwrite(args, 1, len, out);
+        } else if (sscanf(line, "checkpoint %255s", target_path) == 1 ||
+                   sscanf(line, "restore %255s", target_path) == 1) {
+            fputc(line[0] == 'c' ? TRACE_OP_CHECKPOINT : TRACE_OP_RESTORE, out);
+            fputc((int)strlen(target_path), out);
+            fwrite(target_path, 1, strlen(target_path), out);
         } else {
-            printf("    %4d   |", pd->frame_swap);
+            continue;
         }
-        
-        printf(" %s\n", segment);
+        records++;
     }
-    printf("==================\n");
-    printf("Legend: V=Valid, D=Dirty, P=Permission (1=Read-Only, 0=Read/Write)\n");
-    printf("        Frame/Swap: Frame number if in memory (V=1), Swap page if swapped out\n\n");
+    fclose(script);
+    
+    if (fclose(out) != 0) {
+        perror("Error writing trace file");
+        return -1;
+    }
+    printf("Converted %ld records from %s to %s\n", records, tokens[2], tokens[3]);
+    return 0;
 }
 
+// A binary trace mapped into memory (data is MAP_FAILED for text scripts)
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    const unsigned char* records;     // First record after the header
+} trace_map;
+
 /**
- * print_tlb - Prints the TLB contents (bonus function)
- * Shows all TLB entries with their page->frame mappings
+ * open_script - Opens a text script or binary trace and reads its init line
+ * Binary traces are mapped and decoded in place, with the init line taken
+ * from their header; anything else is a text script, left positioned after
+ * its first line. Returns NULL (after printing why) on failure.
  */
-void print_tlb(sim_database* mem_sim) {
-    if (!mem_sim || !mem_sim->tlb) {
-        printf("TLB not implemented or invalid\n");
-        return;
+static FILE* open_script(const char* path, char* line, size_t line_size, trace_map* trace) {
+    trace->data = MAP_FAILED;
+    trace->size = 0;
+    trace->records = NULL;
+    
+    FILE* script = fopen(path, "r");
+    if (!script) {
+        fprintf(stderr, "Error: Cannot open script file %s\n", path);
+        return NULL;
     }
     
-    printf("=== TLB CONTENTS ===\n");
-    printf("TLB size: %d entries\n", mem_sim->tlb_size);
-    printf("Entry | Valid | Page | Frame | Timestamp\n");
-    printf("------|-------|------|-------|----------\n");
+    char magic[4];
+    if (fread(magic, 1, 4, script) == 4 && memcmp(magic, TRACE_MAGIC, 4) == 0) {
+        struct stat st;
+        if (fstat(fileno(script), &st) == 0 && st.st_size >= 7) {
+            trace->size = st.st_size;
+            trace->data = mmap(NULL, trace->size, PROT_READ, MAP_PRIVATE, fileno(script), 0);
+        }
+        size_t init_len = (trace->data != MAP_FAILED) ? (size_t)(trace->data[5] | (trace->data[6] << 8)) : 0;
+        if (trace->data == MAP_FAILED || trace->data[4] != TRACE_VERSION ||
+            7 + init_len > trace->size || init_len >= line_size) {
+            fprintf(stderr, "Error: Invalid trace file %s\n", path);
+            if (trace->data != MAP_FAILED) munmap(trace->data, trace->size);
+            trace->data = MAP_FAILED;
+            fclose(script);
+            return NULL;
+        }
+        madvise(trace->data, trace->size, MADV_SEQUENTIAL);
+        memcpy(line, trace->data + 7, init_len);
+        line[init_len] = '\0';
+        trace->records = trace->data + 7 + init_len;
+        return script;
+    }
     
-    for (int i = 0; i < mem_sim->tlb_size; i++) {
-        tlb_entry* entry = &mem_sim->tlb[i];
-        printf("  %d   |   %d   |", i, entry->valid);
-        
-        if (entry->valid) {
-            printf(" %4d | %5d |  %8d\n", 
-                   entry->page_number, entry->frame_number, entry->timestamp);
+    // Read the first line for initialization
+    rewind(script);
+    if (!fgets(line, line_size, script)) {
+        fprintf(stderr, "Error: Invalid script format\n");
+        fclose(script);
+        return NULL;
+    }
+    
+    // Remove newline from first line
+    line[strcspn(line, "\n")] = '\0';
+    return script;
+}
+
+/**
+ * parse_vmem_flags - Splits vmem arguments from tokens[first] on
+ * -q and --stats set the flags, "--key=value" flags are appended to
+ * 'overrides' as init line settings and the one remaining token is the
+ * script. Returns -1 if there is no script or more than one.
+ */
+static int parse_vmem_flags(char** tokens, int tokenCount, int first, char** path,
+                            char* overrides, size_t overrides_size, int* quiet, int* show_stats) {
+    *path = NULL;
+    overrides[0] = '\0';
+    *quiet = 0;
+    *show_stats = 0;
+    for (int i = first; i < tokenCount; i++) {
+        if (strcmp(tokens[i], "-q") == 0) {
+            *quiet = 1;
+        } else if (strcmp(tokens[i], "--stats") == 0) {
+            *quiet = 1;
+            *show_stats = 1;
+        } else if (strncmp(tokens[i], "--", 2) == 0 && strchr(tokens[i], '=')) {
+            strncat(overrides, " ", overrides_size - strlen(overrides) - 1);
+            strncat(overrides, tokens[i] + 2, overrides_size - strlen(overrides) - 1);
+        } else if (!*path) {
+            *path = tokens[i];
         } else {
-            printf("   -  |   -   |     -\n");
+            return -1;
         }
     }
-    printf("====================\n\n");
+    return *path ? 0 : -1;
 }
-sim_database* init_system(char* init_line) {
-    // Allocate the main structure
-    sim_database* mem_sim = (sim_database*)calloc(1, sizeof(sim_database));
-    if (!mem_sim) {
-        perror("Error allocating memory for sim_database");
-        return NULL;
+
+// Runs the commands of an opened script or trace; unmaps the trace
+static int run_opened_script(sim_database* mem_sim, FILE* script, trace_map* trace) {
+    int result = 0;
+    if (trace->data != MAP_FAILED) {
+        result = run_binary_trace(mem_sim, trace->records, trace->data + trace->size);
+        munmap(trace->data, trace->size);
+    } else {
+        run_text_script(mem_sim, script);
+    }
+    return result;
+}
+
+/* ---- Persistent vmem session ---- */
+
+// Simulator kept alive between commands by "vmem open" until "vmem close"
+static sim_database* vmem_session = NULL;
+
+/**
+ * handleVmemOpen - Starts a session from a script's or trace's init line
+ * Usage: vmem open <config|script|trace.bin> [-q] [--key=value]...
+ * Only the init line is read; its commands are not run. Later "vmem exec"
+ * commands share the simulator, so frames, TLBs, swap and counters carry
+ * over from one to the next.
+ */
+static int handleVmemOpen(char** tokens, int tokenCount) {
+    char* path;
+    char overrides[BUFSIZ];
+    int quiet, show_stats;
+    if (parse_vmem_flags(tokens, tokenCount, 2, &path, overrides, sizeof(overrides),
+                         &quiet, &show_stats) != 0 || show_stats) {
+        fprintf(stderr, "Usage: vmem open <config|script|trace.bin> [-q] [--key=value]...\n");
+        return -1;
+    }
+    if (vmem_session) {
+        fprintf(stderr, "Error: A vmem session is already open (vmem close ends it)\n");
+        return -1;
     }
     
-    // Parse initialization parameters
-    char exe_file_name[256];
-    char swap_file_name[256];
+    char line[256];
+    trace_map trace;
+    FILE* script = open_script(path, line, sizeof(line), &trace);
+    if (!script) return -1;
+    if (trace.data != MAP_FAILED) munmap(trace.data, trace.size);
+    fclose(script);
     
-    int parsed = sscanf(init_line, "%s %s %d %d %d %d %d %d %d %d",
-                        exe_file_name, swap_file_name,
-                        &mem_sim->text_size, &mem_sim->data_size,
-                        &mem_sim->bss_size, &mem_sim->heap_stack_size,
-                        &mem_sim->page_size, &mem_sim->num_pages,
-                        &mem_sim->memory_size, &mem_sim->swap_size);
+    char init_line[sizeof(line) + sizeof(overrides)];
+    snprintf(init_line, sizeof(init_line), "%s%s", line, overrides);
+    vmem_session = init_system(init_line);
+    if (!vmem_session) {
+        fprintf(stderr, "Error: Failed to initialize memory system\n");
+        return -1;
+    }
+    vmem_session->quiet = quiet;
     
-    if (parsed != 10) {
-        fprintf(stderr, "Error: Invalid script format\n");
-        free(mem_sim);
-        return NULL;
+    vmem_process* proc = vmem_session->procs[0];
+    printf("Opened vmem session: program \"%s\" with text=%d, data=%d, bss=%d, heap_stack=%lld.\n",
+           proc->program_name, proc->text_size, proc->data_size,
+           proc->bss_size, (long long)proc->heap_stack_size);
+    return 0;
+}
+
+/**
+ * handleVmemExec - Runs a script or trace on the open session
+ * Usage: vmem exec <script|trace.bin> [-q|--stats]
+ * The file's init line is skipped: the session keeps the settings it was
+ * opened with. -q (or --stats) silences per-access messages for this run.
+ */
+static int handleVmemExec(char** tokens, int tokenCount) {
+    char* path;
+    char overrides[BUFSIZ];
+    int quiet, show_stats;
+    if (parse_vmem_flags(tokens, tokenCount, 2, &path, overrides, sizeof(overrides),
+                         &quiet, &show_stats) != 0 || overrides[0]) {
+        fprintf(stderr, "Usage: vmem exec <script|trace.bin> [-q|--stats]\n");
+        return -1;
+    }
+    if (!vmem_session) {
+        fprintf(stderr, "Error: No vmem session is open (use vmem open <config>)\n");
+        return -1;
     }
     
-    // Calculate number of frames
-    mem_sim->num_frames = mem_sim->memory_size / mem_sim->page_size;
+    char line[256];
+    trace_map trace;
+    FILE* script = open_script(path, line, sizeof(line), &trace);
+    if (!script) return -1;
     
-    // Open program file (read-only)
-    mem_sim->program_fd = open(exe_file_name, O_RDONLY);
-    if (mem_sim->program_fd < 0) {
-        perror("Error opening program file");
-        free(mem_sim);
-        return NULL;
-    }
+    int was_quiet = vmem_session->quiet;
+    vmem_session->quiet = quiet;
+    int result = run_opened_script(vmem_session, script, &trace);
+    fclose(script);
+    vmem_flush(vmem_session);
+    vmem_session->quiet = was_quiet;
     
-    // Create/open swap file
-    mem_sim->swapfile_fd = open(swap_file_name, O_RDWR | O_CREAT | O_TRUNC, 0666);
-    if (mem_sim->swapfile_fd < 0) {
-        perror("Error creating/opening swap file");
-        close(mem_sim->program_fd);
-        free(mem_sim);
-        return NULL;
+    if (show_stats) print_stats(vmem_session);
+    return result;
+}
+
+// Ends the session: final snapshot row, queued writebacks, then teardown
+static void close_vmem_session(void) {
+    if (!vmem_session) return;
+    finish_snapshots(vmem_session);
+    clear_system(vmem_session);
+    vmem_session = NULL;
+}
+
+int handleVmemBench(char** tokens, int tokenCount);
+int handleVmemSweep(char** tokens, int tokenCount);
+int handleVmemMrc(char** tokens, int tokenCount);
+int handleVmemGen(char** tokens, int tokenCount);
+int handleVmemBenchSuite(char** tokens, int tokenCount);
+int handleVmemSmp(char** tokens, int tokenCount);
+int handleVmem(char** tokens, int tokenCount) {
+    if (tokenCount >= 3 && strcmp(tokens[1], "bench") == 0 && strcmp(tokens[2], "suite") == 0) {
+        return handleVmemBenchSuite(tokens, tokenCount);
     }
-    
-    // Initialize swap file with '-' characters
-    char* init_buffer = (char*)malloc(mem_sim->swap_size);
-    if (!init_buffer) {
-        perror("Error allocating buffer");
-        close(mem_sim->program_fd);
-        close(mem_sim->swapfile_fd);
-        free(mem_sim);
-        return NULL;
+    if (tokenCount >= 2 && strcmp(tokens[1], "bench") == 0) {
+        return handleVmemBench(tokens, tokenCount);
     }
-    memset(init_buffer, '-', mem_sim->swap_size);
-    if (write(mem_sim->swapfile_fd, init_buffer, mem_sim->swap_size) != mem_sim->swap_size) {
-        perror("Error writing to swap file");
-        free(init_buffer);
-        close(mem_sim->program_fd);
-        close(mem_sim->swapfile_fd);
-        free(mem_sim);
-        return NULL;
+    if (tokenCount >= 2 && strcmp(tokens[1], "convert") == 0) {
+        return handleVmemConvert(tokens, tokenCount);
     }
-    free(init_buffer);
-    
-    // Allocate and initialize main memory
-    mem_sim->main_memory = (char*)malloc(mem_sim->memory_size);
-    if (!mem_sim->main_memory) {
-        perror("Error allocating main memory");
-        close(mem_sim->program_fd);
-        close(mem_sim->swapfile_fd);
-        free(mem_sim);
-        return NULL;
+    if (tokenCount >= 2 && strcmp(tokens[1], "sweep") == 0) {
+        return handleVmemSweep(tokens, tokenCount);
     }
-    memset(mem_sim->main_memory, '-', mem_sim->memory_size);
-    
-    // Allocate and initialize page table
-    mem_sim->page_table = (page_descriptor*)calloc(mem_sim->num_pages, sizeof(page_descriptor));
-    if (!mem_sim->page_table) {
-        perror("Error allocating page table");
-        free(mem_sim->main_memory);
-        close(mem_sim->program_fd);
-        close(mem_sim->swapfile_fd);
-        free(mem_sim);
-        return NULL;
+    if (tokenCount >= 2 && strcmp(tokens[1], "mrc") == 0) {
+        return handleVmemMrc(tokens, tokenCount);
     }
-    
-    // Initialize page table entries
-    int text_pages = (mem_sim->text_size + mem_sim->page_size - 1) / mem_sim->page_size;
-    
-    for (int i = 0; i < mem_sim->num_pages; i++) {
-        mem_sim->page_table[i].V = 0;  // Not in memory
-        mem_sim->page_table[i].D = 0;  // Not dirty
-        mem_sim->page_table[i].frame_swap = -1;  // Not allocated
-        
-        // Set permissions: TEXT pages are read-only (P=1)
-        if (i < text_pages) {
-            mem_sim->page_table[i].P = 1;  // Read-only
-        } else {
-            mem_sim->page_table[i].P = 0;  // Read-write
+    if (tokenCount >= 2 && strcmp(tokens[1], "gen") == 0) {
+        return handleVmemGen(tokens, tokenCount);
+    }
+    if (tokenCount >= 2 && strcmp(tokens[1], "smp") == 0) {
+        return handleVmemSmp(tokens, tokenCount);
+    }
+    if (tokenCount >= 2 && strcmp(tokens[1], "open") == 0) {
+        return handleVmemOpen(tokens, tokenCount);
+    }
+    if (tokenCount >= 2 && strcmp(tokens[1], "exec") == 0) {
+        return handleVmemExec(tokens, tokenCount);
+    }
+    if (tokenCount == 2 && strcmp(tokens[1], "stats") == 0) {
+        if (!vmem_session) {
+            fprintf(stderr, "Error: No vmem session is open (use vmem open <config>)\n");
+            return -1;
+        }
+        print_stats(vmem_session);
+        return 0;
+    }
+    if (tokenCount == 2 && strcmp(tokens[1], "close") == 0) {
+        if (!vmem_session) {
+            fprintf(stderr, "Error: No vmem session is open\n");
+            return -1;
         }
+        close_vmem_session();
+        printf("Closed vmem session.\n");
+        return 0;
     }
     
-    // Print initialization message
-    printf("Loaded program \"%s\" with text=%d, data=%d, bss=%d, heap_stack=%d.\n",
-           exe_file_name, mem_sim->text_size, mem_sim->data_size,
-           mem_sim->bss_size, mem_sim->heap_stack_size);
+    // "--key=value" flags override the same settings on the script's init line
+    char* scriptPath;
+    char overrides[BUFSIZ];
+    int quiet;
+    int show_stats;
+    if (parse_vmem_flags(tokens, tokenCount, 1, &scriptPath, overrides, sizeof(overrides),
+                         &quiet, &show_stats) != 0) {
+        fprintf(stderr, "Usage: vmem [-q|--stats] [--policy=<name>] <script|trace.bin>\n"
+                        "       vmem open <config|script|trace.bin> [-q] [--key=value]...\n"
+                        "       vmem exec <script|trace.bin> [-q|--stats]\n"
+                        "       vmem stats | vmem close\n"
+                        "       vmem convert <script.txt> <trace.bin>\n"
+                        "       vmem sweep <script|trace.bin> <key>=<values>... [threads=<n>] [format=csv|json] [sort=time|faults]\n"
+                        "       vmem mrc <script|trace.bin> [page=<size>] [format=csv]\n"
+                        "       vmem gen <script|trace.bin> <zipf|seq|loop|stride|random> [n=<accesses>] ...\n"
+                        "       vmem smp <script|trace.bin> <zipf|seq|loop|stride|random> [cpus=<n>,...] ...\n"
+                        "       vmem bench [frames] [accesses]\n"
+                        "       vmem bench suite [n=<accesses>] [baseline=<file>] [save=<file>]\n");
+        return -1;
+    }
     
-    return mem_sim;
-}
-int handleVmem(char* scriptPath) {
-    // Open the script file
-    FILE* script = fopen(scriptPath, "r");
+    // Open the script or trace and read its init line
+    char line[256];
+    trace_map trace;
+    FILE* script = open_script(scriptPath, line, sizeof(line), &trace);
     if (!script) {
-        fprintf(stderr, "Error: Cannot open script file %s\n", scriptPath);
         return -1;  // Return error code
     }
     
-    // Read the first line for initialization
-    char line[256];
-    if (!fgets(line, sizeof(line), script)) {
-        fprintf(stderr, "Error: Invalid script format\n");
+    // Initialize the system using the first line plus any flag overrides
+    char init_line[sizeof(line) + sizeof(overrides)];
+    snprintf(init_line, sizeof(init_line), "%s%s", line, overrides);
+    sim_database* mem_sim = init_system(init_line);
+    if (!mem_sim) {
+        fprintf(stderr, "Error: Failed to initialize memory system\n");
+        if (trace.data != MAP_FAILED) munmap(trace.data, trace.size);
         fclose(script);
         return -1;  // Return error code
     }
+    mem_sim->quiet = quiet;
     
-    // Remove newline from first line
-    line[strcspn(line, "\n")] = '\0';
+    // Print initialization message
+    vmem_process* proc = mem_sim->procs[0];
+    printf("Loaded program \"%s\" with text=%d, data=%d, bss=%d, heap_stack=%lld.\n",
+           proc->program_name, proc->text_size, proc->data_size,
+           proc->bss_size, (long long)proc->heap_stack_size);
     
-    // Initialize the system using the first line
-    sim_database* mem_sim = init_system(line);
-    if (!mem_sim) {
-        fprintf(stderr, "Error: Failed to initialize memory system\n");
-        fclose(script);
-        return -1;  // Return error code
+    // Process commands from the script or trace
+    int result = run_opened_script(mem_sim, script, &trace);
+    finish_snapshots(mem_sim);
+    
+    // Final summary for --stats replays
+    if (show_stats) {
+        vmem_flush(mem_sim);
+        print_stats(mem_sim);
     }
     
-    // Process commands from the script
-    while (fgets(line, sizeof(line), script)) {
-        // Remove newline
-        line[strcspn(line, "\n")] = '\0';
+    // Clean up
+    fclose(script);
+    clear_system(mem_sim);
+    return result;
+}
+
+// Counts this thread's hardware cache misses; -1 where perf events are unavailable
+static int open_cache_miss_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long read_cache_misses(int fd) {
+    long long count;
+    if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+    return (long)count;
+}
+
+// One row of the PTE layout table; misses are "n/a" without a counter
+static void print_pte_row(const char* layout, const char* bytes, double lookup_ns,
+                          long lookup_misses, double scan_ms, long scan_misses) {
+    char lookup[32] = "        -", misses[32] = "-", scan[32] = "n/a";
+    if (lookup_ns >= 0) {
+        snprintf(lookup, sizeof(lookup), "%9.1f", lookup_ns);
+        if (lookup_misses >= 0) snprintf(misses, sizeof(misses), "%ld", lookup_misses);
+        else strcpy(misses, "n/a");
+    }
+    if (scan_misses >= 0) snprintf(scan, sizeof(scan), "%ld", scan_misses);
+    printf(" %-12s | %9s | %s | %13s | %7.2f | %11s\n",
+           layout, bytes, lookup, misses, scan_ms, scan);
+}
+
+/**
+ * bench_pte_layouts - Cache behaviour of page table entry layouts
+ * Compares the old four-int descriptor with the packed one on random
+ * translations (valid bit and frame) and on a scan of every valid bit, the
+ * access pattern of whole-table walks. A dense bitmap of the hot flag
+ * answers the scan from 1/64 of the packed table's memory.
+ */
+static void bench_pte_layouts(long accesses) {
+    typedef struct {
+        int V;
+        int D;
+        int P;
+        int frame_swap;
+    } pte_unpacked;
+    const long count = 1L << 22;
+    pte_unpacked* unpacked = (pte_unpacked*)malloc(count * sizeof(pte_unpacked));
+    page_descriptor* packed = (page_descriptor*)calloc(count, sizeof(page_descriptor));
+    uint64_t* hot = (uint64_t*)calloc(count / 64, sizeof(uint64_t));
+    if (!unpacked || !packed || !hot) {
+        perror("Error allocating PTE benchmark");
+        free(unpacked);
+        free(packed);
+        free(hot);
+        return;
+    }
+    
+    // Every fourth page resident, as in a table much larger than memory
+    for (long page = 0; page < count; page++) {
+        int valid = (page % 4 == 0);
+        unpacked[page].V = valid;
+        unpacked[page].D = 0;
+        unpacked[page].P = 0;
+        unpacked[page].frame_swap = valid ? (int)(page / 4) : -1;
+        packed[page].V = valid;
+        packed[page].frame_swap = valid ? page / 4 : -1;
+        if (valid) hot[page / 64] |= 1ULL << (page % 64);
+    }
+    
+    printf("\nPTE layout: %ld entries, %ld random translations\n", count, accesses);
+    printf(" Layout       | Bytes/PTE | Lookup ns | Lookup misses | Scan ms | Scan misses\n");
+    printf("--------------|-----------|-----------|---------------|---------|------------\n");
+    
+    int fd = open_cache_miss_counter();
+    volatile long sink = 0;
+    for (int layout = 0; layout < 3; layout++) {
+        struct timespec start, end;
+        double lookup_ns = -1;
+        long lookup_misses = -1;
         
-        // Skip empty lines
-        if (strlen(line) == 0) continue;
+        // The same pseudo-random page sequence for each layout
+        if (layout < 2) {
+            uint64_t x = 88172645463325252ULL;
+            long sum = 0;
+            long before = read_cache_misses(fd);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (long i = 0; i < accesses; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                long page = (long)(x & (count - 1));
+                if (layout == 0) {
+                    if (unpacked[page].V) sum += unpacked[page].frame_swap;
+                } else {
+                    if (packed[page].V) sum += packed[page].frame_swap;
+                }
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            long after = read_cache_misses(fd);
+            sink += sum;
+            lookup_ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / accesses;
+            if (before >= 0 && after >= 0) lookup_misses = after - before;
+        }
         
-        // Parse the command
-        char command[20];
-        int address;
-        char value;
+        long resident = 0;
+        long before = read_cache_misses(fd);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (layout == 0) {
+            for (long page = 0; page < count; page++) resident += unpacked[page].V;
+        } else if (layout == 1) {
+            for (long page = 0; page < count; page++) resident += packed[page].V;
+        } else {
+            for (long word = 0; word < count / 64; word++) resident += __builtin_popcountll(hot[word]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long after = read_cache_misses(fd);
+        sink += resident;
+        double scan_ms = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e6;
+        long scan_misses = (before >= 0 && after >= 0) ? after - before : -1;
+        
+        if (layout == 0) {
+            print_pte_row("4 ints", "16", lookup_ns, lookup_misses, scan_ms, scan_misses);
+        } else if (layout == 1) {
+            char bytes[16];
+            snprintf(bytes, sizeof(bytes), "%d", (int)sizeof(page_descriptor));
+            print_pte_row("packed", bytes, lookup_ns, lookup_misses, scan_ms, scan_misses);
+        } else {
+            print_pte_row("V bitmap", "1/8", lookup_ns, lookup_misses, scan_ms, scan_misses);
+        }
+    }
+    if (fd >= 0) close(fd);
+    else printf("(cache misses need perf events; see /proc/sys/kernel/perf_event_paranoid)\n");
+    
+    free(unpacked);
+    free(packed);
+    free(hot);
+}
+
+/**
+ * handleVmemBench - Measures page fault throughput of the simulator
+ * Replays a cyclic scan over more pages than there are frames, so every
+ * access faults and evicts, and reports the cost per fault for several
+ * page table sizes. Fault cost should stay flat as num_pages grows.
+ * Then compares startup and swap fault cost of the syscall and mmap backends,
+ * fault cost and stalls of the dirty page writeback modes and of the
+ * compressed swap tier, fault cost and host memory of the page table
+ * organisations, and the cache behaviour of the page table entry layout.
+ */
+int handleVmemBench(char** tokens, int tokenCount) {
+    int frames = (tokenCount > 2) ? atoi(tokens[2]) : 64;
+    long accesses = (tokenCount > 3) ? atol(tokens[3]) : 200000;
+    if (frames <= 0 || accesses <= 0) {
+        fprintf(stderr, "Usage: vmem bench [frames] [accesses]\n");
+        return -1;
+    }
+    
+    const int page_size = 64;
+    const int page_counts[] = {1024, 16384, 262144, 1048576};
+    const char* swap_name = "vmem_bench.swp";
+    
+    printf("=== VMEM FAULT BENCHMARK ===\n");
+    printf("Frames: %d, Page size: %d bytes, Accesses per run: %ld\n",
+           frames, page_size, accesses);
+    printf("  Pages  |  Faults  | ns/fault\n");
+    printf("---------|----------|---------\n");
+    
+    for (size_t run = 0; run < sizeof(page_counts) / sizeof(page_counts[0]); run++) {
+        int num_pages = page_counts[run];
+        if (num_pages <= frames) continue;
         
-        if (sscanf(line, "%s", command) < 1) continue;
+        // Everything is heap/stack so faults never touch the program file
+        char init_line[256];
+        snprintf(init_line, sizeof(init_line), "/dev/null %s 0 0 0 %d %d %d %d %d",
+                 swap_name, num_pages * page_size, page_size, num_pages,
+                 frames * page_size, page_size);
+        sim_database* mem_sim = init_system(init_line);
+        if (!mem_sim) {
+            unlink(swap_name);
+            return -1;
+        }
+        mem_sim->quiet = 1;
         
-        if (strcmp(command, "load") == 0) {
-            if (sscanf(line, "load %d", &address) == 1) {
-                char result = load(mem_sim, address);
-                if (result != '\0') {
-                    printf("Value at address %d = %c\n", address, result);
-                }
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long i = 0; i < accesses; i++) {
+            int page = (int)(i % num_pages);
+            load(mem_sim, page * page_size);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        
+        double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        long faults = mem_sim->stats.faults;
+        printf("%8d | %8ld | %8.1f\n", num_pages, faults, faults ? ns / faults : 0.0);
+        
+        clear_system(mem_sim);
+        unlink(swap_name);
+    }
+    
+    // Page I/O backends: startup with a 64 MB swap file, then a cyclic store
+    // pattern over 4x more pages than frames so every fault swaps in and out
+    const int io_page_size = 4096;
+    const int io_pages = frames * 4;
+    const char* io_modes[] = {"syscall", "mmap"};
+    long swap_bytes = (long)io_pages * io_page_size;
+    if (swap_bytes < 64L * 1024 * 1024) swap_bytes = 64L * 1024 * 1024;
+    
+    printf("\nPage I/O: %d frames, %d pages of %d bytes, %ld dirty accesses\n",
+           frames, io_pages, io_page_size, accesses);
+    printf(" Backend | Startup (ms) | ns/fault\n");
+    printf("---------|--------------|---------\n");
+    for (int mode = 0; mode < 2; mode++) {
+        char init_line[256];
+        snprintf(init_line, sizeof(init_line), "/dev/null %s 0 0 0 %d %d %d %d %ld io=%s",
+                 swap_name, io_pages * io_page_size, io_page_size, io_pages,
+                 frames * io_page_size, swap_bytes, io_modes[mode]);
+        
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        sim_database* mem_sim = init_system(init_line);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (!mem_sim) {
+            unlink(swap_name);
+            return -1;
+        }
+        mem_sim->quiet = 1;
+        double startup_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+        
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long i = 0; i < accesses; i++) {
+            store(mem_sim, (int)(i % io_pages) * io_page_size, 'x');
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        
+        double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        long faults = mem_sim->stats.faults;
+        printf(" %-7s | %12.3f | %8.1f\n", io_modes[mode], startup_ms, faults ? ns / faults : 0.0);
+        
+        clear_system(mem_sim);
+        unlink(swap_name);
+    }
+    
+    // Writeback modes on the syscall backend, same dirty cyclic pattern
+    const char* wb_modes[] = {"sync", "batch", "async"};
+    printf("\nWriteback (io=syscall): queue of 64 pages, async flusher from 16\n");
+    printf(" Mode  | ns/fault | Pages/write | Stalls | Stall (ms)\n");
+    printf("-------|----------|-------------|--------|-----------\n");
+    for (int mode = 0; mode < 3; mode++) {
+        char init_line[256];
+        snprintf(init_line, sizeof(init_line),
+                 "/dev/null %s 0 0 0 %d %d %d %d %ld io=syscall writeback=%s",
+                 swap_name, io_pages * io_page_size, io_page_size, io_pages,
+                 frames * io_page_size, swap_bytes, wb_modes[mode]);
+        sim_database* mem_sim = init_system(init_line);
+        if (!mem_sim) {
+            unlink(swap_name);
+            return -1;
+        }
+        mem_sim->quiet = 1;
+        
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long i = 0; i < accesses; i++) {
+            store(mem_sim, (int)(i % io_pages) * io_page_size, 'x');
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        writeback_drain(mem_sim);
+        
+        double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        vmem_stats* st = &mem_sim->stats;
+        printf(" %-5s | %8.1f | %11.2f | %6ld | %10.3f\n", wb_modes[mode],
+               st->faults ? ns / st->faults : 0.0,
+               st->wb_writes ? (double)st->wb_pages / st->wb_writes : 0.0,
+               st->wb_stalls, st->wb_stall_ns / 1e6);
+        
+        clear_system(mem_sim);
+        unlink(swap_name);
+    }
+    
+    // Compressed swap tier on the syscall backend, same dirty cyclic pattern:
+    // off, then a tier a quarter of the space (mostly zero pages compress well)
+    const long zswap_sizes[] = {0, (long)io_pages * io_page_size / 4};
+    printf("\nCompressed swap (io=syscall)\n");
+    printf(" Tier (bytes) | ns/fault | Ratio | Hit rate | Spills | Modeled ns/access\n");
+    printf("--------------|----------|-------|----------|--------|------------------\n");
+    for (int run = 0; run < 2; run++) {
+        char init_line[256];
+        snprintf(init_line, sizeof(init_line),
+                 "/dev/null %s 0 0 0 %d %d %d %d %ld io=syscall zswap=%ld",
+                 swap_name, io_pages * io_page_size, io_page_size, io_pages,
+                 frames * io_page_size, swap_bytes, zswap_sizes[run]);
+        sim_database* mem_sim = init_system(init_line);
+        if (!mem_sim) {
+            unlink(swap_name);
+            return -1;
+        }
+        mem_sim->quiet = 1;
+        
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long i = 0; i < accesses; i++) {
+            store(mem_sim, (int)(i % io_pages) * io_page_size, 'x');
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        
+        double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        vmem_stats* st = &mem_sim->stats;
+        printf(" %12ld | %8.1f | %5.1f | %7.2f%% | %6ld | %17.1f\n", zswap_sizes[run],
+               st->faults ? ns / st->faults : 0.0,
+               st->zswap_bytes_out ? (double)st->zswap_bytes_in / st->zswap_bytes_out : 1.0,
+               st->faults_swap ? 100.0 * st->faults_zswap / st->faults_swap : 0.0,
+               st->zswap_spills, vmem_access_time(mem_sim, NULL));
+        
+        clear_system(mem_sim);
+        unlink(swap_name);
+    }
+    
+    // Page table organisations: a cyclic scan over 4x more pages than frames,
+    // spread evenly over a dense space and over a sparse 48-bit one
+    const char* pt_types[] = {"flat", "radix", "inverted"};
+    const int64_t pt_spaces[] = {(int64_t)1 << 20, (int64_t)1 << 36};
+    const int pt_page_size = 4096;
+    const int pt_pages = frames * 4;
+    printf("\nPage tables: %d frames, %d pages of %d bytes spread over the space\n",
+           frames, pt_pages, pt_page_size);
+    printf(" Table    | Space (pages) | ns/fault | Table bytes\n");
+    printf("----------|---------------|----------|------------\n");
+    for (int space = 0; space < 2; space++) {
+        for (int type = 0; type < 3; type++) {
+            int64_t num_pages = pt_spaces[space];
+            if (type == 0 && num_pages > ((int64_t)1 << 24)) {
+                printf(" %-8s | %13lld |        - |  too large\n", pt_types[type], (long long)num_pages);
+                continue;
+            }
+            char init_line[256];
+            snprintf(init_line, sizeof(init_line), "/dev/null %s 0 0 0 %lld %d %lld %d %d pagetable=%s",
+                     swap_name, (long long)(num_pages * pt_page_size), pt_page_size,
+                     (long long)num_pages, frames * pt_page_size, pt_pages * pt_page_size,
+                     pt_types[type]);
+            sim_database* mem_sim = init_system(init_line);
+            if (!mem_sim) {
+                unlink(swap_name);
+                return -1;
+            }
+            mem_sim->quiet = 1;
+            
+            int64_t stride = num_pages / pt_pages;
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (long i = 0; i < accesses; i++) {
+                load(mem_sim, (i % pt_pages) * stride * pt_page_size);
             }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            
+            double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+            long faults = mem_sim->stats.faults;
+            printf(" %-8s | %13lld | %8.1f | %11ld\n", pt_types[type], (long long)num_pages,
+                   faults ? ns / faults : 0.0, mem_sim->stats.pt_bytes);
+            
+            clear_system(mem_sim);
+            unlink(swap_name);
         }
-        else if (strcmp(command, "store") == 0) {
-            if (sscanf(line, "store %d %c", &address, &value) == 2) {
-                store(mem_sim, address, value);
-                // Only print success if store didn't print an error
-                // Check if the store was successful by verifying the value was written
-                if (load(mem_sim, address) == value) {
-                    printf("Stored value '%c' at address %d\n", value, address);
+    }
+    
+    bench_pte_layouts(accesses);
+    printf("============================\n\n");
+    return 0;
+}
+/* ---- Parameter sweeps: many simulations over one shared trace ---- */
+
+// One decoded trace record; print records are dropped
+typedef struct {
+    unsigned char op;               // TRACE_OP_LOAD / STORE / SWITCH / SPAWN / range ops
+    char value;                     // Byte written by a store
+    int64_t arg;                    // Address, ASID or index into spawns or ranges
+} sweep_op;
+
+// Operands of a range record (loadrange, storerange, memset, memcpy)
+typedef struct {
+    int64_t address;                // Start, or memcpy destination
+    int64_t source;                 // memcpy source
+    int64_t length;
+    char value;                     // memset byte
+    char* data;                     // storerange bytes
+} sweep_range;
+
+// A spawned process, sized in bytes so any page size can be applied
+typedef struct {
+    char program[256];
+    int text_size;
+    int data_size;
+    int bss_size;
+    int64_t heap_stack_size;
+    int64_t space;                  // Virtual address space in bytes
+} sweep_spawn;
+
+#define SWEEP_MAX_DIMS     8
+#define SWEEP_MAX_VALUES   64
+#define SWEEP_MAX_JOBS     65536
+
+// One swept setting: "key=a,b,c" or "key=lo..hi" (doubling from lo)
+typedef struct {
+    char key[32];
+    char values[SWEEP_MAX_VALUES][32];
+    int count;
+} sweep_dim;
+
+typedef struct {
+    char init_line[512];
+    int page_size;
+    int failed;
+    vmem_stats stats;
+    vmem_time time;                 // Modeled time under the job's cost_* settings
+    double access_time;             // ...and its effective access time in ns
+} sweep_job;
+
+typedef struct {
+    // Read-only once the workers start
+    sweep_op* ops;
+    long num_ops;
+    long num_stores;                // Bounds the pages that can ever reach swap
+    sweep_spawn* spawns;
+    int num_spawns;
+    sweep_range* ranges;
+    long num_ranges;
+    int64_t range_store_bytes;      // Bytes written by range records, for the same bound
+    long num_range_stores;
+    sweep_job* jobs;
+    int num_jobs;
+
+    pthread_mutex_t lock;
+    int next_job;                   // Next job to hand out, under lock
+} vmem_sweep;
+
+static int sweep_add_op(vmem_sweep* sweep, long* capacity, int op, int64_t arg, char value) {
+    if (sweep->num_ops == *capacity) {
+        long new_capacity = *capacity ? *capacity * 2 : 4096;
+        sweep_op* ops = (sweep_op*)realloc(sweep->ops, new_capacity * sizeof(sweep_op));
+        if (!ops) {
+            perror("Error allocating sweep trace");
+            return -1;
+        }
+        sweep->ops = ops;
+        *capacity = new_capacity;
+    }
+    sweep_op* rec = &sweep->ops[sweep->num_ops++];
+    rec->op = (unsigned char)op;
+    rec->arg = arg;
+    rec->value = value;
+    if (op == TRACE_OP_STORE) sweep->num_stores++;
+    return 0;
+}
+
+// Record a spawn from "spawn" arguments, converting its size in pages to bytes
+static int sweep_add_spawn(vmem_sweep* sweep, long* capacity, const char* args, int page_size) {
+    sweep_spawn spawn;
+    long long heap_stack_size, num_pages;
+    if (sscanf(args, "%255s %d %d %d %lld %lld", spawn.program, &spawn.text_size, &spawn.data_size,
+               &spawn.bss_size, &heap_stack_size, &num_pages) != 6 ||
+        num_pages < 0 || num_pages > INT64_MAX / page_size) {
+        fprintf(stderr, "Error: Invalid spawn record '%s'\n", args);
+        return -1;
+    }
+    spawn.heap_stack_size = heap_stack_size;
+    spawn.space = num_pages * page_size;
+
+    sweep_spawn* spawns = (sweep_spawn*)realloc(sweep->spawns,
+                                                (sweep->num_spawns + 1) * sizeof(sweep_spawn));
+    if (!spawns) {
+        perror("Error allocating sweep trace");
+        return -1;
+    }
+    sweep->spawns = spawns;
+    sweep->spawns[sweep->num_spawns] = spawn;
+    return sweep_add_op(sweep, capacity, TRACE_OP_SPAWN, sweep->num_spawns++, 0);
+}
+
+// Record a range op; writes also widen the bound on pages that reach swap
+static int sweep_add_range(vmem_sweep* sweep, long* capacity, int op, int64_t address,
+                           int64_t source, int64_t length, char value, const char* data) {
+    if (length < 0) return 0;       // Refused by the simulator anyway
+    sweep_range* ranges = (sweep_range*)realloc(sweep->ranges,
+                                                (sweep->num_ranges + 1) * sizeof(sweep_range));
+    if (!ranges) {
+        perror("Error allocating sweep trace");
+        return -1;
+    }
+    sweep->ranges = ranges;
+    sweep_range* range = &ranges[sweep->num_ranges];
+    range->address = address;
+    range->source = source;
+    range->length = length;
+    range->value = value;
+    range->data = NULL;
+    if (data) {
+        if (!(range->data = (char*)malloc(length ? length : 1))) {
+            perror("Error allocating sweep trace");
+            return -1;
+        }
+        memcpy(range->data, data, length);
+    }
+    if (op != TRACE_OP_LOADRANGE) {
+        sweep->range_store_bytes += length;
+        sweep->num_range_stores++;
+    }
+    return sweep_add_op(sweep, capacity, op, sweep->num_ranges++, 0);
+}
+
+// Release everything sweep_decode() built
+static void sweep_free_trace(vmem_sweep* sweep) {
+    for (long i = 0; i < sweep->num_ranges; i++) free(sweep->ranges[i].data);
+    free(sweep->ranges);
+    free(sweep->ops);
+    free(sweep->spawns);
+}
+
+// Decode a text script or binary trace once into the shared op array
+static int sweep_decode(vmem_sweep* sweep, FILE* script, const trace_map* trace, int page_size) {
+    long capacity = 0;
+
+    if (trace->data == MAP_FAILED) {
+        char line[256];
+        while (fgets(line, sizeof(line), script)) {
+            long long address, source, length;
+            char value;
+            int data_start = 0;
+            int rc = 0;
+
+            if (sscanf(line, "load %lld", &address) == 1) {
+                rc = sweep_add_op(sweep, &capacity, TRACE_OP_LOAD, address, 0);
+            } else if (sscanf(line, "store %lld %c", &address, &value) == 2) {
+                rc = sweep_add_op(sweep, &capacity, TRACE_OP_STORE, address, value);
+            } else if (sscanf(line, "switch %lld", &address) == 1) {
+                rc = sweep_add_op(sweep, &capacity, TRACE_OP_SWITCH, address, 0);
+            } else if (strncmp(line, "spawn ", 6) == 0) {
+                rc = sweep_add_spawn(sweep, &capacity, line + 6, page_size);
+            } else if (sscanf(line, "loadrange %lld %lld", &address, &length) == 2) {
+                rc = sweep_add_range(sweep, &capacity, TRACE_OP_LOADRANGE, address, 0, length, 0, NULL);
+            } else if (sscanf(line, "storerange %lld %n", &address, &data_start) == 1 &&
+                       line[data_start] && line[data_start] != '\n') {
+                rc = sweep_add_range(sweep, &capacity, TRACE_OP_STORERANGE, address, 0,
+                                     strcspn(line + data_start, "\n"), 0, line + data_start);
+            } else if (sscanf(line, "memset %lld %c %lld", &address, &value, &length) == 3) {
+                rc = sweep_add_range(sweep, &capacity, TRACE_OP_MEMSET, address, 0, length, value, NULL);
+            } else if (sscanf(line, "memcpy %lld %lld %lld", &address, &source, &length) == 3) {
+                rc = sweep_add_range(sweep, &capacity, TRACE_OP_MEMCPY, address, source, length, 0, NULL);
+            }
+            if (rc != 0) return -1;
+        }
+        return 0;
+    }
+
+    const unsigned char* p = trace->records;
+    const unsigned char* end = trace->data + trace->size;
+    while (p < end) {
+        int op = *p++;
+        int64_t arg = 0, source = 0, length = 0;
+        char value = 0;
+        char args[256];
+        int rc;
+
+        switch (op) {
+            case TRACE_OP_LOAD:
+            case TRACE_OP_SWITCH:
+                p = decode_varint(p, end, &arg);
+                break;
+            case TRACE_OP_STORE:
+                p = decode_varint(p, end, &arg);
+                if (p && p < end) value = (char)*p++;
+                else p = NULL;
+                break;
+            case TRACE_OP_PRINT:
+                p = (p < end) ? p + 1 : NULL;
+                continue;
+            case TRACE_OP_CHECKPOINT:
+            case TRACE_OP_RESTORE:
+                // Images belong to one simulator; sweeps replay the plain trace
+                p = (p < end && p + 1 + *p <= end) ? p + 1 + *p : NULL;
+                if (!p) break;
+                continue;
+            case TRACE_OP_SPAWN:
+                if (p >= end || p + 1 + *p > end) {
+                    p = NULL;
+                    break;
+                }
+                memcpy(args, p + 1, *p);
+                args[*p] = '\0';
+                p += 1 + *p;
+                if (sweep_add_spawn(sweep, &capacity, args, page_size) != 0) return -1;
+                continue;
+            case TRACE_OP_LOADRANGE:
+            case TRACE_OP_MEMCPY:
+                if ((p = decode_varint(p, end, &arg)) && op == TRACE_OP_MEMCPY) {
+                    p = decode_varint(p, end, &source);
+                }
+                if (p) p = decode_varint(p, end, &length);
+                if (!p) break;
+                rc = sweep_add_range(sweep, &capacity, op, arg, source, length, 0, NULL);
+                if (rc != 0) return -1;
+                continue;
+            case TRACE_OP_STORERANGE:
+                if (!(p = decode_varint(p, end, &arg)) || p >= end || p + 1 + *p > end) {
+                    p = NULL;
+                    break;
+                }
+                rc = sweep_add_range(sweep, &capacity, op, arg, 0, *p, 0, (const char*)p + 1);
+                if (rc != 0) return -1;
+                p += 1 + *p;
+                continue;
+            case TRACE_OP_MEMSET:
+                if ((p = decode_varint(p, end, &arg)) && p < end) {
+                    value = (char)*p++;
+                    p = decode_varint(p, end, &length);
+                } else {
+                    p = NULL;
                 }
+                if (!p) break;
+                if (sweep_add_range(sweep, &capacity, op, arg, 0, length, value, NULL) != 0) return -1;
+                continue;
+            default:
+                fprintf(stderr, "Error: Unknown trace op %d\n", op);
+                return -1;
+        }
+        if (!p) {
+            fprintf(stderr, "Error: Truncated trace record\n");
+            return -1;
+        }
+        if (sweep_add_op(sweep, &capacity, op, arg, value) != 0) return -1;
+    }
+    return 0;
+}
+
+// Expand "a,b,c" or "lo..hi" into a dimension's values
+static int parse_sweep_dim(sweep_dim* dim, const char* token) {
+    const char* eq = strchr(token, '=');
+    size_t key_len = eq - token;
+    if (key_len == 0 || key_len >= sizeof(dim->key) || eq[1] == '\0') {
+        fprintf(stderr, "Error: Invalid sweep setting '%s'\n", token);
+        return -1;
+    }
+    memcpy(dim->key, token, key_len);
+    dim->key[key_len] = '\0';
+    dim->count = 0;
+
+    const char* list = eq + 1;
+    const char* dots = strstr(list, "..");
+    if (dots) {
+        char* end;
+        long lo = strtol(list, &end, 10);
+        long hi = (end == dots) ? strtol(dots + 2, &end, 10) : 0;
+        if (end == dots || *end != '\0' || lo <= 0 || hi < lo) {
+            fprintf(stderr, "Error: Invalid range '%s' (use lo..hi, doubling from lo)\n", list);
+            return -1;
+        }
+        for (long v = lo; v <= hi && dim->count < SWEEP_MAX_VALUES; v *= 2) {
+            snprintf(dim->values[dim->count++], sizeof(dim->values[0]), "%ld", v);
+        }
+        return 0;
+    }
+
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", list);
+    char* save = NULL;
+    for (char* value = strtok_r(copy, ",", &save); value; value = strtok_r(NULL, ",", &save)) {
+        if (dim->count == SWEEP_MAX_VALUES || strlen(value) >= sizeof(dim->values[0])) {
+            fprintf(stderr, "Error: Too many or too long values for '%s'\n", dim->key);
+            return -1;
+        }
+        strcpy(dim->values[dim->count++], value);
+    }
+    return dim->count ? 0 : -1;
+}
+
+// Replay the shared trace on a fresh simulator built from the job's init line
+static void run_sweep_job(vmem_sweep* sweep, sweep_job* job) {
+    sim_database* mem_sim = init_system(job->init_line);
+    if (!mem_sim) {
+        job->failed = 1;
+        return;
+    }
+    mem_sim->quiet = 1;
+    mem_sim->snapshot_every = 0;  // Concurrent jobs would all write the same file
+
+    for (long i = 0; i < sweep->num_ops; i++) {
+        const sweep_op* rec = &sweep->ops[i];
+        switch (rec->op) {
+            case TRACE_OP_LOAD:
+                script_load(mem_sim, rec->arg);
+                break;
+            case TRACE_OP_STORE:
+                script_store(mem_sim, rec->arg, rec->value);
+                break;
+            case TRACE_OP_SWITCH:
+                switch_process(mem_sim, (int)rec->arg);
+                break;
+            case TRACE_OP_SPAWN: {
+                const sweep_spawn* spawn = &sweep->spawns[rec->arg];
+                int64_t num_pages = (spawn->space + job->page_size - 1) / job->page_size;
+                create_process(mem_sim, spawn->program, spawn->text_size, spawn->data_size,
+                               spawn->bss_size, spawn->heap_stack_size, num_pages);
+                break;
+            }
+            case TRACE_OP_LOADRANGE:
+                script_loadrange(mem_sim, sweep->ranges[rec->arg].address, sweep->ranges[rec->arg].length);
+                break;
+            case TRACE_OP_STORERANGE:
+                store_range(mem_sim, sweep->ranges[rec->arg].address, sweep->ranges[rec->arg].data,
+                            sweep->ranges[rec->arg].length);
+                break;
+            case TRACE_OP_MEMSET:
+                memset_range(mem_sim, sweep->ranges[rec->arg].address, sweep->ranges[rec->arg].value,
+                             sweep->ranges[rec->arg].length);
+                break;
+            case TRACE_OP_MEMCPY:
+                copy_range(mem_sim, sweep->ranges[rec->arg].address, sweep->ranges[rec->arg].source,
+                           sweep->ranges[rec->arg].length);
+                break;
+        }
+    }
+
+    writeback_drain(mem_sim);
+    job->stats = mem_sim->stats;
+    job->access_time = vmem_access_time(mem_sim, &job->time);
+    clear_system(mem_sim);
+}
+
+static void* sweep_worker(void* arg) {
+    vmem_sweep* sweep = (vmem_sweep*)arg;
+    for (;;) {
+        pthread_mutex_lock(&sweep->lock);
+        int job = sweep->next_job++;
+        pthread_mutex_unlock(&sweep->lock);
+        if (job >= sweep->num_jobs) break;
+
+        run_sweep_job(sweep, &sweep->jobs[job]);
+
+        // Each job owns its swap file; nothing needs it afterwards
+        char swap_name[64];
+        if (sscanf(sweep->jobs[job].init_line, "%*s %63s", swap_name) == 1) {
+            unlink(swap_name);
+        }
+    }
+    return NULL;
+}
+
+#define SWEEP_SORT_NONE   0         // Job order: the last setting varies fastest
+#define SWEEP_SORT_TIME   1         // Modeled access time, fastest first
+#define SWEEP_SORT_FAULTS 2
+
+static int compare_job_time(const void* a, const void* b) {
+    const sweep_job* x = *(const sweep_job* const*)a;
+    const sweep_job* y = *(const sweep_job* const*)b;
+    if (x->failed != y->failed) return x->failed - y->failed;
+    if (x->access_time != y->access_time) return x->access_time < y->access_time ? -1 : 1;
+    return (x > y) - (x < y);
+}
+
+static int compare_job_faults(const void* a, const void* b) {
+    const sweep_job* x = *(const sweep_job* const*)a;
+    const sweep_job* y = *(const sweep_job* const*)b;
+    if (x->failed != y->failed) return x->failed - y->failed;
+    if (x->stats.faults != y->stats.faults) return x->stats.faults < y->stats.faults ? -1 : 1;
+    return (x > y) - (x < y);
+}
+
+// Values that look like numbers are emitted bare in JSON, the rest quoted
+static int is_number(const char* s) {
+    char* end;
+    strtod(s, &end);
+    return end != s && *end == '\0';
+}
+
+/**
+ * handleVmemSweep - Replays one trace under every combination of settings
+ * Usage: vmem sweep <script|trace.bin> <key>=<values>... [threads=<n>] [format=csv|json]
+ *                   [sort=time|faults]
+ * frames= and page= set the frame count and page size (memory and swap are
+ * sized to match); any other key is passed on as an init line option, e.g.
+ * tlb=0,16,64 policy=lru,clock. Values are a comma list or lo..hi, which
+ * doubles from lo. The trace is decoded once and shared read-only by a pool
+ * of worker threads, each running independent simulators. sort=time ranks
+ * the configurations by modeled access time (see the cost_* options).
+ */
+int handleVmemSweep(char** tokens, int tokenCount) {
+    sweep_dim dims[SWEEP_MAX_DIMS];
+    int num_dims = 0;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int json = 0;
+    int sort = SWEEP_SORT_NONE;
+
+    if (tokenCount < 3) {
+        fprintf(stderr, "Usage: vmem sweep <script|trace.bin> <key>=<values>... "
+                        "[threads=<n>] [format=csv|json] [sort=time|faults]\n");
+        return -1;
+    }
+    for (int i = 3; i < tokenCount; i++) {
+        if (!strchr(tokens[i], '=')) {
+            fprintf(stderr, "Error: Invalid sweep setting '%s'\n", tokens[i]);
+            return -1;
+        }
+        if (strncmp(tokens[i], "threads=", 8) == 0) {
+            threads = atoi(tokens[i] + 8);
+        } else if (strcmp(tokens[i], "format=json") == 0) {
+            json = 1;
+        } else if (strcmp(tokens[i], "format=csv") == 0) {
+            json = 0;
+        } else if (strcmp(tokens[i], "sort=time") == 0) {
+            sort = SWEEP_SORT_TIME;
+        } else if (strcmp(tokens[i], "sort=faults") == 0) {
+            sort = SWEEP_SORT_FAULTS;
+        } else if (strncmp(tokens[i], "sort=", 5) == 0) {
+            fprintf(stderr, "Error: Unknown sort '%s' (use time or faults)\n", tokens[i] + 5);
+            return -1;
+        } else if (num_dims == SWEEP_MAX_DIMS) {
+            fprintf(stderr, "Error: At most %d sweep settings\n", SWEEP_MAX_DIMS);
+            return -1;
+        } else if (parse_sweep_dim(&dims[num_dims], tokens[i]) != 0) {
+            return -1;
+        } else {
+            num_dims++;
+        }
+    }
+    if (threads <= 0) threads = 1;
+
+    // The trace's init line supplies the program layout and default settings
+    char line[256];
+    trace_map trace;
+    FILE* script = open_script(tokens[2], line, sizeof(line), &trace);
+    if (!script) return -1;
+
+    char exe_file_name[256];
+    int text_size, data_size, bss_size, page_size, memory_size;
+    long long heap_stack_size, num_pages;
+    int options_start = 0;
+    if (sscanf(line, "%255s %*s %d %d %d %lld %d %lld %d %*d%n", exe_file_name,
+               &text_size, &data_size, &bss_size, &heap_stack_size,
+               &page_size, &num_pages, &memory_size, &options_start) != 8 || page_size <= 0 ||
+        num_pages < 0 || num_pages > INT64_MAX / page_size) {
+        fprintf(stderr, "Error: Invalid script format\n");
+        if (trace.data != MAP_FAILED) munmap(trace.data, trace.size);
+        fclose(script);
+        return -1;
+    }
+
+    vmem_sweep sweep;
+    memset(&sweep, 0, sizeof(sweep));
+    int rc = sweep_decode(&sweep, script, &trace, page_size);
+    if (trace.data != MAP_FAILED) munmap(trace.data, trace.size);
+    fclose(script);
+    if (rc != 0) {
+        sweep_free_trace(&sweep);
+        return -1;
+    }
+
+    // Every combination of the swept values becomes one job
+    long num_jobs = 1;
+    for (int d = 0; d < num_dims; d++) {
+        num_jobs *= dims[d].count;
+        if (num_jobs > SWEEP_MAX_JOBS) {
+            fprintf(stderr, "Error: Sweep has more than %d configurations\n", SWEEP_MAX_JOBS);
+            sweep_free_trace(&sweep);
+            return -1;
+        }
+    }
+    sweep.num_jobs = (int)num_jobs;
+    sweep.jobs = (sweep_job*)calloc(num_jobs, sizeof(sweep_job));
+    if (!sweep.jobs) {
+        perror("Error allocating sweep jobs");
+        sweep_free_trace(&sweep);
+        return -1;
+    }
+
+    int64_t space = num_pages * page_size;
+
+    for (int job = 0; job < sweep.num_jobs; job++) {
+        sweep_job* j = &sweep.jobs[job];
+        int frames = memory_size / page_size;
+        int job_page = page_size;
+        char options[256] = "";
+
+        // Mixed-radix index: the last setting varies fastest
+        int rest = job;
+        for (int d = num_dims - 1; d >= 0; d--) {
+            const char* value = dims[d].values[rest % dims[d].count];
+            rest /= dims[d].count;
+            if (strcmp(dims[d].key, "frames") == 0) {
+                frames = atoi(value);
+            } else if (strcmp(dims[d].key, "page") == 0) {
+                job_page = atoi(value);
+            } else {
+                size_t len = strlen(options);
+                snprintf(options + len, sizeof(options) - len, " %s=%s", dims[d].key, value);
+            }
+        }
+
+        j->page_size = job_page;
+        if (frames <= 0 || job_page <= 0) {
+            j->failed = 1;
+            continue;
+        }
+        // Swap holds every page of every process, so it never fills up. Only
+        // stored pages get dirty, which bounds it for sparse address spaces
+        int64_t swap_pages = (space + job_page - 1) / job_page;
+        for (int i = 0; i < sweep.num_spawns; i++) {
+            swap_pages += (sweep.spawns[i].space + job_page - 1) / job_page;
+        }
+        int64_t stored_pages = sweep.num_stores + sweep.range_store_bytes / job_page +
+                               2 * sweep.num_range_stores;
+        if (swap_pages > INT_MAX / job_page && swap_pages > stored_pages) {
+            swap_pages = stored_pages ? stored_pages : 1;
+        }
+        snprintf(j->init_line, sizeof(j->init_line),
+                 "%s vmem_sweep.%d.%d.swp %d %d %d %lld %d %lld %ld %lld%s%s",
+                 exe_file_name, (int)getpid(), job, text_size, data_size, bss_size,
+                 heap_stack_size, job_page, (long long)((space + job_page - 1) / job_page),
+                 (long)frames * job_page, (long long)(swap_pages * job_page),
+                 line + options_start, options);
+    }
+
+    // Fan the jobs out over the worker pool
+    if (threads > sweep.num_jobs) threads = sweep.num_jobs;
+    pthread_t* workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    if (!workers) {
+        perror("Error allocating sweep threads");
+        free(sweep.jobs);
+        sweep_free_trace(&sweep);
+        return -1;
+    }
+    pthread_mutex_init(&sweep.lock, NULL);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, sweep_worker, &sweep) != 0) break;
+    }
+    if (started == 0) {
+        sweep_worker(&sweep);  // No threads available: run the jobs here
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_mutex_destroy(&sweep.lock);
+    free(workers);
+
+    // Results in job order (or ranked), whatever order the workers finished in
+    sweep_job** order = (sweep_job**)malloc(sweep.num_jobs * sizeof(sweep_job*));
+    if (!order) {
+        perror("Error allocating sweep results");
+        free(sweep.jobs);
+        sweep_free_trace(&sweep);
+        return -1;
+    }
+    for (int job = 0; job < sweep.num_jobs; job++) order[job] = &sweep.jobs[job];
+    if (sort == SWEEP_SORT_TIME) {
+        qsort(order, sweep.num_jobs, sizeof(sweep_job*), compare_job_time);
+    } else if (sort == SWEEP_SORT_FAULTS) {
+        qsort(order, sweep.num_jobs, sizeof(sweep_job*), compare_job_faults);
+    }
+
+    if (json) printf("[\n");
+    else {
+        for (int d = 0; d < num_dims; d++) printf("%s,", dims[d].key);
+        printf("accesses,faults,fault_rate,evictions,writebacks,prefetched,prefetch_useful,"
+               "prefetch_wasted,zswap_hits,tlb_hit_rate,access_time_ns,pt_bytes,sim_time_ms,"
+               "tlb_ms,walk_ms,mem_ms,disk_read_ms,disk_write_ms,zswap_ms\n");
+    }
+    for (int rank = 0; rank < sweep.num_jobs; rank++) {
+        sweep_job* j = order[rank];
+        int job = (int)(j - sweep.jobs);
+        vmem_stats* st = &j->stats;
+        vmem_time* t = &j->time;
+        long lookups = st->tlb_hits + st->tlb_misses;
+        double fault_rate = st->accesses ? (double)st->faults / st->accesses : 0.0;
+        double tlb_hit_rate = lookups ? (double)st->tlb_hits / lookups : 0.0;
+
+        int rest = job;
+        const char* values[SWEEP_MAX_DIMS];
+        for (int d = num_dims - 1; d >= 0; d--) {
+            values[d] = dims[d].values[rest % dims[d].count];
+            rest /= dims[d].count;
+        }
+
+        if (json) {
+            printf("  {");
+            for (int d = 0; d < num_dims; d++) {
+                printf(is_number(values[d]) ? "\"%s\": %s, " : "\"%s\": \"%s\", ",
+                       dims[d].key, values[d]);
+            }
+            if (j->failed) {
+                printf("\"error\": true}");
+            } else {
+                printf("\"accesses\": %ld, \"faults\": %ld, \"fault_rate\": %.6f, "
+                       "\"evictions\": %ld, \"writebacks\": %ld, \"prefetched\": %ld, "
+                       "\"prefetch_useful\": %ld, \"prefetch_wasted\": %ld, \"zswap_hits\": %ld, "
+                       "\"tlb_hit_rate\": %.6f, \"access_time_ns\": %.1f, \"pt_bytes\": %ld, "
+                       "\"sim_time_ms\": %.3f, \"tlb_ms\": %.3f, \"walk_ms\": %.3f, \"mem_ms\": %.3f, "
+                       "\"disk_read_ms\": %.3f, \"disk_write_ms\": %.3f, \"zswap_ms\": %.3f}",
+                       st->accesses, st->faults, fault_rate, st->evictions, st->writebacks,
+                       st->ra_pages, st->ra_useful, st->ra_wasted, st->zswap_hits,
+                       tlb_hit_rate, j->access_time, st->pt_bytes, t->total / 1e6, t->tlb / 1e6,
+                       t->walk / 1e6, t->mem / 1e6, t->disk_read / 1e6, t->disk_write / 1e6,
+                       t->zswap / 1e6);
+            }
+            printf("%s\n", rank + 1 < sweep.num_jobs ? "," : "");
+        } else {
+            for (int d = 0; d < num_dims; d++) printf("%s,", values[d]);
+            if (j->failed) {
+                printf("error,,,,,,,,,,,,,,,,,,\n");
+            } else {
+                printf("%ld,%ld,%.6f,%ld,%ld,%ld,%ld,%ld,%ld,%.6f,%.1f,%ld,%.3f,%.3f,%.3f,%.3f,"
+                       "%.3f,%.3f,%.3f\n",
+                       st->accesses, st->faults, fault_rate, st->evictions, st->writebacks,
+                       st->ra_pages, st->ra_useful, st->ra_wasted, st->zswap_hits,
+                       tlb_hit_rate, j->access_time, st->pt_bytes, t->total / 1e6, t->tlb / 1e6,
+                       t->walk / 1e6, t->mem / 1e6, t->disk_read / 1e6, t->disk_write / 1e6,
+                       t->zswap / 1e6);
+            }
+        }
+    }
+    if (json) printf("]\n");
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "Swept %d configurations of %ld records on %d threads in %.3f s\n",
+            sweep.num_jobs, sweep.num_ops, started ? started : 1, secs);
+
+    free(order);
+    free(sweep.jobs);
+    sweep_free_trace(&sweep);
+    return 0;
+}
+/* ---- Miss-ratio curves from LRU stack distances ---- */
+
+// Per-process state for stack-distance analysis
+typedef struct {
+    int64_t num_pages;
+    int text_pages;
+    int data_pages;
+    int bss_pages;
+} mrc_process;
+
+// Open-addressing map from (process, page) to the reference index of its last
+// use; sized by the trace rather than the address space, which may be sparse
+typedef struct {
+    int64_t* page;
+    int* proc;                      // -1 marks an empty slot
+    long* last_use;
+    long mask;
+} mrc_map;
+
+static int mrc_map_init(mrc_map* map, long refs) {
+    long capacity = 16;
+    while (capacity < 2 * refs) capacity *= 2;
+    map->page = (int64_t*)malloc(capacity * sizeof(int64_t));
+    map->proc = (int*)malloc(capacity * sizeof(int));
+    map->last_use = (long*)malloc(capacity * sizeof(long));
+    map->mask = capacity - 1;
+    if (!map->page || !map->proc || !map->last_use) {
+        perror("Error allocating stack distance map");
+        return -1;
+    }
+    for (long i = 0; i < capacity; i++) map->proc[i] = -1;
+    return 0;
+}
+
+static void mrc_map_free(mrc_map* map) {
+    free(map->page);
+    free(map->proc);
+    free(map->last_use);
+}
+
+// Slot holding the last use of a page, added with -1 (never used) if absent
+static long* mrc_last_use(mrc_map* map, int proc, int64_t page) {
+    uint64_t h = ((uint64_t)page ^ ((uint64_t)proc << 48)) * 0x9E3779B97F4A7C15ULL;
+    long i = (long)(h >> 32) & map->mask;
+    while (map->proc[i] != -1 && (map->proc[i] != proc || map->page[i] != page)) {
+        i = (i + 1) & map->mask;
+    }
+    if (map->proc[i] == -1) {
+        map->proc[i] = proc;
+        map->page[i] = page;
+        map->last_use[i] = -1;
+    }
+    return &map->last_use[i];
+}
+
+// Fenwick tree over reference indexes; a 1 marks the latest use of some page
+static void fenwick_add(int* tree, long n, long i, int delta) {
+    for (i++; i <= n; i += i & -i) tree[i] += delta;
+}
+
+// Sum of marks at indexes 0..i
+static long fenwick_sum(const int* tree, long i) {
+    long sum = 0;
+    for (i++; i > 0; i -= i & -i) sum += tree[i];
+    return sum;
+}
+
+// One LRU stack-distance pass: the last-use map, the Fenwick tree over
+// reference indexes, and per-segment distance histograms and cold misses
+typedef struct {
+    mrc_map map;
+    int* tree;
+    long size;                      // References the tree has room for
+    long refs;
+    long* hist[4];
+    long cold[4];
+} mrc_pass;
+
+// Record a reference to 'page' of process 'asid'
+static void mrc_reference(mrc_pass* pass, const mrc_process* proc, int asid, int64_t page) {
+    int seg = (page < proc->text_pages) ? 0 :
+              (page < proc->text_pages + proc->data_pages) ? 1 :
+              (page < proc->text_pages + proc->data_pages + proc->bss_pages) ? 2 : 3;
+    long* last_use = mrc_last_use(&pass->map, asid, page);
+    long last = *last_use;
+
+    if (last == -1) {
+        pass->cold[seg]++;
+    } else {
+        pass->hist[seg][fenwick_sum(pass->tree, pass->refs - 1) - fenwick_sum(pass->tree, last)]++;
+        fenwick_add(pass->tree, pass->size, last, -1);
+    }
+    fenwick_add(pass->tree, pass->size, pass->refs, 1);
+    *last_use = pass->refs++;
+}
+
+// Upper bound on the page translations a record makes at 'page_size'
+static long mrc_record_refs(const vmem_sweep* decoded, const sweep_op* rec, int page_size) {
+    if (rec->op == TRACE_OP_LOAD || rec->op == TRACE_OP_STORE) return 1;
+    if (rec->op == TRACE_OP_SPAWN || rec->op == TRACE_OP_SWITCH) return 0;
+    long pages = decoded->ranges[rec->arg].length / page_size + 2;
+    return rec->op == TRACE_OP_MEMCPY ? 4 * pages : pages;
+}
+
+// References of a range record, in the order the simulator translates pages.
+// Like the simulator, ranges out of bounds or writing TEXT are skipped whole
+static void mrc_range(mrc_pass* pass, const mrc_process* proc, int asid, int op,
+                      const sweep_range* range, int page_size) {
+    int64_t space = proc->num_pages * page_size;
+    int64_t first = range->address / page_size;
+    if (range->address < 0 || range->length <= 0 || range->address > space ||
+        range->length > space - range->address) return;
+    if (op != TRACE_OP_LOADRANGE && first < proc->text_pages) return;
+
+    if (op != TRACE_OP_MEMCPY) {
+        int64_t last = (range->address + range->length - 1) / page_size;
+        for (int64_t page = first; page <= last; page++) mrc_reference(pass, proc, asid, page);
+        return;
+    }
+    int64_t src = range->source, dest = range->address, length = range->length;
+    if (src < 0 || src > space || length > space - src) return;
+    int backward = dest > src && dest < src + length;
+    for (int64_t left = length; left > 0; ) {
+        int64_t start = backward ? 0 : length - left;
+        int64_t chunk = copy_chunk(dest + start, src + start, left, page_size, backward);
+        int64_t offset = backward ? left - chunk : start;
+        mrc_reference(pass, proc, asid, (src + offset) / page_size);
+        mrc_reference(pass, proc, asid, (dest + offset) / page_size);
+        left -= chunk;
+    }
+}
+
+static int mrc_add_process(mrc_process** procs, int* num_procs, int64_t space, int page_size,
+                           int text_size, int data_size, int bss_size) {
+    mrc_process* grown = (mrc_process*)realloc(*procs, (*num_procs + 1) * sizeof(mrc_process));
+    if (!grown) return -1;
+    *procs = grown;
+
+    mrc_process* proc = &grown[*num_procs];
+    proc->num_pages = (space + page_size - 1) / page_size;
+    proc->text_pages = (text_size + page_size - 1) / page_size;
+    proc->data_pages = (data_size + page_size - 1) / page_size;
+    proc->bss_pages = (bss_size + page_size - 1) / page_size;
+    (*num_procs)++;
+    return 0;
+}
+
+/**
+ * handleVmemMrc - LRU miss-ratio curve of a trace in a single pass
+ * Usage: vmem mrc <script|trace.bin> [page=<size>] [format=csv]
+ * Each reference's stack distance (distinct pages touched since the same
+ * page was last used) comes from a Fenwick tree in O(log n). An LRU memory
+ * of C frames faults exactly on cold references and those with distance
+ * >= C, so one pass yields the fault count for every frame count, split by
+ * segment (TEXT, DATA, BSS, H/S), plus a histogram of reuse distances.
+ */
+int handleVmemMrc(char** tokens, int tokenCount) {
+    int page_override = 0;
+    int csv = 0;
+
+    if (tokenCount < 3) {
+        fprintf(stderr, "Usage: vmem mrc <script|trace.bin> [page=<size>] [format=csv]\n");
+        return -1;
+    }
+    for (int i = 3; i < tokenCount; i++) {
+        if (strncmp(tokens[i], "page=", 5) == 0 && atoi(tokens[i] + 5) > 0) {
+            page_override = atoi(tokens[i] + 5);
+        } else if (strcmp(tokens[i], "format=csv") == 0) {
+            csv = 1;
+        } else {
+            fprintf(stderr, "Error: Invalid mrc setting '%s'\n", tokens[i]);
+            return -1;
+        }
+    }
+
+    char line[256];
+    trace_map trace;
+    FILE* script = open_script(tokens[2], line, sizeof(line), &trace);
+    if (!script) return -1;
+
+    int text_size, data_size, bss_size, page_size;
+    long long num_pages;
+    if (sscanf(line, "%*s %*s %d %d %d %*d %d %lld", &text_size, &data_size, &bss_size,
+               &page_size, &num_pages) != 5 || page_size <= 0 ||
+        num_pages < 0 || num_pages > INT64_MAX / page_size) {
+        fprintf(stderr, "Error: Invalid script format\n");
+        if (trace.data != MAP_FAILED) munmap(trace.data, trace.size);
+        fclose(script);
+        return -1;
+    }
+
+    // Decoded exactly as for sweeps (addresses are bytes, spawns sized in bytes)
+    vmem_sweep decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    int rc = sweep_decode(&decoded, script, &trace, page_size);
+    if (trace.data != MAP_FAILED) munmap(trace.data, trace.size);
+    fclose(script);
+
+    int analysis_page = page_override ? page_override : page_size;
+    mrc_process* procs = NULL;
+    int num_procs = 0;
+    mrc_pass pass;
+    memset(&pass, 0, sizeof(pass));
+    for (long i = 0; rc == 0 && i < decoded.num_ops; i++) {
+        pass.size += mrc_record_refs(&decoded, &decoded.ops[i], analysis_page);
+    }
+    int* tree = pass.tree = (int*)calloc(pass.size + 1, sizeof(int));
+    int64_t total_pages = 0;
+
+    if (rc == 0 && tree) {
+        rc = mrc_map_init(&pass.map, pass.size);
+    }
+    if (rc == 0 && tree) {
+        rc = mrc_add_process(&procs, &num_procs, num_pages * page_size, analysis_page,
+                             text_size, data_size, bss_size);
+        for (int i = 0; rc == 0 && i < decoded.num_spawns; i++) {
+            sweep_spawn* spawn = &decoded.spawns[i];
+            rc = mrc_add_process(&procs, &num_procs, spawn->space, analysis_page,
+                                 spawn->text_size, spawn->data_size, spawn->bss_size);
+        }
+        for (int i = 0; i < num_procs; i++) total_pages += procs[i].num_pages;
+    }
+
+    // hist[seg][d]: references at stack distance d; cold[seg]: first touches.
+    // Distances stay below the number of distinct pages, so neither the
+    // address space nor the trace length can be exceeded
+    long max_distance = total_pages < pass.size ? (long)total_pages : pass.size;
+    long** hist = pass.hist;
+    long* cold = pass.cold;
+    for (int seg = 0; rc == 0 && seg < 4; seg++) {
+        hist[seg] = (long*)calloc(max_distance + 1, sizeof(long));
+        if (!hist[seg]) rc = -1;
+    }
+    if (rc != 0 || !tree) {
+        if (rc == 0) perror("Error allocating stack distance tree");
+        mrc_map_free(&pass.map);
+        for (int seg = 0; seg < 4; seg++) free(hist[seg]);
+        free(procs);
+        free(tree);
+        sweep_free_trace(&decoded);
+        return -1;
+    }
+
+    // One pass over the references; spawned processes become live in trace order
+    int live = 1;
+    int cur_asid = 0;
+    mrc_process* cur = &procs[0];
+    for (long i = 0; i < decoded.num_ops; i++) {
+        sweep_op* rec = &decoded.ops[i];
+        if (rec->op == TRACE_OP_SPAWN) {
+            live++;
+            continue;
+        }
+        if (rec->op == TRACE_OP_SWITCH) {
+            if (rec->arg >= 0 && rec->arg < live) {
+                cur_asid = (int)rec->arg;
+                cur = &procs[cur_asid];
             }
+            continue;
+        }
+        if (rec->op != TRACE_OP_LOAD && rec->op != TRACE_OP_STORE) {
+            mrc_range(&pass, cur, cur_asid, rec->op, &decoded.ranges[rec->arg], analysis_page);
+            continue;
+        }
+        // Loads and stores; out-of-range addresses never reach the page table,
+        // and stores to TEXT are refused before translation
+        if (rec->arg < 0 || rec->arg / analysis_page >= cur->num_pages) continue;
+        int64_t page = rec->arg / analysis_page;
+        if (rec->op == TRACE_OP_STORE && page < cur->text_pages) continue;
+        mrc_reference(&pass, cur, cur_asid, page);
+    }
+    long refs = pass.refs;
+
+    long distinct = cold[0] + cold[1] + cold[2] + cold[3];
+
+    // Faults with C frames = cold + references at distance >= C; print each
+    // frame count where the curve drops, and the point where it flattens
+    long faults[4];
+    for (int seg = 0; seg < 4; seg++) {
+        faults[seg] = cold[seg];
+        for (long d = 0; d <= max_distance; d++) faults[seg] += hist[seg][d];
+    }
+    if (csv) {
+        printf("frames,faults,miss_ratio,text,data,bss,heap_stack\n");
+    } else {
+        printf("=== MISS RATIO CURVE (LRU) ===\n");
+        printf("References: %ld, Distinct pages: %ld, Page size: %d bytes\n",
+               refs, distinct, analysis_page);
+        printf("  Frames |     Faults | Miss ratio |       TEXT |       DATA |        BSS |        H/S\n");
+        printf("---------|------------|------------|------------|------------|------------|-----------\n");
+    }
+    for (long frames = 1; frames <= (distinct ? distinct : 1); frames++) {
+        long dropped = 0;
+        for (int seg = 0; seg < 4; seg++) {
+            dropped += hist[seg][frames - 1];
+            faults[seg] -= hist[seg][frames - 1];
+        }
+        if (dropped == 0 && frames != 1 && frames != distinct) continue;
+
+        long total = faults[0] + faults[1] + faults[2] + faults[3];
+        double ratio = refs ? (double)total / refs : 0.0;
+        if (csv) {
+            printf("%ld,%ld,%.6f,%ld,%ld,%ld,%ld\n", frames, total, ratio,
+                   faults[0], faults[1], faults[2], faults[3]);
+        } else {
+            printf("%8ld | %10ld | %9.4f%% | %10ld | %10ld | %10ld | %10ld\n", frames, total,
+                   100.0 * ratio, faults[0], faults[1], faults[2], faults[3]);
         }
-        else if (strcmp(command, "print") == 0) {
-            char target[20];
-            if (sscanf(line, "print %s", target) == 1) {
-                if (strcmp(target, "ram") == 0) {
-                    print_memory(mem_sim);
-                }
-                else if (strcmp(target, "swap") == 0) {
-                    print_swap(mem_sim);
-                }
-                else if (strcmp(target, "table") == 0) {
-                    print_page_table(mem_sim);
-                }
+    }
+
+    // Reuse-distance histogram in power-of-two buckets
+    if (!csv) {
+        printf("\nReuse distance |       TEXT |       DATA |        BSS |        H/S\n");
+        printf("---------------|------------|------------|------------|-----------\n");
+        for (long lo = 0; lo <= max_distance; lo = lo ? lo * 2 : 1) {
+            long hi = lo ? lo * 2 - 1 : 0;
+            long count[4] = {0, 0, 0, 0};
+            long any = 0;
+            for (int seg = 0; seg < 4; seg++) {
+                for (long d = lo; d <= hi && d <= max_distance; d++) count[seg] += hist[seg][d];
+                any += count[seg];
             }
+            if (!any) continue;
+            char label[48];
+            if (lo == hi) snprintf(label, sizeof(label), "%ld", lo);
+            else snprintf(label, sizeof(label), "%ld-%ld", lo, hi);
+            printf("%14s | %10ld | %10ld | %10ld | %10ld\n", label,
+                   count[0], count[1], count[2], count[3]);
         }
+        printf("%14s | %10ld | %10ld | %10ld | %10ld\n", "cold",
+               cold[0], cold[1], cold[2], cold[3]);
+        printf("==============================\n\n");
     }
-    
-    // Clean up
-    fclose(script);
-    clear_system(mem_sim);
-    return 0;  // Return success
+
+    mrc_map_free(&pass.map);
+    for (int seg = 0; seg < 4; seg++) free(hist[seg]);
+    free(procs);
+    free(tree);
+    sweep_free_trace(&decoded);
+    return 0;
 }
-// Global variables for LRU tracking
-static int* page_access_time = NULL;
-static int global_time_counter = 0;
 
-// Helper function to update access time for LRU
-void update_page_access_time(int page_num) {
-    if (!page_access_time) {
-        page_access_time = (int*)calloc(1024, sizeof(int)); // Max pages
-    }
-    page_access_time[page_num] = global_time_counter++;
+/* ---- Synthetic workloads ---- */
+
+#define GEN_ZIPF   0
+#define GEN_SEQ    1
+#define GEN_LOOP   2
+#define GEN_STRIDE 3
+#define GEN_RANDOM 4
+
+static const char* gen_patterns[] = {"zipf", "seq", "loop", "stride", "random"};
+
+#define GEN_BATCH       4096
+#define GEN_ZETA_EXACT  (1 << 20)   // Ranks summed exactly; the tail is integrated
+
+/**
+ * workload - State of one seeded access generator
+ * Addresses fall in [base, base + span). seq, loop and stride walk it with
+ * a cursor, random draws uniformly and zipf draws pages by rank with Gray
+ * et al.'s closed form (rank 0 is the region's first page). Stores below
+ * text_end would be refused, so they are issued as loads.
+ */
+typedef struct {
+    int pattern;
+    int64_t base;
+    int64_t span;
+    int64_t step;
+    int64_t cursor;
+    int page_size;
+    int64_t text_end;
+    uint64_t write_threshold;       // A draw below this makes the access a store
+    uint64_t rng;
+    long generated;
+    // Zipf over 'items' pages
+    int64_t items;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+    double rank1_bound;             // 1 + 0.5^theta
+} workload;
+
+static inline uint64_t workload_rand(workload* w) {
+    w->rng ^= w->rng >> 12;
+    w->rng ^= w->rng << 25;
+    w->rng ^= w->rng >> 27;
+    return w->rng * 2685821657736338717ULL;
+}
+
+// Uniform in [0, n) without a division
+static inline int64_t workload_below(workload* w, int64_t n) {
+    return (int64_t)(((unsigned __int128)workload_rand(w) * (uint64_t)n) >> 64);
+}
+
+// The shell is built without libm, so Zipf draws bring their own pow():
+// log from the exponent bits and an atanh series, exp from 2^k times a
+// Taylor series, both far more precise than page ranks need
+static double gen_log(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int exponent = (int)((bits >> 52) & 0x7FF) - 1023;
+    bits = (bits & ((1ULL << 52) - 1)) | (1023ULL << 52);
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    if (m > 1.4142135623730951) {
+        m *= 0.5;
+        exponent++;
+    }
+    // log(m) = 2 atanh(s) = 2 (s + s^3/3 + s^5/5 + ...), |s| < 0.172
+    static const double odd[] = {1.0 / 13, 1.0 / 11, 1.0 / 9, 1.0 / 7, 1.0 / 5, 1.0 / 3, 1.0};
+    double s = (m - 1.0) / (m + 1.0);
+    double s2 = s * s, sum = 0.0;
+    for (int i = 0; i < 7; i++) sum = sum * s2 + odd[i];
+    return 2.0 * s * sum + exponent * 0.6931471805599453;
+}
+
+static double gen_exp(double y) {
+    if (y < -708.0) return 0.0;
+    int k = (int)(y * 1.4426950408889634 + (y >= 0 ? 0.5 : -0.5));
+    double r = y - k * 0.6931471805599453;  // |r| <= ln 2 / 2
+    static const double inv[] = {1.0 / 10, 1.0 / 9, 1.0 / 8, 1.0 / 7, 1.0 / 6,
+                                 1.0 / 5, 1.0 / 4, 1.0 / 3, 1.0 / 2, 1.0};
+    double sum = 1.0;
+    for (int i = 0; i < 10; i++) sum = 1.0 + r * inv[i] * sum;
+    if (k < -1022) return 0.0;
+    uint64_t bits = (uint64_t)(k + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return sum * scale;
+}
+
+static double gen_pow(double x, double y) {
+    return (x > 0.0) ? gen_exp(y * gen_log(x)) : 0.0;
+}
+
+// Generalized harmonic number H(n, theta): exact head, integral for the tail
+static double zipf_zeta(int64_t n, double theta) {
+    int64_t exact = (n < GEN_ZETA_EXACT) ? n : GEN_ZETA_EXACT;
+    double sum = 0.0;
+    for (int64_t i = 1; i <= exact; i++) sum += gen_pow((double)i, -theta);
+    if (n > exact) {
+        sum += (gen_pow((double)n, 1.0 - theta) - gen_pow((double)exact, 1.0 - theta)) / (1.0 - theta);
+    }
+    return sum;
 }
 
-// Helper function to find a free frame
-int find_free_frame(sim_database* mem_sim) {
-    // Check if any frame is not used by checking all pages
-    for (int frame = 0; frame < mem_sim->num_frames; frame++) {
-        int frame_used = 0;
-        for (int page = 0; page < mem_sim->num_pages; page++) {
-            if (mem_sim->page_table[page].V == 1 && 
-                mem_sim->page_table[page].frame_swap == frame) {
-                frame_used = 1;
+// Fill 'batch' with the next 'count' accesses
+static void workload_fill(workload* w, sweep_op* batch, int count) {
+    for (int i = 0; i < count; i++) {
+        int64_t offset;
+        switch (w->pattern) {
+            case GEN_ZIPF: {
+                double u = (double)(workload_rand(w) >> 11) * (1.0 / 9007199254740992.0);
+                double uz = u * w->zetan;
+                int64_t rank = (uz < 1.0) ? 0 :
+                               (uz < w->rank1_bound) ? 1 :
+                               (int64_t)(w->items * gen_pow(w->eta * u - w->eta + 1.0, w->alpha));
+                if (rank >= w->items) rank = w->items - 1;
+                offset = rank * w->page_size + workload_below(w, w->page_size);
+                if (offset >= w->span) offset = w->span - 1;  // Partial last page
                 break;
             }
+            case GEN_RANDOM:
+                offset = workload_below(w, w->span);
+                break;
+            default:
+                offset = w->cursor;
+                w->cursor += w->step;
+                if (w->cursor >= w->span) w->cursor -= w->span;
+                break;
         }
-        if (!frame_used) {
-            return frame;
-        }
-    }
-    return -1;  // No free frame found
-}
-// Check if page is in TLB
-int check_tlb(sim_database* mem_sim, int page_num) {
-    if (!mem_sim->tlb) return -1;
-    
-    for (int i = 0; i < mem_sim->tlb_size; i++) {
-        if (mem_sim->tlb[i].valid && mem_sim->tlb[i].page_number == page_num) {
-            // Update timestamp for LRU
-            mem_sim->tlb[i].timestamp = global_time_counter++;
-            return mem_sim->tlb[i].frame_number;
+        
+        int64_t address = w->base + offset;
+        if (workload_rand(w) < w->write_threshold && address >= w->text_end) {
+            batch[i].op = TRACE_OP_STORE;
+            batch[i].value = (char)('a' + w->generated % 26);
+        } else {
+            batch[i].op = TRACE_OP_LOAD;
+            batch[i].value = 0;
         }
+        batch[i].arg = address;
+        w->generated++;
     }
-    return -1;  // TLB miss
 }
 
-// Add entry to TLB
-void add_to_tlb(sim_database* mem_sim, int page_num, int frame_num) {
-    if (!mem_sim->tlb) return;
-    
-    // First check if page already in TLB (shouldn't happen but be safe)
-    for (int i = 0; i < mem_sim->tlb_size; i++) {
-        if (mem_sim->tlb[i].valid && mem_sim->tlb[i].page_number == page_num) {
-            mem_sim->tlb[i].frame_number = frame_num;
-            mem_sim->tlb[i].timestamp = global_time_counter++;
-            printf("TLB Updated: Page %d -> Frame %d\n", page_num, frame_num);
-            return;
-        }
+/**
+ * workload_init - Sets up a generator over one segment of process 0
+ * The segment bounds come from the simulator's own layout, page-aligned as
+ * in page_segment(). Returns 0, or -1 (after printing why) if the segment
+ * is empty or a setting does not fit it.
+ */
+static int workload_init(workload* w, sim_database* mem_sim, int pattern, int segment,
+                         double writes, double theta, int64_t step, int64_t span, uint64_t seed) {
+    vmem_process* proc = mem_sim->procs[0];
+    int64_t page_size = mem_sim->page_size;
+    int64_t bounds[5];
+    bounds[0] = 0;
+    bounds[1] = text_page_count(mem_sim, proc);
+    bounds[2] = bounds[1] + (proc->data_size + page_size - 1) / page_size;
+    bounds[3] = bounds[2] + (proc->bss_size + page_size - 1) / page_size;
+    bounds[4] = proc->num_pages;
+    
+    memset(w, 0, sizeof(*w));
+    w->pattern = pattern;
+    w->page_size = mem_sim->page_size;
+    w->text_end = bounds[1] * page_size;
+    if (segment < 0) {
+        w->base = 0;
+        w->span = bounds[4] * page_size;
+    } else {
+        w->base = bounds[segment] * page_size;
+        w->span = (bounds[segment + 1] - bounds[segment]) * page_size;
     }
-    
-    // Find empty slot
-    for (int i = 0; i < mem_sim->tlb_size; i++) {
-        if (!mem_sim->tlb[i].valid) {
-            mem_sim->tlb[i].valid = 1;
-            mem_sim->tlb[i].page_number = page_num;
-            mem_sim->tlb[i].frame_number = frame_num;
-            mem_sim->tlb[i].timestamp = global_time_counter++;
-            printf("TLB Updated: Page %d -> Frame %d\n", page_num, frame_num);
-            return;
-        }
+    if (w->span <= 0) {
+        fprintf(stderr, "Error: The target segment is empty\n");
+        return -1;
     }
     
-    // TLB full - evict LRU entry
-    int lru_idx = 0;
-    int oldest_time = mem_sim->tlb[0].timestamp;
+    // Cursor patterns: seq reads word by word, loop touches each page of a
+    // span twice the size of main memory, stride skips four pages at a time
+    if (pattern == GEN_LOOP && span == 0) span = 2 * (int64_t)mem_sim->memory_size;
+    if (span > 0 && span < w->span) w->span = span;
+    w->step = step ? step : (pattern == GEN_SEQ) ? 8 : (pattern == GEN_LOOP) ? page_size : 4 * page_size;
+    w->step %= w->span;
+    if (w->step == 0) w->step = 1;
     
-    for (int i = 1; i < mem_sim->tlb_size; i++) {
-        if (mem_sim->tlb[i].timestamp < oldest_time) {
-            oldest_time = mem_sim->tlb[i].timestamp;
-            lru_idx = i;
-        }
-    }
+    w->write_threshold = (writes >= 1.0) ? UINT64_MAX : (uint64_t)(writes * 18446744073709551616.0);
+    w->rng = seed ? seed : 1;
     
-    // Replace LRU entry
-    mem_sim->tlb[lru_idx].page_number = page_num;
-    mem_sim->tlb[lru_idx].frame_number = frame_num;
-    mem_sim->tlb[lru_idx].timestamp = global_time_counter++;
-    printf("TLB Updated: Page %d -> Frame %d\n", page_num, frame_num);
+    if (pattern == GEN_ZIPF) {
+        w->items = (w->span + page_size - 1) / page_size;
+        w->theta = theta;
+        w->alpha = 1.0 / (1.0 - theta);
+        w->zetan = zipf_zeta(w->items, theta);
+        w->rank1_bound = 1.0 + gen_pow(0.5, theta);
+        w->eta = (w->items > 1) ?
+                 (1.0 - gen_pow(2.0 / w->items, 1.0 - theta)) / (1.0 - zipf_zeta(2, theta) / w->zetan) : 0.0;
+    }
+    return 0;
 }
 
-// Remove page from TLB when it's evicted from memory
-void remove_from_tlb(sim_database* mem_sim, int page_num) {
-    if (!mem_sim->tlb) return;
-    
-    for (int i = 0; i < mem_sim->tlb_size; i++) {
-        if (mem_sim->tlb[i].valid && mem_sim->tlb[i].page_number == page_num) {
-            mem_sim->tlb[i].valid = 0;
-            mem_sim->tlb[i].page_number = -1;
-            mem_sim->tlb[i].frame_number = -1;
-            return;
-        }
+static int find_gen_pattern(const char* name) {
+    for (int i = 0; i < (int)(sizeof(gen_patterns) / sizeof(gen_patterns[0])); i++) {
+        if (strcmp(gen_patterns[i], name) == 0) return i;
     }
+    return -1;
 }
-// Helper function to find free swap slot (first-fit)
-int find_free_swap_slot(sim_database* mem_sim) {
-    int num_swap_pages = mem_sim->swap_size / mem_sim->page_size;
-    char* check_buffer = (char*)malloc(mem_sim->page_size);
-    
-    for (int slot = 0; slot < num_swap_pages; slot++) {
-        // Check if this slot is all '-' (empty)
-        if (lseek(mem_sim->swapfile_fd, slot * mem_sim->page_size, SEEK_SET) == -1) {
-            free(check_buffer);
-            return -1;
-        }
-        
-        if (read(mem_sim->swapfile_fd, check_buffer, mem_sim->page_size) != mem_sim->page_size) {
-            free(check_buffer);
-            return -1;
-        }
-        
-        // Check if slot is empty (all '-')
-        int is_empty = 1;
-        for (int i = 0; i < mem_sim->page_size; i++) {
-            if (check_buffer[i] != '-') {
-                is_empty = 0;
-                break;
-            }
-        }
-        
-        if (is_empty) {
-            free(check_buffer);
-            return slot;
-        }
+
+// Segment by name as in workload_init(): 0..3, -1 for "all", -2 if unknown
+static int find_gen_segment(const char* name) {
+    static const char* segments[] = {"text", "data", "bss", "heap_stack"};
+    for (int seg = 0; seg < 4; seg++) {
+        if (strcmp(segments[seg], name) == 0) return seg;
     }
-    
-    free(check_buffer);
-    return -1;  // No free slot found
+    return (strcmp(name, "all") == 0) ? -1 : -2;
 }
 
-// Helper function to save page to swap
-void save_page_to_swap(sim_database* mem_sim, int page_num) {
-    // Find first free slot in swap (first-fit)
-    int swap_slot = find_free_swap_slot(mem_sim);
-    if (swap_slot == -1) {
-        fprintf(stderr, "Error: Swap file full!\n");
-        return;
+// Write the whole stream as a text script or, for a .bin name, a binary trace
+static int gen_write(workload* w, long accesses, const char* init_line, const char* path) {
+    size_t path_len = strlen(path);
+    int binary = path_len > 4 && strcmp(path + path_len - 4, ".bin") == 0;
+    FILE* out = fopen(path, binary ? "wb" : "w");
+    if (!out) {
+        perror("Error creating workload file");
+        return -1;
     }
     
-    // Get frame content
-    int frame_num = mem_sim->page_table[page_num].frame_swap;
-    char* frame_start = mem_sim->main_memory + (frame_num * mem_sim->page_size);
-    
-    // Write to swap
-    int swap_offset = swap_slot * mem_sim->page_size;
-    if (lseek(mem_sim->swapfile_fd, swap_offset, SEEK_SET) == -1) {
-        perror("Error seeking in swap file");
-        return;
+    size_t init_len = strlen(init_line);
+    if (binary) {
+        fwrite(TRACE_MAGIC, 1, 4, out);
+        fputc(TRACE_VERSION, out);
+        fputc((int)(init_len & 0xFF), out);
+        fputc((int)(init_len >> 8), out);
+        fwrite(init_line, 1, init_len, out);
+    } else {
+        fprintf(out, "%s\n", init_line);
+    }
+    
+    sweep_op batch[GEN_BATCH];
+    for (long done = 0; done < accesses; ) {
+        int count = (accesses - done < GEN_BATCH) ? (int)(accesses - done) : GEN_BATCH;
+        workload_fill(w, batch, count);
+        for (int i = 0; i < count; i++) {
+            if (binary) {
+                fputc(batch[i].op, out);
+                encode_varint(out, batch[i].arg);
+                if (batch[i].op == TRACE_OP_STORE) fputc((unsigned char)batch[i].value, out);
+            } else if (batch[i].op == TRACE_OP_STORE) {
+                fprintf(out, "store %lld %c\n", (long long)batch[i].arg, batch[i].value);
+            } else {
+                fprintf(out, "load %lld\n", (long long)batch[i].arg);
+            }
+        }
+        done += count;
     }
     
-    if (write(mem_sim->swapfile_fd, frame_start, mem_sim->page_size) != mem_sim->page_size) {
-        perror("Error writing to swap file");
-        return;
+    if (fclose(out) != 0) {
+        perror("Error writing workload file");
+        return -1;
     }
-    
-    // Update page table to remember swap location
-    mem_sim->page_table[page_num].frame_swap = swap_slot;
+    printf("Wrote %ld accesses to %s\n", accesses, path);
+    return 0;
 }
 
-// Helper function to evict a page using LRU
-int evict_page_lru(sim_database* mem_sim) {
-    // Initialize access times if needed
-    if (!page_access_time) {
-        page_access_time = (int*)calloc(mem_sim->num_pages, sizeof(int));
+// Feed 'accesses' generated accesses to load()/store(), timing the generator
+// and the simulator separately, batch by batch
+static void workload_run(sim_database* mem_sim, workload* w, long accesses,
+                         double* gen_ns, double* sim_ns) {
+    sweep_op batch[GEN_BATCH];
+    *gen_ns = 0.0;
+    *sim_ns = 0.0;
+    for (long done = 0; done < accesses; ) {
+        int count = (accesses - done < GEN_BATCH) ? (int)(accesses - done) : GEN_BATCH;
+        struct timespec start, mid, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        workload_fill(w, batch, count);
+        clock_gettime(CLOCK_MONOTONIC, &mid);
+        for (int i = 0; i < count; i++) {
+            if (batch[i].op == TRACE_OP_STORE) store(mem_sim, batch[i].arg, batch[i].value);
+            else load(mem_sim, batch[i].arg);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        *gen_ns += (mid.tv_sec - start.tv_sec) * 1e9 + (mid.tv_nsec - start.tv_nsec);
+        *sim_ns += (end.tv_sec - mid.tv_sec) * 1e9 + (end.tv_nsec - mid.tv_nsec);
+        done += count;
+    }
+}
+
+/**
+ * handleVmemGen - Generates a synthetic workload, or streams it into the simulator
+ * Usage: vmem gen <script|trace.bin> <zipf|seq|loop|stride|random> [n=<accesses>]
+ *        [writes=<fraction>] [segment=text|data|bss|heap_stack|all] [theta=<skew>]
+ *        [stride=<bytes>] [span=<bytes>] [seed=<n>] [out=<file>] [--key=value]
+ * The simulator is built from the script's init line (plus overrides), and
+ * its process 0 layout places the accesses. Without out= the accesses are
+ * generated in batches and replayed at once, never touching disk; the
+ * generator and simulator rates are reported separately, then the stats.
+ * The same seed always gives the same stream, in both modes.
+ */
+int handleVmemGen(char** tokens, int tokenCount) {
+    const char* usage =
+        "Usage: vmem gen <script|trace.bin> <zipf|seq|loop|stride|random> [n=<accesses>]\n"
+        "       [writes=<fraction>] [segment=text|data|bss|heap_stack|all] [theta=<skew>]\n"
+        "       [stride=<bytes>] [span=<bytes>] [seed=<n>] [out=<file>] [--key=value]\n";
+    if (tokenCount < 4 || find_gen_pattern(tokens[3]) == -1) {
+        fprintf(stderr, "%s", usage);
+        return -1;
     }
     
-    // Find the page with oldest access time that's in memory
-    int oldest_page = -1;
-    int oldest_time = global_time_counter;
-    
-    for (int page = 0; page < mem_sim->num_pages; page++) {
-        if (mem_sim->page_table[page].V == 1) {
-            if (oldest_page == -1 || page_access_time[page] < oldest_time) {
-                oldest_page = page;
-                oldest_time = page_access_time[page];
-            }
+    int pattern = find_gen_pattern(tokens[3]);
+    long accesses = 1000000;
+    double writes = 0.25;
+    double theta = 0.99;
+    int segment = -1;
+    int64_t step = 0, span = 0;
+    uint64_t seed = 1;
+    const char* out_path = NULL;
+    char overrides[BUFSIZ] = "";
+    
+    for (int i = 4; i < tokenCount; i++) {
+        const char* arg = tokens[i];
+        int ok = 1;
+        if (strncmp(arg, "--", 2) == 0 && strchr(arg, '=')) {
+            strncat(overrides, " ", sizeof(overrides) - strlen(overrides) - 1);
+            strncat(overrides, arg + 2, sizeof(overrides) - strlen(overrides) - 1);
+        } else if (strncmp(arg, "n=", 2) == 0) {
+            accesses = atol(arg + 2);
+            ok = accesses > 0;
+        } else if (strncmp(arg, "writes=", 7) == 0) {
+            writes = atof(arg + 7);
+            ok = writes >= 0.0 && writes <= 1.0;
+        } else if (strncmp(arg, "theta=", 6) == 0) {
+            theta = atof(arg + 6);
+            ok = theta >= 0.0 && theta < 1.0;
+        } else if (strncmp(arg, "stride=", 7) == 0) {
+            step = atoll(arg + 7);
+            ok = step > 0;
+        } else if (strncmp(arg, "span=", 5) == 0) {
+            span = atoll(arg + 5);
+            ok = span > 0;
+        } else if (strncmp(arg, "seed=", 5) == 0) {
+            seed = strtoull(arg + 5, NULL, 10);
+        } else if (strncmp(arg, "out=", 4) == 0 && arg[4]) {
+            out_path = arg + 4;
+        } else if (strncmp(arg, "segment=", 8) == 0) {
+            segment = find_gen_segment(arg + 8);
+            ok = segment != -2;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: Invalid gen setting '%s' (theta is 0 to <1, writes 0 to 1)\n", arg);
+            return -1;
         }
     }
     
-    if (oldest_page == -1) {
-        fprintf(stderr, "Error: No page to evict!\n");
+    char line[256];
+    trace_map trace;
+    FILE* script = open_script(tokens[2], line, sizeof(line), &trace);
+    if (!script) return -1;
+    if (trace.data != MAP_FAILED) munmap(trace.data, trace.size);
+    fclose(script);
+    
+    char init_line[sizeof(line) + sizeof(overrides)];
+    snprintf(init_line, sizeof(init_line), "%s%s", line, overrides);
+    sim_database* mem_sim = init_system(init_line);
+    if (!mem_sim) {
+        fprintf(stderr, "Error: Failed to initialize memory system\n");
         return -1;
     }
+    mem_sim->quiet = 1;
     
-    // Get the frame that will be freed
-    int frame_to_free = mem_sim->page_table[oldest_page].frame_swap;
-    
-    // If page is dirty and not TEXT, save to swap
-    if (mem_sim->page_table[oldest_page].D == 1 && 
-        mem_sim->page_table[oldest_page].P == 0) {  // Not read-only
-        printf("Page replacement: Evicting page %d to swap\n", oldest_page);
-        save_page_to_swap(mem_sim, oldest_page);
+    workload w;
+    if (workload_init(&w, mem_sim, pattern, segment, writes, theta, step, span, seed) != 0) {
+        clear_system(mem_sim);
+        return -1;
+    }
+    if (out_path) {
+        int rc = gen_write(&w, accesses, init_line, out_path);
+        clear_system(mem_sim);
+        return rc;
     }
     
-    // Mark page as not in memory
-    mem_sim->page_table[oldest_page].V = 0;
-    
-    // Remove from TLB - IMPORTANT: remove the evicted page from TLB
-    remove_from_tlb(mem_sim, oldest_page);
+    double gen_ns, sim_ns;
+    workload_run(mem_sim, &w, accesses, &gen_ns, &sim_ns);
+    finish_snapshots(mem_sim);
     
-    return frame_to_free;
+    printf("Generated %ld %s accesses (seed %llu): generator %.1f M/s, simulator %.2f M/s\n",
+           accesses, gen_patterns[pattern], (unsigned long long)seed,
+           gen_ns > 0 ? accesses / gen_ns * 1e3 : 0.0, sim_ns > 0 ? accesses / sim_ns * 1e3 : 0.0);
+    vmem_flush(mem_sim);
+    print_stats(mem_sim);
+    clear_system(mem_sim);
+    return 0;
 }
 
-// Helper function to load page from program file
-void load_page_from_program(sim_database* mem_sim, int page_num, char* dest, int base_offset) {
-    int file_offset = base_offset + (page_num * mem_sim->page_size);
-    
-    if (lseek(mem_sim->program_fd, file_offset, SEEK_SET) == -1) {
-        perror("Error seeking in file");
-        return;
-    }
-    
-    ssize_t bytes_read = read(mem_sim->program_fd, dest, mem_sim->page_size);
-    if (bytes_read != mem_sim->page_size) {
-        if (bytes_read == -1) {
-            perror("Error reading from file");
-        }
-        // Fill rest with zeros if we read less than page_size
-        if (bytes_read > 0 && bytes_read < mem_sim->page_size) {
-            memset(dest + bytes_read, 0, mem_sim->page_size - bytes_read);
-        }
+/* ---- Benchmark suite with regression baselines ---- */
+
+#define BENCH_SWAP      "vmem_bench.swp"
+#define BENCH_MAX_CASES 16
+
+// One fixed, seeded workload; the init line uses /dev/null as the program
+typedef struct {
+    const char* name;
+    const char* init;               // %s is the swap file name
+    int pattern;
+    double writes;
+    int64_t span;                   // Bytes, 0 for the pattern's default
+} bench_case;
+
+static const bench_case bench_cases[] = {
+    // 8 pages that stay in the TLB: the cost of a translation that hits
+    {"tlb-hit", "/dev/null %s 0 0 0 65536 4096 16 1048576 1048576", GEN_RANDOM, 0.25, 32768},
+    // Page loop over twice the size of RAM: every access faults, clean evictions
+    {"fault-loop", "/dev/null %s 0 0 0 16777216 4096 4096 262144 4194304", GEN_LOOP, 0.0, 0},
+    // Stores spread over 4x RAM: faults whose victims are written back
+    {"dirty-evict", "/dev/null %s 0 0 0 16777216 4096 4096 262144 4194304", GEN_RANDOM, 1.0, 1048576},
+    {"dirty-batch", "/dev/null %s 0 0 0 16777216 4096 4096 262144 4194304 writeback=batch",
+     GEN_RANDOM, 1.0, 1048576},
+    // Zipf over 1M pages with a flat table, and over 2^28 pages with a radix tree
+    {"table-flat", "/dev/null %s 0 0 0 268435456 256 1048576 262144 67108864", GEN_ZIPF, 0.1, 0},
+    {"table-radix", "/dev/null %s 0 0 0 68719476736 256 268435456 262144 67108864 pagetable=radix",
+     GEN_ZIPF, 0.1, 0},
+};
+#define NUM_BENCH_CASES ((int)(sizeof(bench_cases) / sizeof(bench_cases[0])))
+
+// One case's best run; ns_per_fault is -1 when the case does not fault
+typedef struct {
+    char name[32];
+    long accesses;
+    double ns_per_access;
+    double ns_per_fault;
+    long faults;
+} bench_result;
+
+// Read "name accesses ns/access ns/fault faults" lines; returns the count or -1
+static int read_bench_baseline(const char* path, bench_result* results, int max) {
+    FILE* in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "Error: Cannot open baseline %s\n", path);
+        return -1;
     }
+    char line[256];
+    int count = 0;
+    while (count < max && fgets(line, sizeof(line), in)) {
+        bench_result* r = &results[count];
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%31s %ld %lf %lf %ld", r->name, &r->accesses, &r->ns_per_access,
+                   &r->ns_per_fault, &r->faults) == 5) count++;
+    }
+    fclose(in);
+    return count;
 }
 
-// Helper function to load page from swap
-void load_page_from_swap(sim_database* mem_sim, int page_num, char* dest) {
-    int swap_page = mem_sim->page_table[page_num].frame_swap;
-    int swap_offset = swap_page * mem_sim->page_size;
-    
-    if (lseek(mem_sim->swapfile_fd, swap_offset, SEEK_SET) == -1) {
-        perror("Error seeking in swap file");
-        return;
+static int write_bench_baseline(const char* path, const bench_result* results, int count) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        perror("Error creating baseline");
+        return -1;
     }
-    
-    if (read(mem_sim->swapfile_fd, dest, mem_sim->page_size) != mem_sim->page_size) {
-        perror("Error reading from swap file");
+    fprintf(out, "# vmem bench suite: name accesses ns/access ns/fault faults\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%s %ld %.3f %.3f %ld\n", results[i].name, results[i].accesses,
+                results[i].ns_per_access, results[i].ns_per_fault, results[i].faults);
+    }
+    if (fclose(out) != 0) {
+        perror("Error writing baseline");
+        return -1;
     }
+    return 0;
+}
+
+// Change against the baseline in percent, or 0 if either side is missing
+static double bench_change(double now, double before) {
+    return (now > 0 && before > 0) ? 100.0 * (now - before) / before : 0.0;
 }
 
-// Main load function
-char load(sim_database* mem_sim, int address) {
-    // 1. Check if address is valid
-    if (address < 0 || address >= (mem_sim->num_pages * mem_sim->page_size)) {
-        fprintf(stderr, "Error: Invalid address %d (out of range)\n", address);
-        return '\0';
+/**
+ * handleVmemBenchSuite - Simulator throughput on fixed seeded workloads
+ * Usage: vmem bench suite [n=<accesses>] [runs=<n>] [baseline=<file>]
+ *        [save=<file>] [tolerance=<percent>]
+ * Each case replays the same generated accesses through load()/store()
+ * 'runs' times on a fresh simulator and keeps the fastest run; generation
+ * is not timed. ns/fault is the time beyond what the accesses would have
+ * cost as TLB hits (taken from the tlb-hit case), divided by the faults.
+ * With baseline=, a case whose ns/access or ns/fault grew by more than the
+ * tolerance (default 15%) is reported as a regression and the command
+ * fails; save= writes the results in the same format.
+ */
+int handleVmemBenchSuite(char** tokens, int tokenCount) {
+    long accesses = 1000000;
+    int runs = 3;
+    double tolerance = 15.0;
+    const char* baseline_path = NULL;
+    const char* save_path = NULL;
+    
+    for (int i = 3; i < tokenCount; i++) {
+        const char* arg = tokens[i];
+        int ok = 1;
+        if (strncmp(arg, "n=", 2) == 0) {
+            accesses = atol(arg + 2);
+            ok = accesses > 0;
+        } else if (strncmp(arg, "runs=", 5) == 0) {
+            runs = atoi(arg + 5);
+            ok = runs > 0;
+        } else if (strncmp(arg, "tolerance=", 10) == 0) {
+            tolerance = atof(arg + 10);
+            ok = tolerance > 0;
+        } else if (strncmp(arg, "baseline=", 9) == 0 && arg[9]) {
+            baseline_path = arg + 9;
+        } else if (strncmp(arg, "save=", 5) == 0 && arg[5]) {
+            save_path = arg + 5;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "Usage: vmem bench suite [n=<accesses>] [runs=<n>] [baseline=<file>] "
+                            "[save=<file>] [tolerance=<percent>]\n");
+            return -1;
+        }
     }
     
-    // 2. Calculate page number and offset
-    int page_num = address / mem_sim->page_size;
-    int offset = address % mem_sim->page_size;
+    bench_result baseline[BENCH_MAX_CASES];
+    int num_baseline = 0;
+    if (baseline_path && (num_baseline = read_bench_baseline(baseline_path, baseline, BENCH_MAX_CASES)) < 0) {
+        return -1;
+    }
     
-    // 3. Check TLB first
-    int tlb_frame = check_tlb(mem_sim, page_num);
-    if (mem_sim->tlb) {
-        int tlb_frame = check_tlb(mem_sim, page_num);
-        if (tlb_frame != -1) {
-            // TLB hit!
-            printf("TLB Hit: Page %d -> Frame %d\n", page_num, tlb_frame);
-            int physical_addr = tlb_frame * mem_sim->page_size + offset;
-            update_page_access_time(page_num);
-            return mem_sim->main_memory[physical_addr];
+    printf("=== VMEM BENCHMARK SUITE ===\n");
+    printf("Accesses per case: %ld, fastest of %d runs%s%s\n", accesses, runs,
+           baseline_path ? ", baseline " : "", baseline_path ? baseline_path : "");
+    printf(" Case        |  M acc/s | ns/access |   Faults | ns/fault | vs baseline (access / fault)\n");
+    printf("-------------|----------|-----------|----------|----------|-----------------------------\n");
+    
+    bench_result results[NUM_BENCH_CASES];
+    double hit_ns = 0.0;
+    int regressions = 0;
+    for (int c = 0; c < NUM_BENCH_CASES; c++) {
+        const bench_case* bc = &bench_cases[c];
+        bench_result* r = &results[c];
+        snprintf(r->name, sizeof(r->name), "%s", bc->name);
+        r->accesses = accesses;
+        r->ns_per_access = -1.0;
+        
+        for (int run = 0; run < runs; run++) {
+            char init_line[256];
+            snprintf(init_line, sizeof(init_line), bc->init, BENCH_SWAP);
+            sim_database* mem_sim = init_system(init_line);
+            if (!mem_sim) {
+                unlink(BENCH_SWAP);
+                return -1;
+            }
+            mem_sim->quiet = 1;
+            
+            workload w;
+            double gen_ns, sim_ns;
+            if (workload_init(&w, mem_sim, bc->pattern, -1, bc->writes, 0.99, 0, bc->span, 1) != 0) {
+                clear_system(mem_sim);
+                unlink(BENCH_SWAP);
+                return -1;
+            }
+            workload_run(mem_sim, &w, accesses, &gen_ns, &sim_ns);
+            writeback_drain(mem_sim);
+            
+            double ns = sim_ns / accesses;
+            if (r->ns_per_access < 0 || ns < r->ns_per_access) {
+                r->ns_per_access = ns;
+                r->faults = mem_sim->stats.faults;
+            }
+            clear_system(mem_sim);
+            unlink(BENCH_SWAP);
         }
         
-        // TLB miss
-        printf("TLB Miss: Page %d\n", page_num);
-    }
-    // 4. Check if page is already in memory (page table lookup)
-    if (mem_sim->page_table[page_num].V == 1) {
-        // Page is in memory - add to TLB
-        int frame_num = mem_sim->page_table[page_num].frame_swap;
-        add_to_tlb(mem_sim, page_num, frame_num);
+        // Fault service: time beyond TLB-hit translations, per fault
+        if (c == 0) hit_ns = r->ns_per_access;
+        r->ns_per_fault = (c > 0 && r->faults > 0) ?
+                          (r->ns_per_access - hit_ns) * accesses / r->faults : -1.0;
         
-        int physical_addr = frame_num * mem_sim->page_size + offset;
-        update_page_access_time(page_num);
-        return mem_sim->main_memory[physical_addr];
+        char fault_col[16] = "-";
+        if (r->ns_per_fault >= 0) snprintf(fault_col, sizeof(fault_col), "%.1f", r->ns_per_fault);
+        char change_col[64] = "-";
+        for (int b = 0; b < num_baseline; b++) {
+            if (strcmp(baseline[b].name, r->name) != 0) continue;
+            double access_change = bench_change(r->ns_per_access, baseline[b].ns_per_access);
+            double fault_change = bench_change(r->ns_per_fault, baseline[b].ns_per_fault);
+            int slower = access_change > tolerance || fault_change > tolerance;
+            char note[48] = "";
+            if (baseline[b].accesses != r->accesses) {
+                snprintf(note, sizeof(note), " (baseline n=%ld)", baseline[b].accesses);
+            } else if (baseline[b].faults != r->faults) {
+                snprintf(note, sizeof(note), " (faults differ)");
+            }
+            snprintf(change_col, sizeof(change_col), "%+.1f%% / %+.1f%%%s%s", access_change, fault_change,
+                     slower ? " SLOWER" : "", note);
+            regressions += slower;
+        }
+        printf(" %-11s | %8.2f | %9.1f | %8ld | %8s | %s\n", r->name,
+               r->ns_per_access > 0 ? 1e3 / r->ns_per_access : 0.0, r->ns_per_access,
+               r->faults, fault_col, change_col);
     }
     
-    // 5. Page fault - need to load the page
-    // Find a free frame or select one to evict
-    int frame_to_use = find_free_frame(mem_sim);
-    if (frame_to_use == -1) {
-        // No free frame, need to evict a page using LRU
-        frame_to_use = evict_page_lru(mem_sim);
+    if (baseline_path) {
+        if (regressions) {
+            printf("%d case(s) more than %.0f%% slower than %s\n", regressions, tolerance, baseline_path);
+        } else {
+            printf("No case more than %.0f%% slower than %s\n", tolerance, baseline_path);
+        }
     }
-    
-    // Now print the page fault message after eviction is done
-    printf("Page fault: Loading page %d from ", page_num);
-    
-    // 6. Load the page content based on its type
-    char* frame_start = mem_sim->main_memory + (frame_to_use * mem_sim->page_size);
-    
-    // Calculate which segment this page belongs to
-    int text_pages = (mem_sim->text_size + mem_sim->page_size - 1) / mem_sim->page_size;
-    int data_pages = (mem_sim->data_size + mem_sim->page_size - 1) / mem_sim->page_size;
-    int bss_pages = (mem_sim->bss_size + mem_sim->page_size - 1) / mem_sim->page_size;
-    
-    if (page_num < text_pages) {
-        // TEXT page - always load from program file
-        printf("program file\n");
-        load_page_from_program(mem_sim, page_num, frame_start, 0);
+    if (save_path && write_bench_baseline(save_path, results, NUM_BENCH_CASES) == 0) {
+        printf("Baseline saved to %s\n", save_path);
     }
-    else if (mem_sim->page_table[page_num].D == 1) {
-        // Page was modified before - load from swap
-        printf("swap\n");
-        load_page_from_swap(mem_sim, page_num, frame_start);
+    printf("============================\n\n");
+    return regressions ? -1 : 0;
+}
+/* ---- Simulated multiprocessor ---- */
+
+#define SMP_MAX_CPUS     64
+#define SMP_ACCESS_BATCH 64         // Hits buffered per CPU before the policy sees them
+
+/**
+ * smp_cpu - One simulated CPU, run by its own host thread
+ * The TLB is private and guarded by tlb_lock, which the CPU holds for a
+ * whole translation and data access; an evicting CPU takes it to shoot an
+ * entry down, so holding it is the acknowledgement a real IPI waits for.
+ * Counters are written by the owning thread only, except the two marked
+ * as written by evicting CPUs under tlb_lock.
+ */
+typedef struct {
+    sim_database* mem_sim;
+    struct smp_system* smp;
+    int id;
+    pthread_t thread;
+    pthread_spinlock_t tlb_lock;
+    tlb_level tlb;
+    uint64_t clock;                 // Logical time for this TLB's timestamps
+    workload w;
+    long accesses;
+    
+    int batch[SMP_ACCESS_BATCH];    // Frames hit without the mm lock, for policy->on_access
+    int batched;
+    
+    long fast;                      // Accesses served without the mm lock
+    long tlb_hits;
+    long tlb_misses;
+    long walks;                     // ...of which lock-free page table walks
+    long faults;
+    long lock_acquires;             // mm lock taken (locked accesses, policy batches)
+    long lock_contended;            // ...and found held by another CPU
+    long lock_wait_ns;
+    long tlb_lock_waits;            // Own TLB lock found held by a shootdown
+    long shootdowns_in;             // Entries invalidated by other CPUs (written by them)
+    long shootdown_waits;           // Shootdowns that waited for this CPU (written by them)
+} __attribute__((aligned(64))) smp_cpu;
+
+/**
+ * smp_system - CPUs sharing process 0's page table and the frame pool
+ * mm_lock serializes faults, evictions and everything behind them (policy,
+ * swap, writeback, read-ahead). Flags are set with atomic operations on the
+ * packed descriptor word, so CPUs never take mm_lock for TLB hits, nor for
+ * page table walks in flat and radix tables, whose descriptors never move.
+ */
+typedef struct smp_system {
+    smp_cpu* cpus;
+    int num_cpus;
+    int evicting_cpu;               // CPU holding mm_lock, for counting remote shootdowns
+    int lockfree_walk;              // Not with an inverted table, whose entries move
+    pthread_mutex_t mm_lock;
+    int go;                         // Set once every CPU thread exists
+    pte_bits pte_v, pte_d, pte_a, pte_p;  // Flag masks in the descriptor word
+    long ipis;                      // Remote TLB entries shot down
+} smp_system;
+
+_Static_assert(sizeof(page_descriptor) == sizeof(pte_bits), "descriptor must be one word");
+
+// Mask of one flag, whatever order the compiler gave the bit-fields
+static pte_bits pte_flag(int v, int d, int a, int p) {
+    page_descriptor probe;
+    pte_bits bits;
+    memset(&probe, 0, sizeof(probe));
+    probe.V = v;
+    probe.D = d;
+    probe.A = a;
+    probe.P = p;
+    memcpy(&bits, &probe, sizeof(bits));
+    return bits;
+}
+
+// TLB locks are held for one access; waiters yield in case the holder's
+// thread was preempted (there may be more CPUs than host cores)
+static int smp_tlb_lock(smp_cpu* cpu) {
+    if (pthread_spin_trylock(&cpu->tlb_lock) == 0) return 0;
+    while (pthread_spin_trylock(&cpu->tlb_lock) != 0) sched_yield();
+    return 1;
+}
+
+static void smp_lock(smp_cpu* cpu) {
+    smp_system* smp = cpu->smp;
+    cpu->lock_acquires++;
+    if (pthread_mutex_trylock(&smp->mm_lock) == 0) return;
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(&smp->mm_lock);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    cpu->lock_contended++;
+    cpu->lock_wait_ns += (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+}
+
+// Hand buffered hits to the policy (mm_lock held); frames freed since are skipped
+static void smp_drain(smp_cpu* cpu) {
+    sim_database* mem_sim = cpu->mem_sim;
+    for (int i = 0; i < cpu->batched; i++) {
+        if (mem_sim->frame_owner[cpu->batch[i]] != -1) {
+            mem_sim->policy->on_access(mem_sim, cpu->batch[i]);
+        }
     }
-    else if (page_num < text_pages + data_pages) {
-        // DATA page - load from program file
-        printf("program file\n");
-        int file_offset = mem_sim->text_size;
-        load_page_from_program(mem_sim, page_num - text_pages, frame_start, file_offset);
+    cpu->batched = 0;
+}
+
+/**
+ * smp_shootdown - Unmaps an evicted page from every simulated CPU
+ * Called from evict_page() with mm_lock held. V is cleared first, so no
+ * walk can map the page again, then each CPU's TLB lock is taken in turn:
+ * once it is, that CPU has finished any access through the old mapping.
+ */
+static void smp_shootdown(sim_database* mem_sim, page_descriptor* pd, int asid, int64_t page_num) {
+    smp_system* smp = (smp_system*)mem_sim->hook_data;
+    int invalidated = 0;
+    
+    __atomic_fetch_and((pte_bits*)pd, ~smp->pte_v, __ATOMIC_SEQ_CST);
+    for (int c = 0; c < smp->num_cpus; c++) {
+        smp_cpu* cpu = &smp->cpus[c];
+        cpu->shootdown_waits += smp_tlb_lock(cpu);
+        if (cpu->tlb.entries && tlb_level_invalidate(&cpu->tlb, asid, page_num)) {
+            invalidated = 1;
+            if (c != smp->evicting_cpu) {
+                cpu->shootdowns_in++;
+                smp->ipis++;
+            }
+        }
+        pthread_spin_unlock(&cpu->tlb_lock);
     }
-    else {
-        // BSS or HEAP/STACK page - initialize with zeros
-        printf("new allocation\n");
-        memset(frame_start, 0, mem_sim->page_size);
+    if (invalidated) {
+        mem_sim->stats.tlb_shootdowns++;
     }
-    
-    // 7. Update page table
-    mem_sim->page_table[page_num].V = 1;
-    mem_sim->page_table[page_num].frame_swap = frame_to_use;
-    
-    // 8. Add to TLB
-    add_to_tlb(mem_sim, page_num, frame_to_use);
-    
-    // Update LRU access time
-    update_page_access_time(page_num);
-    
-    // 9. Access the data
-    int physical_addr = frame_to_use * mem_sim->page_size + offset;
-    return mem_sim->main_memory[physical_addr];
 }
-void store(sim_database* mem_sim, int address, char value) {
-    // 1. Check if address is valid
-    if (address < 0 || address >= (mem_sim->num_pages * mem_sim->page_size)) {
-        fprintf(stderr, "Error: Invalid address %d (out of range)\n", address);
+
+// An access that needs mm_lock: a fault, a walk of an inverted table, a
+// read-ahead page's first use, or a store the TLB alone cannot mark dirty
+static void smp_locked_access(smp_cpu* cpu, const sweep_op* op) {
+    sim_database* mem_sim = cpu->mem_sim;
+    smp_system* smp = cpu->smp;
+    vmem_process* proc = mem_sim->procs[0];
+    int64_t page_num = op->arg / mem_sim->page_size;
+    
+    smp_lock(cpu);
+    smp_drain(cpu);
+    smp->evicting_cpu = cpu->id;
+    
+    if (op->op == TRACE_OP_STORE && page_read_only(mem_sim, proc, page_num)) {
+        fprintf(stderr, "Error: Invalid write operation to read-only segment at address %lld\n",
+                (long long)op->arg);
+        pthread_mutex_unlock(&smp->mm_lock);
         return;
     }
     
-    // 2. Calculate page number to check permissions
-    int page_num = address / mem_sim->page_size;
+    // Resident pages may be written by CPUs that hold them in their TLBs,
+    // so their flags are only changed atomically
+    page_descriptor* pd = find_descriptor(mem_sim, proc, page_num);
+    int frame;
+    if (pd && pd->V) {
+        frame = pd->frame_swap;
+        mem_sim->stats.accesses++;
+        proc->accesses++;
+        mem_sim->time.mem += mem_sim->costs.mem;
+        mem_sim->time.walk += mem_sim->costs.walk;
+        __atomic_fetch_or((pte_bits*)pd, smp->pte_a, __ATOMIC_RELAXED);
+        if (mem_sim->frame_prefetched[frame]) {
+            mem_sim->frame_prefetched[frame] = 0;
+            mem_sim->stats.ra_useful++;
+        }
+        mem_sim->policy->on_access(mem_sim, frame);
+    } else {
+        long faults = mem_sim->stats.faults;
+        frame = translate_page(mem_sim, proc, page_num);
+        cpu->faults += mem_sim->stats.faults - faults;
+        pd = find_descriptor(mem_sim, proc, page_num);
+    }
+    
+    if (frame != -1) {
+        // No other CPU touches this TLB while mm_lock is held here
+        if (cpu->tlb.entries) tlb_level_insert(&cpu->clock, &cpu->tlb, 0, page_num, frame);
+        char* data = mem_sim->main_memory + (size_t)frame * mem_sim->page_size +
+                     op->arg % mem_sim->page_size;
+        if (op->op == TRACE_OP_STORE) {
+            __atomic_store_n(data, op->value, __ATOMIC_RELAXED);
+            __atomic_fetch_or((pte_bits*)pd, smp->pte_d, __ATOMIC_RELAXED);
+        } else {
+            (void)__atomic_load_n(data, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&smp->mm_lock);
+}
+
+/**
+ * smp_access - One load or store on a simulated CPU
+ * TLB hits and lock-free walks run under the CPU's own TLB lock only: a
+ * walk maps the page if V is set (a shootdown clears V before it asks for
+ * this lock), stores set D atomically. Hits reach the replacement policy
+ * in batches, as with per-CPU LRU lists, so recency is slightly stale.
+ */
+static void smp_access(smp_cpu* cpu, const sweep_op* op) {
+    sim_database* mem_sim = cpu->mem_sim;
+    smp_system* smp = cpu->smp;
+    int64_t page_num = op->arg / mem_sim->page_size;
+    int is_store = op->op == TRACE_OP_STORE;
+    
+    cpu->tlb_lock_waits += smp_tlb_lock(cpu);
+    
+    int frame = -1;
+    if (cpu->tlb.entries) {
+        frame = tlb_level_lookup(&cpu->clock, &cpu->tlb, 0, page_num);
+        if (frame != -1) cpu->tlb_hits++;
+        else cpu->tlb_misses++;
+    }
+    
+    pte_bits* pte = NULL;
+    pte_bits bits = 0;
+    if (smp->lockfree_walk && (frame == -1 || is_store)) {
+        pte = (pte_bits*)find_descriptor(mem_sim, mem_sim->procs[0], page_num);
+        if (pte) bits = __atomic_load_n(pte, __ATOMIC_ACQUIRE);
+    }
+    if (frame == -1 && (bits & smp->pte_v)) {
+        page_descriptor pd;
+        memcpy(&pd, &bits, sizeof(pd));
+        if (!__atomic_load_n(&mem_sim->frame_prefetched[pd.frame_swap], __ATOMIC_RELAXED)) {
+            frame = pd.frame_swap;
+            if (!(bits & smp->pte_a)) __atomic_fetch_or(pte, smp->pte_a, __ATOMIC_RELAXED);
+            if (cpu->tlb.entries) tlb_level_insert(&cpu->clock, &cpu->tlb, 0, page_num, frame);
+            cpu->walks++;
+        }
+    }
+    // Read-only pages are refused (and reported) under mm_lock
+    if (is_store && (!pte || (bits & smp->pte_p))) frame = -1;
     
-    // 3. Check write permissions (TEXT segments are read-only)
-    if (mem_sim->page_table[page_num].P == 1) {
-        fprintf(stderr, "Error: Invalid write operation to read-only segment at address %d\n", address);
+    if (frame == -1) {
+        pthread_spin_unlock(&cpu->tlb_lock);
+        smp_locked_access(cpu, op);
         return;
     }
     
-    // 4. Use load() to ensure the page is in memory
-    // This handles all the page fault logic for us
-    char current_value = load(mem_sim, address);
-    
-    // Note: load() will print any error messages and return '\0' on failure
-    // We don't need to check for errors here since load() handles them
-    
-    // 5. Now the page is guaranteed to be in memory (if load succeeded)
-    // Calculate physical address
-    int offset = address % mem_sim->page_size;
-    int frame_num = mem_sim->page_table[page_num].frame_swap;
-    int physical_addr = frame_num * mem_sim->page_size + offset;
-    
-    // 6. Write the value to memory
-    mem_sim->main_memory[physical_addr] = value;
-    
-    // 7. Mark the page as dirty
-    mem_sim->page_table[page_num].D = 1;
+    char* data = mem_sim->main_memory + (size_t)frame * mem_sim->page_size +
+                 op->arg % mem_sim->page_size;
+    if (is_store) {
+        __atomic_store_n(data, op->value, __ATOMIC_RELAXED);
+        if (!(bits & smp->pte_d)) __atomic_fetch_or(pte, smp->pte_d, __ATOMIC_RELAXED);
+    } else {
+        (void)__atomic_load_n(data, __ATOMIC_RELAXED);
+    }
+    pthread_spin_unlock(&cpu->tlb_lock);
+    cpu->fast++;
     
-    // The page will be saved to swap when it gets evicted (handled by evict_page_lru)
+    cpu->batch[cpu->batched++] = frame;
+    if (cpu->batched == SMP_ACCESS_BATCH) {
+        smp_lock(cpu);
+        smp_drain(cpu);
+        pthread_mutex_unlock(&smp->mm_lock);
+    }
 }
-void clear_system(sim_database* mem_sim) {
-    if (!mem_sim) return;
-    
-    // Free page table
-    if (mem_sim->page_table) {
-        free(mem_sim->page_table);
+
+static void* smp_cpu_thread(void* arg) {
+    smp_cpu* cpu = (smp_cpu*)arg;
+    sweep_op batch[GEN_BATCH];
+    
+    while (!__atomic_load_n(&cpu->smp->go, __ATOMIC_ACQUIRE)) sched_yield();
+    for (long done = 0; done < cpu->accesses; ) {
+        int count = (cpu->accesses - done < GEN_BATCH) ? (int)(cpu->accesses - done) : GEN_BATCH;
+        workload_fill(&cpu->w, batch, count);
+        for (int i = 0; i < count; i++) smp_access(cpu, &batch[i]);
+        done += count;
+    }
+    smp_lock(cpu);
+    smp_drain(cpu);
+    pthread_mutex_unlock(&cpu->smp->mm_lock);
+    return NULL;
+}
+
+// Scaling table row for one CPU count; 'cpus' keeps the per-CPU counters
+typedef struct {
+    int num_cpus;
+    smp_cpu* cpus;
+    double seconds;
+    long accesses;
+    long faults;
+    long shootdowns;
+    long ipis;
+    long fast;
+    long lock_acquires;
+    long lock_contended;
+    long lock_wait_ns;
+} smp_result;
+
+/**
+ * smp_run - Runs 'num_cpus' CPUs of 'accesses' each on a fresh simulator
+ * CPU c replays its own stream: the same pattern seeded with seed + c, with
+ * cursor patterns starting c/num_cpus of the way into the span. The global
+ * TLBs are replaced by one private L1 per CPU of the configured size.
+ * Returns the simulator with the CPUs' counters merged into its stats, for
+ * the caller to print and clear, or NULL after printing why.
+ */
+static sim_database* smp_run(const char* init_line, int num_cpus, long accesses, int pattern,
+                             int segment, double writes, double theta, uint64_t seed,
+                             smp_result* r) {
+    sim_database* mem_sim = init_system((char*)init_line);
+    if (!mem_sim) {
+        fprintf(stderr, "Error: Failed to initialize memory system\n");
+        return NULL;
     }
-    
-    // Free main memory
-    if (mem_sim->main_memory) {
-        free(mem_sim->main_memory);
+    mem_sim->quiet = 1;
+    if (mem_sim->snapshot_every || mem_sim->ws) {
+        fprintf(stderr, "Error: Snapshots and working-set tracking are not supported by vmem smp\n");
+        clear_system(mem_sim);
+        return NULL;
     }
     
-    // Close file descriptors
-    if (mem_sim->program_fd >= 0) {
-        close(mem_sim->program_fd);
+    smp_system* smp = (smp_system*)calloc(1, sizeof(smp_system));
+    smp_cpu* cpus = smp ? (smp_cpu*)aligned_alloc(64, num_cpus * sizeof(smp_cpu)) : NULL;
+    if (!cpus) {
+        perror("Error allocating CPUs");
+        free(smp);
+        clear_system(mem_sim);
+        return NULL;
     }
-    
-    if (mem_sim->swapfile_fd >= 0) {
-        close(mem_sim->swapfile_fd);
+    memset(cpus, 0, num_cpus * sizeof(smp_cpu));
+    smp->cpus = cpus;
+    smp->num_cpus = num_cpus;
+    smp->evicting_cpu = -1;
+    smp->lockfree_walk = mem_sim->pt_type != PT_INVERTED;
+    smp->pte_v = pte_flag(1, 0, 0, 0);
+    smp->pte_d = pte_flag(0, 1, 0, 0);
+    smp->pte_a = pte_flag(0, 0, 1, 0);
+    smp->pte_p = pte_flag(0, 0, 0, 1);
+    pthread_mutex_init(&smp->mm_lock, NULL);
+    
+    free(mem_sim->tlb.entries);
+    free(mem_sim->tlb2.entries);
+    mem_sim->tlb.entries = NULL;
+    mem_sim->tlb2.entries = NULL;
+    
+    int rc = 0;
+    for (int c = 0; c < num_cpus; c++) {
+        smp_cpu* cpu = &cpus[c];
+        cpu->mem_sim = mem_sim;
+        cpu->smp = smp;
+        cpu->id = c;
+        cpu->accesses = accesses;
+        pthread_spin_init(&cpu->tlb_lock, PTHREAD_PROCESS_PRIVATE);
+        if (rc == 0 &&
+            (init_tlb_level(mem_sim, &cpu->tlb, mem_sim->tlb_size, mem_sim->tlb_ways) != 0 ||
+             workload_init(&cpu->w, mem_sim, pattern, segment, writes, theta, 0, 0,
+                           seed + c * 0x9E3779B97F4A7C15ULL) != 0)) {
+            rc = -1;
+        }
+        cpu->w.cursor = cpu->w.span / num_cpus * c;
+    }
+    
+    // CPUs wait for 'go' so they all start together; if one cannot be
+    // started, the others are released with nothing to do
+    int started = 0;
+    mem_sim->hook_data = smp;
+    mem_sim->unmap_hook = smp_shootdown;
+    while (rc == 0 && started < num_cpus) {
+        if (pthread_create(&cpus[started].thread, NULL, smp_cpu_thread, &cpus[started]) != 0) {
+            fprintf(stderr, "Error: Cannot start CPU thread %d\n", started);
+            for (int c = 0; c < started; c++) cpus[c].accesses = 0;
+            rc = -1;
+            break;
+        }
+        started++;
     }
-    
-    // Free TLB if implemented (bonus)
-    if (mem_sim->tlb) {
-        free(mem_sim->tlb);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    __atomic_store_n(&smp->go, 1, __ATOMIC_RELEASE);
+    for (int c = 0; c < started; c++) pthread_join(cpus[c].thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    writeback_drain(mem_sim);
+    mem_sim->unmap_hook = NULL;
+    mem_sim->hook_data = NULL;
+    
+    memset(r, 0, sizeof(*r));
+    r->num_cpus = num_cpus;
+    r->cpus = cpus;
+    r->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    for (int c = 0; c < num_cpus; c++) {
+        smp_cpu* cpu = &cpus[c];
+        mem_sim->stats.accesses += cpu->fast;
+        mem_sim->procs[0]->accesses += cpu->fast;
+        mem_sim->stats.tlb_hits += cpu->tlb_hits;
+        mem_sim->stats.tlb_misses += cpu->tlb_misses;
+        mem_sim->time.mem += cpu->fast * mem_sim->costs.mem;
+        mem_sim->time.tlb += (cpu->tlb_hits + cpu->tlb_misses) * mem_sim->costs.tlb;
+        mem_sim->time.walk += cpu->walks * mem_sim->costs.walk;
+        r->fast += cpu->fast;
+        r->lock_acquires += cpu->lock_acquires;
+        r->lock_contended += cpu->lock_contended;
+        r->lock_wait_ns += cpu->lock_wait_ns;
+        free(cpu->tlb.entries);
+        cpu->tlb.entries = NULL;
+        pthread_spin_destroy(&cpu->tlb_lock);
+    }
+    r->accesses = mem_sim->stats.accesses;
+    r->faults = mem_sim->stats.faults;
+    r->shootdowns = mem_sim->stats.tlb_shootdowns;
+    r->ipis = smp->ipis;
+    pthread_mutex_destroy(&smp->mm_lock);
+    free(smp);
+    
+    if (rc != 0) {
+        free(cpus);
+        r->cpus = NULL;
+        clear_system(mem_sim);
+        return NULL;
+    }
+    return mem_sim;
+}
+
+// Parse "1,2,4,8" into 'counts'; returns how many, or -1 if one is out of range
+static int parse_cpu_counts(const char* list, int* counts, int max) {
+    int n = 0;
+    while (*list) {
+        char* end;
+        long cpus = strtol(list, &end, 10);
+        if (end == list || cpus < 1 || cpus > SMP_MAX_CPUS || n == max) return -1;
+        counts[n++] = (int)cpus;
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        list = end;
+    }
+    return n ? n : -1;
+}
+
+/**
+ * handleVmemSmp - Several simulated CPUs sharing one address space
+ * Usage: vmem smp <script|trace.bin> <zipf|seq|loop|stride|random> [cpus=<n>[,<n>...]]
+ *        [n=<accesses per CPU>] [writes=<fraction>] [segment=...] [theta=<skew>]
+ *        [seed=<n>] [--key=value]
+ * Each CPU is a host thread replaying its own generated stream against
+ * process 0 of the script's simulator (see smp_run). Each CPU count is run
+ * on a fresh simulator and reported as one row: throughput (generation
+ * included) and speedup over the first row, fault rate, evictions that
+ * needed a shootdown, remote entries shot down, the share of accesses
+ * served without the mm lock and how often that lock was contended. The
+ * last run is then broken down per CPU, followed by its stats. The default
+ * counts are the powers of two up to the number of host cores.
+ */
+int handleVmemSmp(char** tokens, int tokenCount) {
+    const char* usage =
+        "Usage: vmem smp <script|trace.bin> <zipf|seq|loop|stride|random> [cpus=<n>[,<n>...]]\n"
+        "       [n=<accesses per CPU>] [writes=<fraction>] [segment=text|data|bss|heap_stack|all]\n"
+        "       [theta=<skew>] [seed=<n>] [--key=value]\n";
+    if (tokenCount < 4 || find_gen_pattern(tokens[3]) == -1) {
+        fprintf(stderr, "%s", usage);
+        return -1;
     }
     
-    // Free the main structure
-    free(mem_sim);
-    
-    // Clean up global LRU tracking
-    if (page_access_time) {
-        free(page_access_time);
-        page_access_time = NULL;
-        global_time_counter = 0;
+    int pattern = find_gen_pattern(tokens[3]);
+    long accesses = 1000000;
+    double writes = 0.25;
+    double theta = 0.99;
+    int segment = -1;
+    uint64_t seed = 1;
+    char overrides[BUFSIZ] = "";
+    int counts[SMP_MAX_CPUS];
+    int num_counts = 0;
+    
+    int host_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (host_cpus < 1) host_cpus = 1;
+    for (int cpus = 1; cpus < host_cpus && cpus <= SMP_MAX_CPUS; cpus *= 2) counts[num_counts++] = cpus;
+    counts[num_counts++] = (host_cpus < SMP_MAX_CPUS) ? host_cpus : SMP_MAX_CPUS;
+    
+    for (int i = 4; i < tokenCount; i++) {
+        const char* arg = tokens[i];
+        int ok = 1;
+        if (strncmp(arg, "--", 2) == 0 && strchr(arg, '=')) {
+            strncat(overrides, " ", sizeof(overrides) - strlen(overrides) - 1);
+            strncat(overrides, arg + 2, sizeof(overrides) - strlen(overrides) - 1);
+        } else if (strncmp(arg, "cpus=", 5) == 0) {
+            num_counts = parse_cpu_counts(arg + 5, counts, SMP_MAX_CPUS);
+            ok = num_counts > 0;
+        } else if (strncmp(arg, "n=", 2) == 0) {
+            accesses = atol(arg + 2);
+            ok = accesses > 0;
+        } else if (strncmp(arg, "writes=", 7) == 0) {
+            writes = atof(arg + 7);
+            ok = writes >= 0.0 && writes <= 1.0;
+        } else if (strncmp(arg, "theta=", 6) == 0) {
+            theta = atof(arg + 6);
+            ok = theta >= 0.0 && theta < 1.0;
+        } else if (strncmp(arg, "seed=", 5) == 0) {
+            seed = strtoull(arg + 5, NULL, 10);
+        } else if (strncmp(arg, "segment=", 8) == 0) {
+            segment = find_gen_segment(arg + 8);
+            ok = segment != -2;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: Invalid smp setting '%s' (cpus are 1 to %d)\n", arg, SMP_MAX_CPUS);
+            return -1;
+        }
     }
+    
+    char line[256];
+    trace_map trace;
+    FILE* script = open_script(tokens[2], line, sizeof(line), &trace);
+    if (!script) return -1;
+    if (trace.data != MAP_FAILED) munmap(trace.data, trace.size);
+    fclose(script);
+    char init_line[sizeof(line) + sizeof(overrides)];
+    snprintf(init_line, sizeof(init_line), "%s%s", line, overrides);
+    
+    sim_database* mem_sim = NULL;
+    smp_result r;
+    double base_rate = 0.0;
+    for (int i = 0; i < num_counts; i++) {
+        if (mem_sim) {
+            free(r.cpus);
+            clear_system(mem_sim);
+        }
+        mem_sim = smp_run(init_line, counts[i], accesses, pattern, segment, writes, theta, seed, &r);
+        if (!mem_sim) return -1;
+        
+        if (i == 0) {
+            printf("=== SMP SIMULATION ===\n");
+            printf("%s, %ld accesses per CPU (seed %llu), %s page table, %d-entry TLB per CPU, "
+                   "%d host cores\n", gen_patterns[pattern], accesses, (unsigned long long)seed,
+                   mem_sim->pt_type == PT_RADIX ? "radix" :
+                   mem_sim->pt_type == PT_INVERTED ? "inverted" : "flat",
+                   mem_sim->tlb_size, host_cpus);
+            printf(" CPUs |  M acc/s | Speedup | Fault rate | Shootdowns |     IPIs | Lock-free | "
+                   "Contended | Wait ms\n");
+            printf("------|----------|---------|------------|------------|----------|-----------|"
+                   "-----------|--------\n");
+        }
+        double rate = r.seconds > 0 ? r.accesses / r.seconds / 1e6 : 0.0;
+        if (i == 0) base_rate = rate;
+        printf(" %4d | %8.2f | %6.2fx | %9.4f%% | %10ld | %8ld | %8.2f%% | %8.2f%% | %7.1f\n",
+               r.num_cpus, rate, base_rate > 0 ? rate / base_rate : 0.0,
+               r.accesses ? 100.0 * r.faults / r.accesses : 0.0, r.shootdowns, r.ipis,
+               r.accesses ? 100.0 * r.fast / r.accesses : 0.0,
+               r.lock_acquires ? 100.0 * r.lock_contended / r.lock_acquires : 0.0,
+               r.lock_wait_ns / 1e6);
+    }
+    
+    // TLB waits: collisions on the CPU's TLB lock, whichever side waited
+    printf("\n CPU |   Accesses | TLB hits | Lock-free |    Walks |   Faults | Shot down | "
+           "mm waits | TLB waits\n");
+    printf("-----|------------|----------|-----------|----------|----------|-----------|"
+           "----------|----------\n");
+    for (int c = 0; c < r.num_cpus; c++) {
+        smp_cpu* cpu = &r.cpus[c];
+        long lookups = cpu->tlb_hits + cpu->tlb_misses;
+        printf(" %3d | %10ld | %7.2f%% | %8.2f%% | %8ld | %8ld | %9ld | %8ld | %9ld\n", c,
+               cpu->accesses, lookups ? 100.0 * cpu->tlb_hits / lookups : 0.0,
+               cpu->accesses ? 100.0 * cpu->fast / cpu->accesses : 0.0, cpu->walks,
+               cpu->faults, cpu->shootdowns_in, cpu->lock_contended,
+               cpu->tlb_lock_waits + cpu->shootdown_waits);
+    }
+    printf("======================\n\n");
+    print_stats(mem_sim);
+    free(r.cpus);
+    clear_system(mem_sim);
+    return 0;
 }
 int handleMCalc(char** tokens,int tokenCount) {
     if (tokenCount < 4) {
@@ -1409,6 +3888,7 @@ void* sub(void* ptr) {
 // Constants
 #define BUFFER_SIZE 1024
 #define MAX_ARGS 7
+#define VMEM_MAX_ARGS 16   // vmem subcommands take one key=value token per setting
 
 // Shell statistics
 typedef struct {
@@ -1762,6 +4242,8 @@ int tokenize_command(char *cmd, char **tokens) {
     int nargs = 0;
     char *p = cmd;
     int spaces = 0;
+    int max_args = (strncmp(cmd, "vmem", 4) == 0 && (cmd[4] == ' ' || cmd[4] == '\0'))
+                   ? VMEM_MAX_ARGS : MAX_ARGS;
     
     // Special case for rlimit set
     if (strncmp(cmd, "rlimit set fsize=", 17) == 0) {
@@ -1808,7 +4290,7 @@ int tokenize_command(char *cmd, char **tokens) {
         }
         spaces = 0;
         
-        if (nargs >= MAX_ARGS - 1) {
+        if (nargs >= max_args - 1) {
             fprintf(stderr, "ERR_ARGS\n");
             return -1;
         }
@@ -1913,10 +4395,7 @@ void run_command(char **args, const char *logfile) {
         clock_gettime(CLOCK_MONOTONIC, &start);
         int argc=0;
         while (args[argc]) argc++;
-        if (argc!=2){
-            perror("vmem error");
-        }
-        int result = handleVmem(args[1]);
+        int result = handleVmem(args, argc);
         clock_gettime(CLOCK_MONOTONIC, &end);
         
         if (result == 0) {
@@ -2071,7 +4550,7 @@ int handle_stderr_redir(char *cmd, const char *logfile, char **dlist, int ndange
     char cmd_copy[BUFFER_SIZE];
     strcpy(cmd_copy, cmd);
     
-    char *args[MAX_ARGS];
+    char *args[VMEM_MAX_ARGS];
     if (tokenize_command(cmd_copy, args) != 0 || !args[0]) {
         *redir = ' ';
         return -1;
@@ -2206,7 +4685,7 @@ int handle_pipe(char *cmd, const char *logfile, char **dlist, int ndanger) {
         return -1;
     }
     
-    char *largs[MAX_ARGS], *rargs[MAX_ARGS];
+    char *largs[VMEM_MAX_ARGS], *rargs[VMEM_MAX_ARGS];
     char lcopy[BUFFER_SIZE], rcopy[BUFFER_SIZE];
     strcpy(lcopy, ltrim);
     strcpy(rcopy, rtrim);
@@ -2483,7 +4962,7 @@ int main(int argc, char *argv[]) {
             char line_copy[BUFFER_SIZE];
             strcpy(line_copy, line);
             
-            char *args[MAX_ARGS];
+            char *args[VMEM_MAX_ARGS];
             if (tokenize_command(line_copy, args) == 0 && args[0]) {
                 int danger = check_danger(args, danger_list, ndanger, 1);
                 
@@ -2503,6 +4982,7 @@ int main(int argc, char *argv[]) {
     }
     
     // Cleanup
+    close_vmem_session();
     for (int i = 0; i < ndanger; i++) {
         free(danger_list[i]);
     }
@@ -0,0 +1,4170 @@
+/**
+ * vmem.c - Virtual memory simulator core: page tables, TLBs, replacement,
+ * swap, writeback and checkpoints. Public API in vmem.h, internals shared
+ * with the shell's vmem tools in vmem_internal.h.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "vmem_internal.h"
+
+// Size of the buffer that batches per-access messages into one write()
+#define VMEM_OUT_CHUNK (64 * 1024)
+
+/**
+ * vmem_flush - Hands any batched per-access messages to the message callback
+ * Must run before anything else is printed to stdout so output stays ordered.
+ */
+void vmem_flush(sim_database* mem_sim) {
+    if (mem_sim->out_len == 0) return;
+    mem_sim->message(mem_sim->callback_data, mem_sim->out_buf, mem_sim->out_len);
+    mem_sim->out_len = 0;
+}
+
+/**
+ * vmem_log - Per-access message (TLB hits, page faults, ...)
+ * Dropped entirely in quiet mode or without a message callback, otherwise
+ * appended to the output buffer and delivered in large chunks instead of
+ * one call per message.
+ */
+void vmem_log(sim_database* mem_sim, const char* fmt, ...) {
+    if (mem_sim->quiet || !mem_sim->message) return;
+    
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(mem_sim->out_buf + mem_sim->out_len,
+                        VMEM_OUT_CHUNK - mem_sim->out_len, fmt, args);
+    va_end(args);
+    
+    if (len < 0) return;
+    if ((size_t)len >= VMEM_OUT_CHUNK - mem_sim->out_len) {
+        // Did not fit: flush and format again into the empty buffer
+        vmem_flush(mem_sim);
+        va_start(args, fmt);
+        len = vsnprintf(mem_sim->out_buf, VMEM_OUT_CHUNK, fmt, args);
+        va_end(args);
+        if (len < 0) return;
+        if (len >= VMEM_OUT_CHUNK) len = VMEM_OUT_CHUNK - 1;
+    }
+    mem_sim->out_len += len;
+}
+
+/**
+ * vmem_error - Reports an error (or a fallback) through the error callback
+ * One line without the newline; dropped if the handle has no callback.
+ * The async writeback thread reports its write errors from that thread.
+ */
+void vmem_error(sim_database* mem_sim, const char* fmt, ...) {
+    if (!mem_sim->error) return;
+    
+    char text[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+    mem_sim->error(mem_sim->callback_data, text);
+}
+
+// Message callback of the shell's simulators: straight to stdout, after
+// anything stdio still holds
+void vmem_print_message(void* data, const char* text, size_t length) {
+    (void)data;
+    fflush(stdout);
+    
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = write(STDOUT_FILENO, text + written, length - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += n;
+    }
+}
+
+// Error callback of the shell's simulators
+void vmem_print_error(void* data, const char* text) {
+    (void)data;
+    fprintf(stderr, "%s\n", text);
+}
+
+/* ---- Page tables: flat, lazily built radix tree, or inverted hash ---- */
+
+#define PT_RADIX_BITS   9                     // Page number bits resolved per level
+#define PT_RADIX_FANOUT (1 << PT_RADIX_BITS)  // Entries in every node
+#define PT_FLAT_MAX_PAGES ((int64_t)1 << 28)  // Largest flat table (4 GiB of descriptors)
+
+/**
+ * inverted_table - One hashed page table shared by all processes
+ * Only pages that hold a frame or a swap slot have an entry, so it is sized
+ * by num_frames + num_swap_slots however large the address spaces are.
+ * A page with neither is clean and not resident: its contents come from
+ * the program file or are zero-filled, and it needs no descriptor at all.
+ */
+typedef struct inverted_table {
+    page_descriptor* pte;         // Entry -> descriptor
+    int64_t* page;                // Entry -> page number
+    int* asid;                    // Entry -> owning process
+    int* chain;                   // Entry -> next entry in the same bucket
+    int* buckets;                 // Hash bucket -> first entry, -1 if empty
+    int mask;
+    int* free_entries;
+    int free_count;
+    int capacity;
+} inverted_table;
+
+int text_page_count(sim_database* mem_sim, vmem_process* proc) {
+    return (proc->text_size + mem_sim->page_size - 1) / mem_sim->page_size;
+}
+
+// Segment a page belongs to, fixed by the process layout
+static int page_segment(sim_database* mem_sim, vmem_process* proc, int64_t page_num) {
+    int text_pages = text_page_count(mem_sim, proc);
+    int data_pages = (proc->data_size + mem_sim->page_size - 1) / mem_sim->page_size;
+    int bss_pages = (proc->bss_size + mem_sim->page_size - 1) / mem_sim->page_size;
+    
+    if (page_num < text_pages) return PTE_SEG_TEXT;
+    if (page_num < text_pages + data_pages) return PTE_SEG_DATA;
+    if (page_num < text_pages + data_pages + bss_pages) return PTE_SEG_BSS;
+    return PTE_SEG_HEAP_STACK;
+}
+
+// A descriptor for an untouched page: not present, clean, read-only if TEXT
+static void init_descriptor(sim_database* mem_sim, vmem_process* proc, int64_t page_num,
+                            page_descriptor* pd) {
+    pd->V = 0;
+    pd->D = 0;
+    pd->A = 0;
+    pd->seg = page_segment(mem_sim, proc, page_num);
+    pd->P = (pd->seg == PTE_SEG_TEXT) ? 1 : 0;
+    pd->frame_swap = -1;
+}
+
+/**
+ * pte_map - Marks a page resident in 'frame' with one release store
+ * Lock-free walks (vmem smp) read descriptors while faults run: they must
+ * see V only together with the frame, and with the page's contents in it.
+ */
+static void pte_map(page_descriptor* pd, int frame, int accessed) {
+    page_descriptor mapped = *pd;
+    pte_bits bits;
+    mapped.V = 1;
+    if (accessed) mapped.A = 1;
+    mapped.frame_swap = frame;
+    memcpy(&bits, &mapped, sizeof(bits));
+    __atomic_store_n((pte_bits*)pd, bits, __ATOMIC_RELEASE);
+}
+
+static int inverted_hash(inverted_table* ipt, int asid, int64_t page_num) {
+    uint64_t key = (uint64_t)page_num * 0x9E3779B97F4A7C15ULL + (uint64_t)asid * 0xC2B2AE3D27D4EB4FULL;
+    return (int)((key >> 32) & (unsigned)ipt->mask);
+}
+
+static int inverted_find(inverted_table* ipt, int asid, int64_t page_num) {
+    int entry = ipt->buckets[inverted_hash(ipt, asid, page_num)];
+    while (entry != -1 && (ipt->page[entry] != page_num || ipt->asid[entry] != asid)) {
+        entry = ipt->chain[entry];
+    }
+    return entry;
+}
+
+int inverted_init(sim_database* mem_sim) {
+    inverted_table* ipt = (inverted_table*)calloc(1, sizeof(inverted_table));
+    if (!ipt) {
+        vmem_error(mem_sim, "Error allocating inverted page table: %s", strerror(errno));
+        return -1;
+    }
+    mem_sim->ipt = ipt;
+    
+    ipt->capacity = mem_sim->num_frames + mem_sim->num_swap_slots;
+    int buckets = 1;
+    while (buckets < 2 * ipt->capacity) buckets <<= 1;
+    ipt->mask = buckets - 1;
+    
+    ipt->pte = (page_descriptor*)malloc(ipt->capacity * sizeof(page_descriptor));
+    ipt->page = (int64_t*)malloc(ipt->capacity * sizeof(int64_t));
+    ipt->asid = (int*)malloc(ipt->capacity * sizeof(int));
+    ipt->chain = (int*)malloc(ipt->capacity * sizeof(int));
+    ipt->free_entries = (int*)malloc(ipt->capacity * sizeof(int));
+    ipt->buckets = (int*)malloc(buckets * sizeof(int));
+    if (!ipt->pte || !ipt->page || !ipt->asid || !ipt->chain || !ipt->free_entries ||
+        !ipt->buckets) {
+        vmem_error(mem_sim, "Error allocating inverted page table: %s", strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < ipt->capacity; i++) {
+        ipt->free_entries[i] = ipt->capacity - 1 - i;
+        ipt->asid[i] = -1;
+    }
+    ipt->free_count = ipt->capacity;
+    for (int i = 0; i < buckets; i++) ipt->buckets[i] = -1;
+    
+    mem_sim->stats.pt_bytes += (long)ipt->capacity * (sizeof(page_descriptor) + sizeof(int64_t) +
+                                                      3 * sizeof(int)) +
+                               (long)buckets * sizeof(int);
+    return 0;
+}
+
+void inverted_destroy(sim_database* mem_sim) {
+    inverted_table* ipt = mem_sim->ipt;
+    if (!ipt) return;
+    free(ipt->pte);
+    free(ipt->page);
+    free(ipt->asid);
+    free(ipt->chain);
+    free(ipt->free_entries);
+    free(ipt->buckets);
+    free(ipt);
+    mem_sim->ipt = NULL;
+}
+
+// Radix levels needed to cover num_pages (4 for a 48-bit space of 4 KB pages)
+static int radix_levels(int64_t num_pages) {
+    int levels = 1;
+    while (levels * PT_RADIX_BITS < 63 && (num_pages - 1) >> (levels * PT_RADIX_BITS)) levels++;
+    return levels;
+}
+
+// Walk to a page's descriptor, building missing nodes when 'create' is set.
+// Nodes are published with release stores, so walks need no lock (vmem smp)
+static page_descriptor* radix_walk(sim_database* mem_sim, vmem_process* proc, int64_t page_num,
+                                   int create) {
+    void** slot = &proc->pt_root;
+    for (int level = proc->pt_levels - 1; level > 0; level--) {
+        void* node = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (!node) {
+            if (!create) return NULL;
+            node = calloc(PT_RADIX_FANOUT, sizeof(void*));
+            if (!node) {
+                vmem_error(mem_sim, "Error allocating page table node: %s", strerror(errno));
+                return NULL;
+            }
+            __atomic_store_n(slot, node, __ATOMIC_RELEASE);
+            mem_sim->stats.pt_bytes += PT_RADIX_FANOUT * sizeof(void*);
+        }
+        slot = &((void**)node)[(page_num >> (level * PT_RADIX_BITS)) & (PT_RADIX_FANOUT - 1)];
+    }
+    
+    page_descriptor* leaf = (page_descriptor*)__atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (!leaf) {
+        if (!create) return NULL;
+        leaf = (page_descriptor*)malloc(PT_RADIX_FANOUT * sizeof(page_descriptor));
+        if (!leaf) {
+            vmem_error(mem_sim, "Error allocating page table node: %s", strerror(errno));
+            return NULL;
+        }
+        int64_t base = page_num & ~(int64_t)(PT_RADIX_FANOUT - 1);
+        for (int i = 0; i < PT_RADIX_FANOUT; i++) {
+            init_descriptor(mem_sim, proc, base + i, &leaf[i]);
+        }
+        __atomic_store_n(slot, (void*)leaf, __ATOMIC_RELEASE);
+        mem_sim->stats.pt_bytes += PT_RADIX_FANOUT * sizeof(page_descriptor);
+    }
+    return &leaf[page_num & (PT_RADIX_FANOUT - 1)];
+}
+
+static void radix_free(void* node, int level) {
+    if (!node) return;
+    if (level > 0) {
+        for (int i = 0; i < PT_RADIX_FANOUT; i++) radix_free(((void**)node)[i], level - 1);
+    }
+    free(node);
+}
+
+/**
+ * find_descriptor - A page's descriptor, or NULL if the page was never given one
+ * NULL stands for the initial state (not present, clean, no swap slot), so
+ * lookups never allocate. Only flat tables have a descriptor for every page.
+ */
+page_descriptor* find_descriptor(sim_database* mem_sim, vmem_process* proc, int64_t page_num) {
+    if (mem_sim->pt_type == PT_FLAT) {
+        return &proc->page_table[page_num];
+    }
+    if (mem_sim->pt_type == PT_RADIX) {
+        return radix_walk(mem_sim, proc, page_num, 0);
+    }
+    int entry = inverted_find(mem_sim->ipt, proc->asid, page_num);
+    return (entry == -1) ? NULL : &mem_sim->ipt->pte[entry];
+}
+
+// A page's descriptor, created on first touch; NULL only if none can be made
+page_descriptor* get_descriptor(sim_database* mem_sim, vmem_process* proc, int64_t page_num) {
+    page_descriptor* pd = find_descriptor(mem_sim, proc, page_num);
+    if (pd) return pd;
+    if (mem_sim->pt_type == PT_RADIX) {
+        return radix_walk(mem_sim, proc, page_num, 1);
+    }
+    
+    inverted_table* ipt = mem_sim->ipt;
+    if (ipt->free_count == 0) {
+        vmem_error(mem_sim, "Error: Inverted page table full (%d entries)", ipt->capacity);
+        return NULL;
+    }
+    int entry = ipt->free_entries[--ipt->free_count];
+    int bucket = inverted_hash(ipt, proc->asid, page_num);
+    init_descriptor(mem_sim, proc, page_num, &ipt->pte[entry]);
+    ipt->page[entry] = page_num;
+    ipt->asid[entry] = proc->asid;
+    ipt->chain[entry] = ipt->buckets[bucket];
+    ipt->buckets[bucket] = entry;
+    return &ipt->pte[entry];
+}
+
+// Drop a descriptor that is back in its initial state (inverted table only)
+void release_descriptor(sim_database* mem_sim, vmem_process* proc, int64_t page_num) {
+    if (mem_sim->pt_type != PT_INVERTED) return;
+    inverted_table* ipt = mem_sim->ipt;
+    int* link = &ipt->buckets[inverted_hash(ipt, proc->asid, page_num)];
+    while (*link != -1 && (ipt->page[*link] != page_num || ipt->asid[*link] != proc->asid)) {
+        link = &ipt->chain[*link];
+    }
+    int entry = *link;
+    if (entry == -1 || ipt->pte[entry].V || ipt->pte[entry].D) return;
+    *link = ipt->chain[entry];
+    ipt->free_entries[ipt->free_count++] = entry;
+}
+
+// Build a process's table: every descriptor when flat, nothing yet otherwise
+static int init_page_table(sim_database* mem_sim, vmem_process* proc) {
+    if (mem_sim->pt_type == PT_RADIX) {
+        proc->pt_levels = radix_levels(proc->num_pages);
+        return 0;
+    }
+    if (mem_sim->pt_type == PT_INVERTED) {
+        return 0;
+    }
+    
+    if (proc->num_pages > PT_FLAT_MAX_PAGES ||
+        !(proc->page_table = (page_descriptor*)malloc(proc->num_pages * sizeof(page_descriptor)))) {
+        vmem_error(mem_sim, "Error allocating page table: %lld pages do not fit a flat table "
+                    "(try pagetable=radix or pagetable=inverted)", (long long)proc->num_pages);
+        return -1;
+    }
+    for (int64_t page = 0; page < proc->num_pages; page++) {
+        init_descriptor(mem_sim, proc, page, &proc->page_table[page]);
+    }
+    mem_sim->stats.pt_bytes += proc->num_pages * sizeof(page_descriptor);
+    return 0;
+}
+
+// Release a process's table; inverted entries stay with the shared table
+static void free_page_table(vmem_process* proc) {
+    free(proc->page_table);
+    proc->page_table = NULL;
+    radix_free(proc->pt_root, proc->pt_levels - 1);
+    proc->pt_root = NULL;
+}
+
+/**
+ * print_memory - Prints the contents of the main memory (RAM)
+ * Shows each frame with its contents in both hex and character format
+ */
+void print_memory(sim_database* mem_sim) {
+    if (!mem_sim || !mem_sim->main_memory) {
+        printf("Error: Invalid memory simulation structure\n");
+        return;
+    }
+    
+    printf("=== MAIN MEMORY CONTENTS ===\n");
+    printf("Memory size: %d bytes, Page size: %d bytes, Number of frames: %d\n", 
+           mem_sim->memory_size, mem_sim->page_size, mem_sim->num_frames);
+    
+    for (int frame = 0; frame < mem_sim->num_frames; frame++) {
+        printf("Frame %d: ", frame);
+        
+        // Print hex values
+        for (int i = 0; i < mem_sim->page_size; i++) {
+            int addr = frame * mem_sim->page_size + i;
+            printf("%02X ", (unsigned char)mem_sim->main_memory[addr]);
+        }
+        
+        printf("| ");
+        
+        // Print character representation
+        for (int i = 0; i < mem_sim->page_size; i++) {
+            int addr = frame * mem_sim->page_size + i;
+            char c = mem_sim->main_memory[addr];
+            if (c >= 32 && c <= 126) {  // Printable ASCII
+                printf("%c", c);
+            } else {
+                printf(".");
+            }
+        }
+        printf("\n");
+    }
+    printf("=============================\n\n");
+}
+
+/**
+ * print_swap - Prints the contents of the swap file
+ * Shows each page slot in the swap file
+ */
+void print_swap(sim_database* mem_sim) {
+    if (!mem_sim) {
+        printf("Error: Invalid swap file\n");
+        return;
+    }
+    
+    printf("=== SWAP FILE CONTENTS ===\n");
+    printf("Swap size: %d bytes, Page size: %d bytes, Number of swap pages: %d\n", 
+           mem_sim->swap_size, mem_sim->page_size, mem_sim->swap_size / mem_sim->page_size);
+    
+    int num_swap_pages = mem_sim->swap_size / mem_sim->page_size;
+    char* buffer = malloc(mem_sim->page_size);
+    
+    if (!buffer) {
+        vmem_error(mem_sim, "Error allocating buffer for swap reading: %s", strerror(errno));
+        return;
+    }
+    
+    for (int page = 0; page < num_swap_pages; page++) {
+        // Released slots keep stale bytes on disk - show them as empty
+        if (!(mem_sim->swap_bitmap[page / 64] & (1ULL << (page % 64)))) {
+            memset(buffer, '-', mem_sim->page_size);
+        } else if (zswap_load(mem_sim, page, buffer, 1)) {
+            // Held compressed in RAM; its disk slot is not written yet
+        } else if (writeback_peek(mem_sim, page, buffer)) {
+            // Still queued: show what is headed for swap, not a stale slot
+        } else if (mem_sim->swap_map) {
+            memcpy(buffer, mem_sim->swap_map + (size_t)page * mem_sim->page_size, mem_sim->page_size);
+        } else if (pread(mem_sim->swapfile_fd, buffer, mem_sim->page_size,
+                         (off_t)page * mem_sim->page_size) != mem_sim->page_size) {
+            printf("Swap Page %d: [Error reading]\n", page);
+            continue;
+        }
+        
+        printf("Swap Page %d: ", page);
+        
+        // Print hex values
+        for (int i = 0; i < mem_sim->page_size; i++) {
+            printf("%02X ", (unsigned char)buffer[i]);
+        }
+        
+        printf("| ");
+        
+        // Print character representation
+        for (int i = 0; i < mem_sim->page_size; i++) {
+            char c = buffer[i];
+            if (c >= 32 && c <= 126) {  // Printable ASCII
+                printf("%c", c);
+            } else {
+                printf(".");
+            }
+        }
+        printf("\n");
+    }
+    
+    free(buffer);
+    printf("===========================\n\n");
+}
+
+// One row of "print table"
+static void print_page_row(int64_t page, const page_descriptor* pd) {
+    static const char* segments[] = {"TEXT", "DATA", "BSS", "H/S"};  // H/S: Heap/Stack
+    
+    printf("%4lld | %d | %d | %d |", (long long)page, (int)pd->V, (int)pd->D, (int)pd->P);
+    
+    if (pd->frame_swap == -1) {
+        printf("      -    |");
+    } else {
+        printf("    %4d   |", (int)pd->frame_swap);
+    }
+    
+    printf(" %s\n", segments[pd->seg]);
+}
+
+// In-order walk of a radix table, printing pages in memory or swap
+static void print_radix_rows(void* node, int level, int64_t base) {
+    if (!node) return;
+    for (int i = 0; i < PT_RADIX_FANOUT; i++) {
+        int64_t page = base + ((int64_t)i << (level * PT_RADIX_BITS));
+        if (level > 0) {
+            print_radix_rows(((void**)node)[i], level - 1, page);
+        } else if (((page_descriptor*)node)[i].V || ((page_descriptor*)node)[i].D) {
+            print_page_row(page, &((page_descriptor*)node)[i]);
+        }
+    }
+}
+
+static int compare_page(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * print_page_table - Prints the page table contents
+ * Flat tables show every page descriptor with its flags and frame/swap
+ * location; radix and inverted tables only show pages in memory or swap,
+ * since the rest of a sparse address space has no descriptors.
+ */
+void print_page_table(sim_database* mem_sim) {
+    if (!mem_sim || !mem_sim->proc ||
+        (mem_sim->pt_type == PT_FLAT && !mem_sim->proc->page_table)) {
+        printf("Error: Invalid page table\n");
+        return;
+    }
+    vmem_process* proc = mem_sim->proc;
+    
+    printf("=== PAGE TABLE ===\n");
+    if (mem_sim->num_procs > 1) {
+        printf("Process: %d (%s)\n", proc->asid, proc->program_name);
+    }
+    printf("Number of pages: %lld\n", (long long)proc->num_pages);
+    if (mem_sim->pt_type != PT_FLAT) {
+        printf("Page table: %s, %ld bytes; pages in memory or swap only\n",
+               mem_sim->pt_type == PT_RADIX ? "radix" : "inverted", mem_sim->stats.pt_bytes);
+    }
+    printf("Page | V | D | P | Frame/Swap | Segment\n");
+    printf("-----|---|---|---|------------|--------\n");
+    
+    if (mem_sim->pt_type == PT_FLAT) {
+        for (int64_t page = 0; page < proc->num_pages; page++) {
+            print_page_row(page, &proc->page_table[page]);
+        }
+    } else if (mem_sim->pt_type == PT_RADIX) {
+        print_radix_rows(proc->pt_root, proc->pt_levels - 1, 0);
+    } else {
+        // Gather this process's entries and print them in page order
+        inverted_table* ipt = mem_sim->ipt;
+        int64_t* pages = (int64_t*)malloc((ipt->capacity + 1) * sizeof(int64_t));
+        int count = 0;
+        for (int entry = 0; pages && entry < ipt->capacity; entry++) {
+            if (ipt->asid[entry] == proc->asid && inverted_find(ipt, proc->asid, ipt->page[entry]) == entry) {
+                pages[count++] = ipt->page[entry];
+            }
+        }
+        if (pages) qsort(pages, count, sizeof(int64_t), compare_page);
+        for (int i = 0; i < count; i++) {
+            print_page_row(pages[i], find_descriptor(mem_sim, proc, pages[i]));
+        }
+        free(pages);
+    }
+    printf("==================\n");
+    printf("Legend: V=Valid, D=Dirty, P=Permission (1=Read-Only, 0=Read/Write)\n");
+    printf("        Frame/Swap: Frame number if in memory (V=1), Swap page if swapped out\n\n");
+}
+
+// Print the valid entries of one TLB level
+static void print_tlb_level(const char* name, tlb_level* level) {
+    printf("%s: %d entries, %d sets x %d ways\n",
+           name, level->sets * level->ways, level->sets, level->ways);
+    printf(" Set | Way | Valid | ASID | Page | Frame | Timestamp\n");
+    printf("-----|-----|-------|------|------|-------|----------\n");
+    
+    for (int set = 0; set < level->sets; set++) {
+        for (int way = 0; way < level->ways; way++) {
+            tlb_entry* entry = &level->entries[set * level->ways + way];
+            printf(" %3d | %3d |   %d   |", set, way, entry->valid);
+            
+            if (entry->valid) {
+                printf(" %4d | %4lld | %5d |  %8llu\n", 
+                       entry->asid, (long long)entry->page_number, entry->frame_number,
+                       (unsigned long long)entry->timestamp);
+            } else {
+                printf("   -  |   -  |   -   |     -\n");
+            }
+        }
+    }
+}
+
+/**
+ * print_tlb - Prints the TLB contents
+ * Shows every set and way of each configured TLB level
+ */
+void print_tlb(sim_database* mem_sim) {
+    if (!mem_sim || !mem_sim->tlb.entries) {
+        printf("TLB disabled (tlb=0)\n\n");
+        return;
+    }
+    
+    printf("=== TLB CONTENTS ===\n");
+    print_tlb_level("L1 TLB", &mem_sim->tlb);
+    if (mem_sim->tlb2.entries) {
+        print_tlb_level("L2 TLB", &mem_sim->tlb2);
+    }
+    printf("====================\n\n");
+}
+/**
+ * map_program_file - Maps a process's program file read-only
+ * Programs that are not regular files (e.g. /dev/zero) keep using read().
+ */
+static int map_program_file(sim_database* mem_sim, vmem_process* proc) {
+    struct stat st;
+    if (fstat(proc->program_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        proc->program_map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                                 proc->program_fd, 0);
+        if (proc->program_map == MAP_FAILED) {
+            vmem_error(mem_sim, "Error mapping program file: %s", strerror(errno));
+            proc->program_map = NULL;
+            return -1;
+        }
+        proc->program_map_size = st.st_size;
+    }
+    return 0;
+}
+
+/**
+ * create_process - Adds an address space running 'exe_file_name'
+ * Opens (and maps) its program file and builds an empty page table with
+ * TEXT pages read-only. The new process gets the next free ASID but does
+ * not become the current process.
+ */
+vmem_process* create_process(sim_database* mem_sim, const char* exe_file_name,
+                             int text_size, int data_size, int bss_size,
+                             int64_t heap_stack_size, int64_t num_pages) {
+    if (num_pages <= 0 || text_size < 0 || data_size < 0 || bss_size < 0 || heap_stack_size < 0 ||
+        num_pages > INT64_MAX / mem_sim->page_size) {
+        vmem_error(mem_sim, "Error: Invalid process layout for %s", exe_file_name);
+        return NULL;
+    }
+    
+    vmem_process** procs = (vmem_process**)realloc(mem_sim->procs,
+                                                   (mem_sim->num_procs + 1) * sizeof(vmem_process*));
+    if (!procs) {
+        vmem_error(mem_sim, "Error allocating process table: %s", strerror(errno));
+        return NULL;
+    }
+    mem_sim->procs = procs;
+    
+    vmem_process* proc = (vmem_process*)calloc(1, sizeof(vmem_process));
+    if (!proc) {
+        vmem_error(mem_sim, "Error allocating process: %s", strerror(errno));
+        return NULL;
+    }
+    snprintf(proc->program_name, sizeof(proc->program_name), "%s", exe_file_name);
+    proc->text_size = text_size;
+    proc->data_size = data_size;
+    proc->bss_size = bss_size;
+    proc->heap_stack_size = heap_stack_size;
+    proc->num_pages = num_pages;
+    proc->ra_next = -1;
+    
+    // Open program file (read-only)
+    proc->program_fd = open(exe_file_name, O_RDONLY);
+    if (proc->program_fd < 0) {
+        vmem_error(mem_sim, "Error opening program file: %s", strerror(errno));
+        free(proc);
+        return NULL;
+    }
+    
+    // Allocate the page table (TEXT pages are read-only, P=1)
+    if (init_page_table(mem_sim, proc) != 0) {
+        close(proc->program_fd);
+        free(proc);
+        return NULL;
+    }
+    
+    // Map the program so page loads are plain memcpy
+    if (mem_sim->io_mode == VMEM_IO_MMAP && map_program_file(mem_sim, proc) != 0) {
+        free_process(proc);
+        return NULL;
+    }
+    
+    proc->asid = mem_sim->num_procs;
+    mem_sim->procs[mem_sim->num_procs++] = proc;
+    return proc;
+}
+
+// Release a process's page table and program file
+void free_process(vmem_process* proc) {
+    if (!proc) return;
+    free_page_table(proc);
+    if (proc->program_map) {
+        munmap(proc->program_map, proc->program_map_size);
+    }
+    if (proc->program_fd >= 0) {
+        close(proc->program_fd);
+    }
+    free(proc);
+}
+
+/**
+ * switch_process - Makes 'asid' the current address space
+ * TLB entries are tagged with their ASID, so nothing is flushed.
+ */
+int switch_process(sim_database* mem_sim, int asid) {
+    if (asid < 0 || asid >= mem_sim->num_procs) {
+        vmem_error(mem_sim, "Error: No process with ASID %d", asid);
+        return -1;
+    }
+    mem_sim->proc = mem_sim->procs[asid];
+    return 0;
+}
+
+/**
+ * vmem_create - Sets up a simulator as described by 'config'
+ * Stores the new handle in *handle and returns VMEM_OK, or reports why it
+ * failed through config->error and returns VMEM_ERR_CONFIG.
+ */
+int vmem_create(const vmem_config* config, vmem_handle** handle) {
+    *handle = NULL;
+    
+    // Allocate the main structure
+    sim_database* mem_sim = (sim_database*)calloc(1, sizeof(sim_database));
+    if (!mem_sim) {
+        if (config->error) config->error(config->callback_data, "Error allocating memory for sim_database");
+        return VMEM_ERR_CONFIG;
+    }
+    mem_sim->page_size = config->page_size;
+    mem_sim->memory_size = config->memory_size;
+    mem_sim->swap_size = config->swap_size;
+    mem_sim->quiet = !config->verbose;
+    mem_sim->message = config->message;
+    mem_sim->error = config->error;
+    mem_sim->callback_data = config->callback_data;
+    
+    // Optional key=value settings may follow the ten required fields
+    mem_sim->policy = find_policy("lru");
+    mem_sim->policy_seed = 1;
+    mem_sim->tlb_size = 16;
+    mem_sim->tlb_ways = 4;
+    mem_sim->tlb2_ways = 8;
+    mem_sim->io_mode = VMEM_IO_MMAP;
+    mem_sim->wb_low = 16;
+    mem_sim->wb_high = 64;
+    mem_sim->ra_max = 32;
+    mem_sim->costs.tlb = 1.0;
+    mem_sim->costs.tlb2 = 5.0;
+    mem_sim->costs.mem = 100.0;
+    mem_sim->costs.walk = 100.0;
+    mem_sim->costs.disk_read = 5000000.0;
+    mem_sim->costs.disk_write = 5000000.0;
+    mem_sim->costs.zswap = 2000.0;
+    strcpy(mem_sim->snapshot_path, "-");
+    if (parse_init_options(mem_sim, config->options ? config->options : "") != 0) {
+        free(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+    
+    // Every table below is sized from these
+    if (!config->program || !config->swap || mem_sim->page_size <= 0 ||
+        mem_sim->memory_size < mem_sim->page_size || mem_sim->swap_size < 0) {
+        vmem_error(mem_sim, "Error: Invalid page, memory or swap size");
+        free(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+    
+    // Calculate number of frames
+    mem_sim->num_frames = mem_sim->memory_size / mem_sim->page_size;
+    
+    // The init line describes process 0, which starts out current
+    mem_sim->proc = create_process(mem_sim, config->program, config->text_size, config->data_size,
+                                   config->bss_size, config->heap_stack_size, config->num_pages);
+    if (!mem_sim->proc) {
+        free(mem_sim->procs);
+        free(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+    
+    // The swap file is created last, once nothing else can fail
+    mem_sim->swapfile_fd = -1;
+    if (snprintf(mem_sim->swap_path, sizeof(mem_sim->swap_path), "%s", config->swap) >=
+        (int)sizeof(mem_sim->swap_path)) {
+        vmem_error(mem_sim, "Error: Swap file name too long");
+        free_process(mem_sim->proc);
+        free(mem_sim->procs);
+        free(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+    
+    // Allocate and initialize main memory (and the message buffer)
+    mem_sim->main_memory = (char*)malloc(mem_sim->memory_size);
+    mem_sim->out_buf = (char*)malloc(VMEM_OUT_CHUNK);
+    if (!mem_sim->main_memory || !mem_sim->out_buf) {
+        vmem_error(mem_sim, "Error allocating main memory: %s", strerror(errno));
+        free(mem_sim->main_memory);
+        free(mem_sim->out_buf);
+        free_process(mem_sim->proc);
+        free(mem_sim->procs);
+        free(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+    memset(mem_sim->main_memory, '-', mem_sim->memory_size);
+    
+    // Allocate the TLB levels (tlb=0 disables translation caching)
+    if (init_tlb_level(mem_sim, &mem_sim->tlb, mem_sim->tlb_size, mem_sim->tlb_ways) != 0 ||
+        init_tlb_level(mem_sim, &mem_sim->tlb2, mem_sim->tlb2_size, mem_sim->tlb2_ways) != 0) {
+        free(mem_sim->tlb.entries);
+        free(mem_sim->main_memory);
+        free(mem_sim->out_buf);
+        free_process(mem_sim->proc);
+        free(mem_sim->procs);
+        free(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+
+    // Allocate the frame manager: free-frame stack and frame -> (ASID, page) tables
+    mem_sim->free_frames = (int*)malloc(mem_sim->num_frames * sizeof(int));
+    mem_sim->frame_owner = (int64_t*)malloc(mem_sim->num_frames * sizeof(int64_t));
+    mem_sim->frame_asid = (int*)malloc(mem_sim->num_frames * sizeof(int));
+    mem_sim->frame_prefetched = (unsigned char*)calloc(mem_sim->num_frames, 1);
+    if (!mem_sim->free_frames || !mem_sim->frame_owner || !mem_sim->frame_asid ||
+        !mem_sim->frame_prefetched || mem_sim->policy->init(mem_sim) != 0) {
+        vmem_error(mem_sim, "Error allocating frame table: %s", strerror(errno));
+        free(mem_sim->free_frames);
+        free(mem_sim->frame_owner);
+        free(mem_sim->frame_asid);
+        free(mem_sim->frame_prefetched);
+        if (mem_sim->policy_state) mem_sim->policy->destroy(mem_sim);
+        free(mem_sim->tlb.entries);
+        free(mem_sim->tlb2.entries);
+        free(mem_sim->main_memory);
+        free(mem_sim->out_buf);
+        free_process(mem_sim->proc);
+        free(mem_sim->procs);
+        free(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+
+    // Push frames in reverse so the lowest frame number is handed out first
+    for (int frame = 0; frame < mem_sim->num_frames; frame++) {
+        mem_sim->free_frames[frame] = mem_sim->num_frames - 1 - frame;
+        mem_sim->frame_owner[frame] = -1;
+        mem_sim->frame_asid[frame] = -1;
+    }
+    mem_sim->free_frame_count = mem_sim->num_frames;
+    
+    // Allocate the swap slot bitmap (all slots start free)
+    mem_sim->num_swap_slots = mem_sim->swap_size / mem_sim->page_size;
+#ifdef VMEM_PTE32
+    if (mem_sim->num_frames > PTE_FRAME_MAX || mem_sim->num_swap_slots > PTE_FRAME_MAX) {
+        vmem_error(mem_sim, "Error: %d frames and %d swap slots do not fit a 32-bit page table entry",
+                    mem_sim->num_frames, mem_sim->num_swap_slots);
+        free(mem_sim->free_frames);
+        free(mem_sim->frame_owner);
+        free(mem_sim->frame_asid);
+        free(mem_sim->frame_prefetched);
+        mem_sim->policy->destroy(mem_sim);
+        free(mem_sim->tlb.entries);
+        free(mem_sim->tlb2.entries);
+        free(mem_sim->main_memory);
+        free(mem_sim->out_buf);
+        free_process(mem_sim->proc);
+        free(mem_sim->procs);
+        free(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+#endif
+    mem_sim->swap_bitmap = (uint64_t*)calloc((mem_sim->num_swap_slots + 63) / 64 + 1,
+                                             sizeof(uint64_t));
+    if (!mem_sim->swap_bitmap) {
+        vmem_error(mem_sim, "Error allocating swap bitmap: %s", strerror(errno));
+        free(mem_sim->free_frames);
+        free(mem_sim->frame_owner);
+        free(mem_sim->frame_asid);
+        free(mem_sim->frame_prefetched);
+        mem_sim->policy->destroy(mem_sim);
+        free(mem_sim->tlb.entries);
+        free(mem_sim->tlb2.entries);
+        free(mem_sim->main_memory);
+        free(mem_sim->out_buf);
+        free_process(mem_sim->proc);
+        free(mem_sim->procs);
+        free(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+
+    // The inverted page table is sized by the frames and swap slots
+    if (mem_sim->pt_type == PT_INVERTED && inverted_init(mem_sim) != 0) {
+        clear_system(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+    
+    // Queue for dirty victims, with its flusher thread in async mode
+    if (mem_sim->wb_mode != WRITEBACK_SYNC && writeback_init(mem_sim) != 0) {
+        clear_system(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+    
+    // Compressed tier in front of the swap file
+    if (mem_sim->zswap_size > 0 && zswap_init(mem_sim) != 0) {
+        clear_system(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+    
+    // Working set over the last ws_window accesses, by default one snapshot interval
+    if (mem_sim->ws_window == 0 && mem_sim->snapshot_every > 0) {
+        mem_sim->ws_window = mem_sim->snapshot_every < INT_MAX ? (int)mem_sim->snapshot_every : INT_MAX;
+    }
+    if (mem_sim->ws_window > 0 && ws_init(mem_sim) != 0) {
+        clear_system(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+    
+    // Scratch for the largest read-ahead window
+    if (mem_sim->readahead) {
+        mem_sim->ra_frames = (int*)malloc(mem_sim->ra_max * sizeof(int));
+        mem_sim->ra_slots = (int*)malloc(mem_sim->ra_max * sizeof(int));
+        mem_sim->ra_iov = (struct iovec*)malloc(mem_sim->ra_max * sizeof(struct iovec));
+        if (!mem_sim->ra_frames || !mem_sim->ra_slots || !mem_sim->ra_iov) {
+            vmem_error(mem_sim, "Error allocating read-ahead buffers: %s", strerror(errno));
+            clear_system(mem_sim);
+            return VMEM_ERR_CONFIG;
+        }
+    }
+    
+    // Create the swap file now, so a bad path fails here rather than at the
+    // first eviction; only the first swap-out sizes and maps it (swap_open)
+    mem_sim->swapfile_fd = open(mem_sim->swap_path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (mem_sim->swapfile_fd < 0) {
+        vmem_error(mem_sim, "Error creating/opening swap file: %s", strerror(errno));
+        clear_system(mem_sim);
+        return VMEM_ERR_CONFIG;
+    }
+    
+    *handle = mem_sim;
+    return VMEM_OK;
+}
+
+/**
+ * init_system - Sets up a simulator from a script's init line
+ * "<program> <swap> <text> <data> <bss> <heap_stack> <page> <pages> <memory> <swap size>"
+ * followed by optional key=value settings.
+ */
+sim_database* init_system(char* init_line) {
+    char exe_file_name[256];
+    char swap_file_name[256];
+    long long heap_stack_size, num_pages;
+    int options_start = 0;
+    vmem_config config;
+    
+    memset(&config, 0, sizeof(config));
+    int parsed = sscanf(init_line, "%255s %255s %d %d %d %lld %d %lld %d %d%n",
+                        exe_file_name, swap_file_name,
+                        &config.text_size, &config.data_size, &config.bss_size, &heap_stack_size,
+                        &config.page_size, &num_pages,
+                        &config.memory_size, &config.swap_size,
+                        &options_start);
+    
+    if (parsed != 10) {
+        vmem_print_error(NULL, "Error: Invalid script format");
+        return NULL;
+    }
+    config.program = exe_file_name;
+    config.swap = swap_file_name;
+    config.heap_stack_size = heap_stack_size;
+    config.num_pages = num_pages;
+    config.options = init_line + options_start;
+    config.verbose = 1;
+    config.message = vmem_print_message;
+    config.error = vmem_print_error;
+    
+    sim_database* mem_sim;
+    return vmem_create(&config, &mem_sim) == VMEM_OK ? mem_sim : NULL;
+}
+
+/**
+ * ckpt_io - One pass over the simulator state for a checkpoint or a restore
+ * Checkpoints append each region to 'out'; restores copy it back from the
+ * mapped image at 'pos'. Everything is visited in the same order both ways,
+ * so one function per structure describes its part of the image.
+ */
+typedef struct ckpt_io {
+    FILE* out;                    // Checkpoint: image being written
+    const char* in;               // Restore: mapped image
+    size_t size;                  // ...and its length
+    size_t pos;
+    int failed;
+} ckpt_io;
+
+static void ckpt_bytes(ckpt_io* io, void* data, size_t bytes) {
+    if (io->failed || bytes == 0) return;
+    if (io->out) {
+        if (fwrite(data, 1, bytes, io->out) != bytes) io->failed = 1;
+    } else if (bytes > io->size - io->pos) {
+        io->failed = 1;
+        return;
+    } else {
+        memcpy(data, io->in + io->pos, bytes);
+    }
+    io->pos += bytes;
+}
+
+
+/**
+ * frame_list - Intrusive doubly-linked list over small integer ids
+ * Used by the replacement policies for frames and for ARC ghost entries.
+ * head is the most recently inserted id, tail the oldest.
+ */
+typedef struct {
+    int* prev;
+    int* next;
+    int head;
+    int tail;
+    int size;
+} frame_list;
+
+static int frame_list_init(frame_list* list, int capacity) {
+    list->prev = (int*)malloc(capacity * sizeof(int));
+    list->next = (int*)malloc(capacity * sizeof(int));
+    list->head = -1;
+    list->tail = -1;
+    list->size = 0;
+    return (list->prev && list->next) ? 0 : -1;
+}
+
+static void frame_list_free(frame_list* list) {
+    free(list->prev);
+    free(list->next);
+}
+
+static void frame_list_serialize(ckpt_io* io, frame_list* list, int capacity) {
+    ckpt_bytes(io, list->prev, capacity * sizeof(int));
+    ckpt_bytes(io, list->next, capacity * sizeof(int));
+    ckpt_bytes(io, &list->head, sizeof(list->head));
+    ckpt_bytes(io, &list->tail, sizeof(list->tail));
+    ckpt_bytes(io, &list->size, sizeof(list->size));
+}
+
+static void frame_list_unlink(frame_list* list, int id) {
+    int prev = list->prev[id];
+    int next = list->next[id];
+
+    if (prev != -1) list->next[prev] = next;
+    else list->head = next;
+
+    if (next != -1) list->prev[next] = prev;
+    else list->tail = prev;
+    list->size--;
+}
+
+static void frame_list_push_front(frame_list* list, int id) {
+    list->prev[id] = -1;
+    list->next[id] = list->head;
+    if (list->head != -1) {
+        list->prev[list->head] = id;
+    } else {
+        list->tail = id;
+    }
+    list->head = id;
+    list->size++;
+}
+
+static void frame_list_push_back(frame_list* list, int id) {
+    list->next[id] = -1;
+    list->prev[id] = list->tail;
+    if (list->tail != -1) {
+        list->next[list->tail] = id;
+    } else {
+        list->head = id;
+    }
+    list->tail = id;
+    list->size++;
+}
+
+// Remove and return the oldest id, or -1 if the list is empty
+static int frame_list_pop_back(frame_list* list) {
+    int id = list->tail;
+    if (id != -1) frame_list_unlink(list, id);
+    return id;
+}
+
+/* ---- LRU and FIFO: a single queue, LRU also reorders on access ---- */
+
+static int queue_policy_init(sim_database* mem_sim) {
+    frame_list* queue = (frame_list*)malloc(sizeof(frame_list));
+    if (!queue) return -1;
+    mem_sim->policy_state = queue;
+    return frame_list_init(queue, mem_sim->num_frames);
+}
+
+static void queue_policy_destroy(sim_database* mem_sim) {
+    frame_list_free((frame_list*)mem_sim->policy_state);
+    free(mem_sim->policy_state);
+    mem_sim->policy_state = NULL;
+}
+
+static void queue_policy_insert(sim_database* mem_sim, int frame) {
+    frame_list_push_front((frame_list*)mem_sim->policy_state, frame);
+}
+
+static int queue_policy_victim(sim_database* mem_sim) {
+    return frame_list_pop_back((frame_list*)mem_sim->policy_state);
+}
+
+static void lru_access(sim_database* mem_sim, int frame) {
+    frame_list* queue = (frame_list*)mem_sim->policy_state;
+    if (queue->head == frame) return;
+    frame_list_unlink(queue, frame);
+    frame_list_push_front(queue, frame);
+}
+
+static void fifo_access(sim_database* mem_sim, int frame) {
+    (void)mem_sim;
+    (void)frame;
+}
+
+static void queue_policy_serialize(sim_database* mem_sim, ckpt_io* io) {
+    frame_list_serialize(io, (frame_list*)mem_sim->policy_state, mem_sim->num_frames);
+}
+
+/* ---- CLOCK and Second-Chance: reference bits, amortized O(1) ---- */
+
+typedef struct {
+    frame_list queue;       // Second-chance: load order
+    unsigned char* ref;     // Reference bit per frame
+    int hand;               // CLOCK: next frame to inspect
+} clock_state;
+
+static int clock_init(sim_database* mem_sim) {
+    clock_state* st = (clock_state*)calloc(1, sizeof(clock_state));
+    if (!st) return -1;
+    mem_sim->policy_state = st;
+    st->ref = (unsigned char*)calloc(mem_sim->num_frames, 1);
+    if (!st->ref) return -1;
+    return frame_list_init(&st->queue, mem_sim->num_frames);
+}
+
+static void clock_destroy(sim_database* mem_sim) {
+    clock_state* st = (clock_state*)mem_sim->policy_state;
+    frame_list_free(&st->queue);
+    free(st->ref);
+    free(st);
+    mem_sim->policy_state = NULL;
+}
+
+static void clock_insert(sim_database* mem_sim, int frame) {
+    clock_state* st = (clock_state*)mem_sim->policy_state;
+    st->ref[frame] = 1;
+}
+
+static void clock_access(sim_database* mem_sim, int frame) {
+    clock_state* st = (clock_state*)mem_sim->policy_state;
+    st->ref[frame] = 1;
+}
+
+// Sweep the hand over the frames, clearing reference bits on the way.
+// Frames taken for a read-ahead window hold no page yet and are passed over.
+static int clock_victim(sim_database* mem_sim) {
+    clock_state* st = (clock_state*)mem_sim->policy_state;
+    while (st->ref[st->hand] || mem_sim->frame_owner[st->hand] == -1) {
+        st->ref[st->hand] = 0;
+        st->hand = (st->hand + 1) % mem_sim->num_frames;
+    }
+    int victim = st->hand;
+    st->hand = (st->hand + 1) % mem_sim->num_frames;
+    return victim;
+}
+
+static void second_chance_insert(sim_database* mem_sim, int frame) {
+    clock_state* st = (clock_state*)mem_sim->policy_state;
+    st->ref[frame] = 0;
+    frame_list_push_front(&st->queue, frame);
+}
+
+static void clock_serialize(sim_database* mem_sim, ckpt_io* io) {
+    clock_state* st = (clock_state*)mem_sim->policy_state;
+    frame_list_serialize(io, &st->queue, mem_sim->num_frames);
+    ckpt_bytes(io, st->ref, mem_sim->num_frames);
+    ckpt_bytes(io, &st->hand, sizeof(st->hand));
+}
+
+// Oldest page loses its reference bit and goes to the back of the queue
+static int second_chance_victim(sim_database* mem_sim) {
+    clock_state* st = (clock_state*)mem_sim->policy_state;
+    int frame = frame_list_pop_back(&st->queue);
+    while (frame != -1 && st->ref[frame]) {
+        st->ref[frame] = 0;
+        frame_list_push_front(&st->queue, frame);
+        frame = frame_list_pop_back(&st->queue);
+    }
+    return frame;
+}
+
+/* ---- LFU: frequency buckets, O(1) per operation ---- */
+
+typedef struct {
+    frame_list members;     // Frames per bucket share these link arrays
+    int* bucket_of;         // Frame -> bucket id
+    long* bucket_freq;      // Bucket -> access count of its frames
+    int* bucket_head;       // Bucket -> most recent member frame
+    int* bucket_tail;       // Bucket -> least recent member frame
+    frame_list buckets;     // Buckets ordered by frequency, lowest at tail
+    int* free_buckets;
+    int free_count;
+} lfu_state;
+
+static int lfu_init(sim_database* mem_sim) {
+    int n = mem_sim->num_frames + 1;  // A promotion briefly needs one extra bucket
+    lfu_state* st = (lfu_state*)calloc(1, sizeof(lfu_state));
+    if (!st) return -1;
+    mem_sim->policy_state = st;
+    st->bucket_of = (int*)malloc(mem_sim->num_frames * sizeof(int));
+    st->bucket_freq = (long*)malloc(n * sizeof(long));
+    st->bucket_head = (int*)malloc(n * sizeof(int));
+    st->bucket_tail = (int*)malloc(n * sizeof(int));
+    st->free_buckets = (int*)malloc(n * sizeof(int));
+    if (!st->bucket_of || !st->bucket_freq || !st->bucket_head ||
+        !st->bucket_tail || !st->free_buckets) return -1;
+    for (int i = 0; i < n; i++) st->free_buckets[i] = n - 1 - i;
+    st->free_count = n;
+    if (frame_list_init(&st->buckets, n) != 0) return -1;
+    return frame_list_init(&st->members, mem_sim->num_frames);
+}
+
+static void lfu_destroy(sim_database* mem_sim) {
+    lfu_state* st = (lfu_state*)mem_sim->policy_state;
+    frame_list_free(&st->members);
+    frame_list_free(&st->buckets);
+    free(st->bucket_of);
+    free(st->bucket_freq);
+    free(st->bucket_head);
+    free(st->bucket_tail);
+    free(st->free_buckets);
+    free(st);
+    mem_sim->policy_state = NULL;
+}
+
+// Add a frame at the most recent end of a bucket's member chain
+static void lfu_bucket_add(lfu_state* st, int bucket, int frame) {
+    st->bucket_of[frame] = bucket;
+    st->members.prev[frame] = -1;
+    st->members.next[frame] = st->bucket_head[bucket];
+    if (st->bucket_head[bucket] != -1) {
+        st->members.prev[st->bucket_head[bucket]] = frame;
+    } else {
+        st->bucket_tail[bucket] = frame;
+    }
+    st->bucket_head[bucket] = frame;
+}
+
+// Remove a frame from its bucket, releasing the bucket if it empties
+static void lfu_bucket_remove(lfu_state* st, int frame) {
+    int bucket = st->bucket_of[frame];
+    int prev = st->members.prev[frame];
+    int next = st->members.next[frame];
+
+    if (prev != -1) st->members.next[prev] = next;
+    else st->bucket_head[bucket] = next;
+    if (next != -1) st->members.prev[next] = prev;
+    else st->bucket_tail[bucket] = prev;
+
+    if (st->bucket_head[bucket] == -1) {
+        frame_list_unlink(&st->buckets, bucket);
+        st->free_buckets[st->free_count++] = bucket;
+    }
+}
+
+static int lfu_new_bucket(lfu_state* st, long freq) {
+    int bucket = st->free_buckets[--st->free_count];
+    st->bucket_freq[bucket] = freq;
+    st->bucket_head[bucket] = -1;
+    st->bucket_tail[bucket] = -1;
+    return bucket;
+}
+
+static void lfu_insert(sim_database* mem_sim, int frame) {
+    lfu_state* st = (lfu_state*)mem_sim->policy_state;
+    int bucket = st->buckets.tail;
+    if (bucket == -1 || st->bucket_freq[bucket] != 1) {
+        bucket = lfu_new_bucket(st, 1);
+        frame_list_push_back(&st->buckets, bucket);
+    }
+    lfu_bucket_add(st, bucket, frame);
+}
+
+static void lfu_access(sim_database* mem_sim, int frame) {
+    lfu_state* st = (lfu_state*)mem_sim->policy_state;
+    int bucket = st->bucket_of[frame];
+    long freq = st->bucket_freq[bucket] + 1;
+    int higher = st->buckets.prev[bucket];
+
+    if (higher == -1 || st->bucket_freq[higher] != freq) {
+        // Link the new bucket above the current one before it may be released
+        higher = lfu_new_bucket(st, freq);
+        st->buckets.prev[higher] = st->buckets.prev[bucket];
+        st->buckets.next[higher] = bucket;
+        if (st->buckets.prev[bucket] != -1) {
+            st->buckets.next[st->buckets.prev[bucket]] = higher;
+        } else {
+            st->buckets.head = higher;
+        }
+        st->buckets.prev[bucket] = higher;
+        st->buckets.size++;
+    }
+    lfu_bucket_remove(st, frame);
+    lfu_bucket_add(st, higher, frame);
+}
+
+static void lfu_serialize(sim_database* mem_sim, ckpt_io* io) {
+    lfu_state* st = (lfu_state*)mem_sim->policy_state;
+    int n = mem_sim->num_frames + 1;
+    frame_list_serialize(io, &st->members, mem_sim->num_frames);
+    frame_list_serialize(io, &st->buckets, n);
+    ckpt_bytes(io, st->bucket_of, mem_sim->num_frames * sizeof(int));
+    ckpt_bytes(io, st->bucket_freq, n * sizeof(long));
+    ckpt_bytes(io, st->bucket_head, n * sizeof(int));
+    ckpt_bytes(io, st->bucket_tail, n * sizeof(int));
+    ckpt_bytes(io, st->free_buckets, n * sizeof(int));
+    ckpt_bytes(io, &st->free_count, sizeof(st->free_count));
+}
+
+// Least frequently used frame; ties go to the least recently promoted one
+static int lfu_victim(sim_database* mem_sim) {
+    lfu_state* st = (lfu_state*)mem_sim->policy_state;
+    int bucket = st->buckets.tail;
+    if (bucket == -1) return -1;
+    int frame = st->bucket_tail[bucket];
+    lfu_bucket_remove(st, frame);
+    return frame;
+}
+
+/* ---- ARC: adaptive replacement cache (Megiddo & Modha) ---- */
+
+#define ARC_NONE 0
+#define ARC_B1   1
+#define ARC_B2   2
+#define ARC_HIT  3      // Ghost hit whose page is not inserted yet
+
+typedef struct {
+    frame_list t1;          // Resident, seen once recently
+    frame_list t2;          // Resident, seen at least twice
+    unsigned char* in_t2;   // Frame -> 1 if in T2
+    frame_list b1;          // Ghosts evicted from T1 (ids are ghost nodes)
+    frame_list b2;          // Ghosts evicted from T2
+    int64_t* ghost_page;    // Node -> page number...
+    int* ghost_asid;        // ...and the ASID it belongs to
+    unsigned char* ghost_list;  // Node -> ARC_B1 / ARC_B2 / ARC_HIT / ARC_NONE (free)
+    int* ghost_chain;       // Node -> next node in the same hash bucket
+    int* ghost_hash;        // Hash bucket -> first node
+    int hash_mask;
+    int* free_nodes;
+    int free_count;
+    int capacity;           // c: number of frames
+    int target_t1;          // p: adaptive target size of T1
+    int ghost_hit;          // Ghost list the faulting page was found in
+    int drop_t1;            // Evict the T1 tail without remembering it
+} arc_state;
+
+static int arc_init(sim_database* mem_sim) {
+    int c = mem_sim->num_frames;
+    int nodes = 2 * c;
+    arc_state* st = (arc_state*)calloc(1, sizeof(arc_state));
+    if (!st) return -1;
+    mem_sim->policy_state = st;
+
+    int buckets = 1;
+    while (buckets < nodes) buckets <<= 1;
+    st->hash_mask = buckets - 1;
+    st->capacity = c;
+
+    st->in_t2 = (unsigned char*)calloc(c, 1);
+    st->ghost_page = (int64_t*)malloc(nodes * sizeof(int64_t));
+    st->ghost_asid = (int*)malloc(nodes * sizeof(int));
+    st->ghost_list = (unsigned char*)calloc(nodes, 1);
+    st->ghost_chain = (int*)malloc(nodes * sizeof(int));
+    st->ghost_hash = (int*)malloc(buckets * sizeof(int));
+    st->free_nodes = (int*)malloc(nodes * sizeof(int));
+    if (!st->in_t2 || !st->ghost_page || !st->ghost_asid || !st->ghost_list || !st->ghost_chain ||
+        !st->ghost_hash || !st->free_nodes) return -1;
+
+    for (int i = 0; i < buckets; i++) st->ghost_hash[i] = -1;
+    for (int i = 0; i < nodes; i++) st->free_nodes[i] = nodes - 1 - i;
+    st->free_count = nodes;
+
+    if (frame_list_init(&st->t1, c) != 0 || frame_list_init(&st->t2, c) != 0 ||
+        frame_list_init(&st->b1, nodes) != 0 || frame_list_init(&st->b2, nodes) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void arc_destroy(sim_database* mem_sim) {
+    arc_state* st = (arc_state*)mem_sim->policy_state;
+    frame_list_free(&st->t1);
+    frame_list_free(&st->t2);
+    frame_list_free(&st->b1);
+    frame_list_free(&st->b2);
+    free(st->in_t2);
+    free(st->ghost_page);
+    free(st->ghost_asid);
+    free(st->ghost_list);
+    free(st->ghost_chain);
+    free(st->ghost_hash);
+    free(st->free_nodes);
+    free(st);
+    mem_sim->policy_state = NULL;
+}
+
+// Ghosts outlive their frames, so they are keyed by ASID and page
+static int arc_hash(arc_state* st, int asid, int64_t page_num) {
+    uint64_t key = (uint64_t)page_num * 0x9E3779B97F4A7C15ULL + (uint64_t)asid * 0xC2B2AE3D27D4EB4FULL;
+    return (int)((key >> 32) & (unsigned)st->hash_mask);
+}
+
+static int arc_ghost_find(arc_state* st, int asid, int64_t page_num) {
+    int node = st->ghost_hash[arc_hash(st, asid, page_num)];
+    while (node != -1 && (st->ghost_page[node] != page_num || st->ghost_asid[node] != asid)) {
+        node = st->ghost_chain[node];
+    }
+    return node;
+}
+
+static void arc_ghost_remove(arc_state* st, int node) {
+    int* link = &st->ghost_hash[arc_hash(st, st->ghost_asid[node], st->ghost_page[node])];
+    while (*link != node) link = &st->ghost_chain[*link];
+    *link = st->ghost_chain[node];
+
+    if (st->ghost_list[node] != ARC_HIT) {
+        frame_list_unlink(st->ghost_list[node] == ARC_B1 ? &st->b1 : &st->b2, node);
+    }
+    st->ghost_list[node] = ARC_NONE;
+    st->free_nodes[st->free_count++] = node;
+}
+
+static void arc_ghost_add(arc_state* st, int list_id, int asid, int64_t page_num) {
+    if (st->free_count == 0) {
+        // Should not happen given ARC's size invariants, but never overflow
+        arc_ghost_remove(st, st->b2.size ? st->b2.tail : st->b1.tail);
+    }
+    int node = st->free_nodes[--st->free_count];
+    int bucket = arc_hash(st, asid, page_num);
+    st->ghost_page[node] = page_num;
+    st->ghost_asid[node] = asid;
+    st->ghost_list[node] = (unsigned char)list_id;
+    st->ghost_chain[node] = st->ghost_hash[bucket];
+    st->ghost_hash[bucket] = node;
+    frame_list_push_front(list_id == ARC_B1 ? &st->b1 : &st->b2, node);
+}
+
+// Adapt the T1 target on ghost hits and trim the history on plain misses.
+// A hit leaves the ghost lists but stays hashed as ARC_HIT until its page is
+// inserted, since read-ahead may fault other pages in between.
+static void arc_fault(sim_database* mem_sim, int64_t page_num) {
+    arc_state* st = (arc_state*)mem_sim->policy_state;
+    int c = st->capacity;
+    int node = arc_ghost_find(st, mem_sim->proc->asid, page_num);
+
+    st->ghost_hit = ARC_NONE;
+    st->drop_t1 = 0;
+
+    if (node != -1 && st->ghost_list[node] == ARC_HIT) {
+        // Faulted before but never inserted: the target already adapted
+        return;
+    }
+    if (node != -1) {
+        if (st->ghost_list[node] == ARC_B1) {
+            int delta = (st->b2.size > st->b1.size) ? st->b2.size / st->b1.size : 1;
+            st->target_t1 = (st->target_t1 + delta < c) ? st->target_t1 + delta : c;
+            st->ghost_hit = ARC_B1;
+        } else {
+            int delta = (st->b1.size > st->b2.size) ? st->b1.size / st->b2.size : 1;
+            st->target_t1 = (st->target_t1 - delta > 0) ? st->target_t1 - delta : 0;
+            st->ghost_hit = ARC_B2;
+        }
+        frame_list_unlink(st->ghost_list[node] == ARC_B1 ? &st->b1 : &st->b2, node);
+        st->ghost_list[node] = ARC_HIT;
+        return;
+    }
+
+    int total = st->t1.size + st->t2.size + st->b1.size + st->b2.size;
+    if (st->t1.size + st->b1.size >= c) {
+        if (st->t1.size < c) {
+            arc_ghost_remove(st, st->b1.tail);
+        } else {
+            st->drop_t1 = 1;
+        }
+    } else if (total >= 2 * c && st->b2.size) {
+        arc_ghost_remove(st, st->b2.tail);
+    }
+}
+
+static int arc_victim(sim_database* mem_sim) {
+    arc_state* st = (arc_state*)mem_sim->policy_state;
+    int frame;
+
+    if (st->drop_t1) {
+        return frame_list_pop_back(&st->t1);
+    }
+
+    // REPLACE(x, p) from the paper
+    if (st->t1.size > 0 &&
+        (st->t1.size > st->target_t1 ||
+         (st->ghost_hit == ARC_B2 && st->t1.size == st->target_t1) ||
+         st->t2.size == 0)) {
+        frame = frame_list_pop_back(&st->t1);
+        arc_ghost_add(st, ARC_B1, mem_sim->frame_asid[frame], mem_sim->frame_owner[frame]);
+    } else {
+        frame = frame_list_pop_back(&st->t2);
+        arc_ghost_add(st, ARC_B2, mem_sim->frame_asid[frame], mem_sim->frame_owner[frame]);
+    }
+    return frame;
+}
+
+static void arc_insert(sim_database* mem_sim, int frame) {
+    arc_state* st = (arc_state*)mem_sim->policy_state;
+    int node = arc_ghost_find(st, mem_sim->frame_asid[frame], mem_sim->frame_owner[frame]);
+    st->in_t2[frame] = (node != -1 && st->ghost_list[node] == ARC_HIT);
+    if (node != -1) arc_ghost_remove(st, node);
+    frame_list_push_front(st->in_t2[frame] ? &st->t2 : &st->t1, frame);
+}
+
+static void arc_access(sim_database* mem_sim, int frame) {
+    arc_state* st = (arc_state*)mem_sim->policy_state;
+    frame_list_unlink(st->in_t2[frame] ? &st->t2 : &st->t1, frame);
+    st->in_t2[frame] = 1;
+    frame_list_push_front(&st->t2, frame);
+}
+
+static void arc_serialize(sim_database* mem_sim, ckpt_io* io) {
+    arc_state* st = (arc_state*)mem_sim->policy_state;
+    int c = st->capacity;
+    int nodes = 2 * c;
+    frame_list_serialize(io, &st->t1, c);
+    frame_list_serialize(io, &st->t2, c);
+    frame_list_serialize(io, &st->b1, nodes);
+    frame_list_serialize(io, &st->b2, nodes);
+    ckpt_bytes(io, st->in_t2, c);
+    ckpt_bytes(io, st->ghost_page, nodes * sizeof(int64_t));
+    ckpt_bytes(io, st->ghost_asid, nodes * sizeof(int));
+    ckpt_bytes(io, st->ghost_list, nodes);
+    ckpt_bytes(io, st->ghost_chain, nodes * sizeof(int));
+    ckpt_bytes(io, st->ghost_hash, (st->hash_mask + 1) * sizeof(int));
+    ckpt_bytes(io, st->free_nodes, nodes * sizeof(int));
+    ckpt_bytes(io, &st->free_count, sizeof(st->free_count));
+    ckpt_bytes(io, &st->target_t1, sizeof(st->target_t1));
+    ckpt_bytes(io, &st->ghost_hit, sizeof(st->ghost_hit));
+    ckpt_bytes(io, &st->drop_t1, sizeof(st->drop_t1));
+}
+
+/* ---- Random: seeded xorshift64* ---- */
+
+static int random_init(sim_database* mem_sim) {
+    uint64_t* rng = (uint64_t*)malloc(sizeof(uint64_t));
+    if (!rng) return -1;
+    *rng = mem_sim->policy_seed ? mem_sim->policy_seed : 1;
+    mem_sim->policy_state = rng;
+    return 0;
+}
+
+static void random_destroy(sim_database* mem_sim) {
+    free(mem_sim->policy_state);
+    mem_sim->policy_state = NULL;
+}
+
+static void random_touch(sim_database* mem_sim, int frame) {
+    (void)mem_sim;
+    (void)frame;
+}
+
+static void random_serialize(sim_database* mem_sim, ckpt_io* io) {
+    ckpt_bytes(io, mem_sim->policy_state, sizeof(uint64_t));
+}
+
+// Victims are only requested when no frame is free, but frames taken for a
+// read-ahead window hold no page yet, so draw again if one comes up
+static int random_victim(sim_database* mem_sim) {
+    uint64_t* rng = (uint64_t*)mem_sim->policy_state;
+    int frame;
+    do {
+        *rng ^= *rng >> 12;
+        *rng ^= *rng << 25;
+        *rng ^= *rng >> 27;
+        frame = (int)((*rng * 2685821657736338717ULL) % (uint64_t)mem_sim->num_frames);
+    } while (mem_sim->frame_owner[frame] == -1);
+    return frame;
+}
+
+static const replacement_policy replacement_policies[] = {
+    {"lru", queue_policy_init, queue_policy_destroy, NULL,
+     queue_policy_insert, lru_access, queue_policy_victim, queue_policy_serialize},
+    {"fifo", queue_policy_init, queue_policy_destroy, NULL,
+     queue_policy_insert, fifo_access, queue_policy_victim, queue_policy_serialize},
+    {"clock", clock_init, clock_destroy, NULL,
+     clock_insert, clock_access, clock_victim, clock_serialize},
+    {"second-chance", clock_init, clock_destroy, NULL,
+     second_chance_insert, clock_access, second_chance_victim, clock_serialize},
+    {"lfu", lfu_init, lfu_destroy, NULL,
+     lfu_insert, lfu_access, lfu_victim, lfu_serialize},
+    {"arc", arc_init, arc_destroy, arc_fault,
+     arc_insert, arc_access, arc_victim, arc_serialize},
+    {"random", random_init, random_destroy, NULL,
+     random_touch, random_touch, random_victim, random_serialize},
+};
+
+// Look up a replacement policy by name, NULL if unknown
+const replacement_policy* find_policy(const char* name) {
+    for (size_t i = 0; i < sizeof(replacement_policies) / sizeof(replacement_policies[0]); i++) {
+        if (strcmp(replacement_policies[i].name, name) == 0) {
+            return &replacement_policies[i];
+        }
+    }
+    return NULL;
+}
+
+// Helper function to find a free frame
+int find_free_frame(sim_database* mem_sim) {
+    // Pop the free-frame stack - O(1) instead of scanning the page table
+    if (mem_sim->free_frame_count == 0) {
+        return -1;  // No free frame found
+    }
+    return mem_sim->free_frames[--mem_sim->free_frame_count];
+}
+/**
+ * init_tlb_level - Allocates one TLB level of 'entries' entries split into
+ * sets of 'ways' entries each. A size of 0 leaves the level disabled.
+ */
+int init_tlb_level(sim_database* mem_sim, tlb_level* level, int entries, int ways) {
+    level->entries = NULL;
+    level->sets = 0;
+    level->ways = 0;
+    if (entries == 0) return 0;
+    
+    if (ways > entries) ways = entries;
+    if (entries % ways != 0) {
+        vmem_error(mem_sim, "Error: TLB size %d is not a multiple of %d ways", entries, ways);
+        return -1;
+    }
+    level->entries = (tlb_entry*)calloc(entries, sizeof(tlb_entry));
+    if (!level->entries) {
+        vmem_error(mem_sim, "Error allocating TLB: %s", strerror(errno));
+        return -1;
+    }
+    level->sets = entries / ways;
+    level->ways = ways;
+    return 0;
+}
+
+// Set holding a translation; other address spaces are spread over other sets
+static tlb_entry* tlb_set(tlb_level* level, int asid, int64_t page_num) {
+    unsigned index = (unsigned)page_num + (unsigned)(page_num >> 32) * 0x85EBCA6Bu +
+                     (unsigned)asid * 0x9E3779B1u;
+    return &level->entries[(index % level->sets) * level->ways];
+}
+
+// Look a page up in its set; refreshes the entry's LRU timestamp on a hit
+int tlb_level_lookup(uint64_t* clock, tlb_level* level, int asid, int64_t page_num) {
+    tlb_entry* set = tlb_set(level, asid, page_num);
+    for (int way = 0; way < level->ways; way++) {
+        if (set[way].valid && set[way].page_number == page_num && set[way].asid == asid) {
+            set[way].timestamp = (*clock)++;
+            return set[way].frame_number;
+        }
+    }
+    return -1;
+}
+
+// Fill a page's set: reuse its entry, else a free way, else the set's LRU way
+void tlb_level_insert(uint64_t* clock, tlb_level* level, int asid,
+                      int64_t page_num, int frame_num) {
+    tlb_entry* set = tlb_set(level, asid, page_num);
+    int target = -1;
+    
+    for (int way = 0; way < level->ways; way++) {
+        if (set[way].valid && set[way].page_number == page_num && set[way].asid == asid) {
+            target = way;
+            break;
+        }
+        if (target == -1 && !set[way].valid) {
+            target = way;
+        }
+    }
+    if (target == -1) {
+        target = 0;
+        for (int way = 1; way < level->ways; way++) {
+            if (set[way].timestamp < set[target].timestamp) {
+                target = way;
+            }
+        }
+    }
+    
+    set[target].valid = 1;
+    set[target].asid = asid;
+    set[target].page_number = page_num;
+    set[target].frame_number = frame_num;
+    set[target].timestamp = (*clock)++;
+}
+
+// Drop a page from one level; returns 1 if it was cached there
+int tlb_level_invalidate(tlb_level* level, int asid, int64_t page_num) {
+    tlb_entry* set = tlb_set(level, asid, page_num);
+    for (int way = 0; way < level->ways; way++) {
+        if (set[way].valid && set[way].page_number == page_num && set[way].asid == asid) {
+            set[way].valid = 0;
+            set[way].page_number = -1;
+            set[way].frame_number = -1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Check if a page of the current process is in the TLB
+// (L1, then L2 which refills L1 on a hit)
+int check_tlb(sim_database* mem_sim, int64_t page_num) {
+    if (!mem_sim->tlb.entries) return -1;
+    int asid = mem_sim->proc->asid;
+    
+    int frame = tlb_level_lookup(&mem_sim->access_clock, &mem_sim->tlb, asid, page_num);
+    mem_sim->time.tlb += mem_sim->costs.tlb;
+    if (frame != -1) {
+        mem_sim->stats.tlb_hits++;
+        return frame;
+    }
+    mem_sim->stats.tlb_misses++;
+    
+    if (!mem_sim->tlb2.entries) return -1;
+    mem_sim->time.tlb += mem_sim->costs.tlb2;
+    frame = tlb_level_lookup(&mem_sim->access_clock, &mem_sim->tlb2, asid, page_num);
+    if (frame != -1) {
+        mem_sim->stats.tlb2_hits++;
+        tlb_level_insert(&mem_sim->access_clock, &mem_sim->tlb, asid, page_num, frame);
+        return frame;
+    }
+    mem_sim->stats.tlb2_misses++;
+    return -1;  // TLB miss
+}
+
+// Add entry for the current process to TLB (both levels are filled, L2 is inclusive)
+void add_to_tlb(sim_database* mem_sim, int64_t page_num, int frame_num) {
+    if (!mem_sim->tlb.entries) return;
+    int asid = mem_sim->proc->asid;
+    
+    tlb_level_insert(&mem_sim->access_clock, &mem_sim->tlb, asid, page_num, frame_num);
+    if (mem_sim->tlb2.entries) {
+        tlb_level_insert(&mem_sim->access_clock, &mem_sim->tlb2, asid, page_num, frame_num);
+    }
+    vmem_log(mem_sim, "TLB Updated: Page %lld -> Frame %d\n", (long long)page_num, frame_num);
+}
+
+// Remove page from TLB when it's evicted from memory (TLB shootdown).
+// The page may belong to any process, not just the current one.
+void remove_from_tlb(sim_database* mem_sim, int asid, int64_t page_num) {
+    if (!mem_sim->tlb.entries) return;
+    
+    int removed = tlb_level_invalidate(&mem_sim->tlb, asid, page_num);
+    if (mem_sim->tlb2.entries) {
+        removed |= tlb_level_invalidate(&mem_sim->tlb2, asid, page_num);
+    }
+    if (removed) {
+        mem_sim->stats.tlb_shootdowns++;
+    }
+}
+
+/**
+ * parse_init_options - Applies optional "key=value" settings from the init line
+ * Supported keys: policy=<name>, seed=<n>, swapfit=first|next, io=mmap|syscall,
+ *                 tlb=<entries>, tlb_ways=<n>, tlb2=<entries>, tlb2_ways=<n>,
+ *                 writeback=sync|batch|async, wb_low=<pages>, wb_high=<pages>,
+ *                 readahead=on|off, ra_max=<pages>, pagetable=flat|radix|inverted,
+ *                 zswap=<bytes>, snapshot=<accesses>, snapshot_format=csv|jsonl,
+ *                 snapshot_out=<path>, ws_window=<accesses>,
+ *                 cost_tlb, cost_tlb2, cost_mem, cost_walk, cost_disk_read,
+ *                 cost_disk_write, cost_zswap=<ns>
+ */
+int parse_init_options(sim_database* mem_sim, const char* options) {
+    char key[64], value[64];
+    int consumed = 0;
+    
+    while (sscanf(options, " %63[^= ]=%63s%n", key, value, &consumed) == 2) {
+        options += consumed;
+        if (strcmp(key, "policy") == 0) {
+            mem_sim->policy = find_policy(value);
+            if (!mem_sim->policy) {
+                vmem_error(mem_sim, "Error: Unknown policy '%s' "
+                            "(use lru, fifo, clock, second-chance, lfu, arc or random)", value);
+                return -1;
+            }
+        } else if (strcmp(key, "tlb") == 0 || strcmp(key, "tlb_ways") == 0 ||
+                   strcmp(key, "tlb2") == 0 || strcmp(key, "tlb2_ways") == 0) {
+            char* end;
+            long n = strtol(value, &end, 10);
+            if (*end != '\0' || n < 0 || n > INT_MAX || (n == 0 && strstr(key, "ways"))) {
+                vmem_error(mem_sim, "Error: Invalid %s '%s'", key, value);
+                return -1;
+            }
+            if (strcmp(key, "tlb") == 0) mem_sim->tlb_size = (int)n;
+            else if (strcmp(key, "tlb_ways") == 0) mem_sim->tlb_ways = (int)n;
+            else if (strcmp(key, "tlb2") == 0) mem_sim->tlb2_size = (int)n;
+            else mem_sim->tlb2_ways = (int)n;
+        } else if (strcmp(key, "io") == 0) {
+            if (strcmp(value, "mmap") == 0) {
+                mem_sim->io_mode = VMEM_IO_MMAP;
+            } else if (strcmp(value, "syscall") == 0) {
+                mem_sim->io_mode = VMEM_IO_SYSCALL;
+            } else {
+                vmem_error(mem_sim, "Error: Unknown io '%s' (use mmap or syscall)", value);
+                return -1;
+            }
+        } else if (strcmp(key, "writeback") == 0) {
+            if (strcmp(value, "sync") == 0) {
+                mem_sim->wb_mode = WRITEBACK_SYNC;
+            } else if (strcmp(value, "batch") == 0) {
+                mem_sim->wb_mode = WRITEBACK_BATCH;
+            } else if (strcmp(value, "async") == 0) {
+                mem_sim->wb_mode = WRITEBACK_ASYNC;
+            } else {
+                vmem_error(mem_sim, "Error: Unknown writeback '%s' (use sync, batch or async)", value);
+                return -1;
+            }
+        } else if (strcmp(key, "wb_low") == 0 || strcmp(key, "wb_high") == 0) {
+            int n = atoi(value);
+            if (n <= 0) {
+                vmem_error(mem_sim, "Error: Invalid %s '%s'", key, value);
+                return -1;
+            }
+            if (strcmp(key, "wb_low") == 0) mem_sim->wb_low = n;
+            else mem_sim->wb_high = n;
+        } else if (strcmp(key, "readahead") == 0) {
+            if (strcmp(value, "on") == 0) {
+                mem_sim->readahead = 1;
+            } else if (strcmp(value, "off") == 0) {
+                mem_sim->readahead = 0;
+            } else {
+                vmem_error(mem_sim, "Error: Unknown readahead '%s' (use on or off)", value);
+                return -1;
+            }
+        } else if (strcmp(key, "pagetable") == 0) {
+            if (strcmp(value, "flat") == 0) {
+                mem_sim->pt_type = PT_FLAT;
+            } else if (strcmp(value, "radix") == 0) {
+                mem_sim->pt_type = PT_RADIX;
+            } else if (strcmp(value, "inverted") == 0) {
+                mem_sim->pt_type = PT_INVERTED;
+            } else {
+                vmem_error(mem_sim, "Error: Unknown pagetable '%s' (use flat, radix or inverted)", value);
+                return -1;
+            }
+        } else if (strcmp(key, "ra_max") == 0) {
+            int n = atoi(value);
+            if (n <= 0 || n > IOV_MAX) {
+                vmem_error(mem_sim, "Error: Invalid ra_max '%s' (1 to %d pages)", value, IOV_MAX);
+                return -1;
+            }
+            mem_sim->ra_max = n;
+        } else if (strcmp(key, "zswap") == 0) {
+            char* end;
+            long n = strtol(value, &end, 10);
+            if (*end != '\0' || n < 0) {
+                vmem_error(mem_sim, "Error: Invalid zswap '%s' (tier size in bytes, 0 for off)", value);
+                return -1;
+            }
+            mem_sim->zswap_size = n;
+        } else if (strcmp(key, "snapshot") == 0 || strcmp(key, "ws_window") == 0) {
+            char* end;
+            long n = strtol(value, &end, 10);
+            if (*end != '\0' || n < 0 || n > INT_MAX) {
+                vmem_error(mem_sim, "Error: Invalid %s '%s' (accesses, 0 for off)", key, value);
+                return -1;
+            }
+            if (strcmp(key, "snapshot") == 0) mem_sim->snapshot_every = n;
+            else mem_sim->ws_window = (int)n;
+        } else if (strcmp(key, "snapshot_format") == 0) {
+            if (strcmp(value, "csv") == 0) {
+                mem_sim->snapshot_jsonl = 0;
+            } else if (strcmp(value, "jsonl") == 0) {
+                mem_sim->snapshot_jsonl = 1;
+            } else {
+                vmem_error(mem_sim, "Error: Unknown snapshot_format '%s' (use csv or jsonl)", value);
+                return -1;
+            }
+        } else if (strcmp(key, "snapshot_out") == 0) {
+            snprintf(mem_sim->snapshot_path, sizeof(mem_sim->snapshot_path), "%s", value);
+        } else if (strncmp(key, "cost_", 5) == 0) {
+            static const char* cost_keys[] = {"tlb", "tlb2", "mem", "walk", "disk_read",
+                                              "disk_write", "zswap"};
+            double* cost_fields[] = {&mem_sim->costs.tlb, &mem_sim->costs.tlb2,
+                                     &mem_sim->costs.mem, &mem_sim->costs.walk,
+                                     &mem_sim->costs.disk_read, &mem_sim->costs.disk_write,
+                                     &mem_sim->costs.zswap};
+            char* end;
+            double ns = strtod(value, &end);
+            int field = -1;
+            for (int i = 0; i < (int)(sizeof(cost_keys) / sizeof(cost_keys[0])); i++) {
+                if (strcmp(key + 5, cost_keys[i]) == 0) field = i;
+            }
+            if (field == -1) {
+                vmem_error(mem_sim, "Error: Unknown init option '%s'", key);
+                return -1;
+            }
+            if (end == value || *end != '\0' || !(ns >= 0)) {
+                vmem_error(mem_sim, "Error: Invalid %s '%s' (latency in ns)", key, value);
+                return -1;
+            }
+            *cost_fields[field] = ns;
+        } else if (strcmp(key, "seed") == 0) {
+            char* end;
+            errno = 0;
+            unsigned long long seed = strtoull(value, &end, 10);
+            if (*end != '\0' || errno == ERANGE || value[0] == '-') {
+                vmem_error(mem_sim, "Error: Invalid seed '%s'", value);
+                return -1;
+            }
+            mem_sim->policy_seed = seed;
+        } else if (strcmp(key, "swapfit") == 0) {
+            if (strcmp(value, "first") == 0) {
+                mem_sim->swap_fit = SWAP_FIRST_FIT;
+            } else if (strcmp(value, "next") == 0) {
+                mem_sim->swap_fit = SWAP_NEXT_FIT;
+            } else {
+                vmem_error(mem_sim, "Error: Unknown swapfit '%s' (use first or next)", value);
+                return -1;
+            }
+        } else {
+            vmem_error(mem_sim, "Error: Unknown init option '%s'", key);
+            return -1;
+        }
+    }
+    
+    // Anything left that is not a key=value pair is a format error
+    while (isspace((unsigned char)*options)) options++;
+    if (*options) {
+        vmem_error(mem_sim, "Error: Invalid init option '%s'", options);
+        return -1;
+    }
+    return 0;
+}
+
+// Find the first free swap slot at or after 'from', or -1
+static int scan_swap_bitmap(sim_database* mem_sim, int from) {
+    for (int word = from / 64; word * 64 < mem_sim->num_swap_slots; word++) {
+        uint64_t free_bits = ~mem_sim->swap_bitmap[word];
+        if (word == from / 64) {
+            free_bits &= ~0ULL << (from % 64);  // Ignore slots before 'from'
+        }
+        if (free_bits) {
+            int slot = word * 64 + __builtin_ctzll(free_bits);
+            return (slot < mem_sim->num_swap_slots) ? slot : -1;
+        }
+    }
+    return -1;
+}
+
+// Helper function to find and claim a free swap slot (first-fit or next-fit)
+int find_free_swap_slot(sim_database* mem_sim) {
+    int slot;
+    if (mem_sim->swap_fit == SWAP_NEXT_FIT) {
+        slot = scan_swap_bitmap(mem_sim, mem_sim->swap_cursor);
+        if (slot == -1) {
+            slot = scan_swap_bitmap(mem_sim, 0);  // Wrap around
+        }
+    } else {
+        slot = scan_swap_bitmap(mem_sim, mem_sim->swap_hint);
+    }
+    if (slot == -1) {
+        return -1;  // No free slot found
+    }
+    
+    mem_sim->swap_bitmap[slot / 64] |= 1ULL << (slot % 64);
+    mem_sim->swap_slots_used++;
+    mem_sim->swap_hint = slot + 1;
+    mem_sim->swap_cursor = slot + 1;
+    if (mem_sim->swap_cursor >= mem_sim->num_swap_slots) {
+        mem_sim->swap_cursor = 0;
+    }
+    return slot;
+}
+
+// Return a swap slot to the allocator once its page is back in memory
+void release_swap_slot(sim_database* mem_sim, int slot) {
+    if (slot < 0 || slot >= mem_sim->num_swap_slots) return;
+    if (!(mem_sim->swap_bitmap[slot / 64] & (1ULL << (slot % 64)))) return;
+    
+    mem_sim->swap_bitmap[slot / 64] &= ~(1ULL << (slot % 64));
+    mem_sim->swap_slots_used--;
+    if (slot < mem_sim->swap_hint) {
+        mem_sim->swap_hint = slot;
+    }
+}
+
+// Count free holes lying between used swap slots
+int swap_fragments(sim_database* mem_sim) {
+    int holes = 0;
+    int seen_used = 0;
+    int in_hole = 0;
+    
+    for (int slot = 0; slot < mem_sim->num_swap_slots; slot++) {
+        if (mem_sim->swap_bitmap[slot / 64] & (1ULL << (slot % 64))) {
+            if (in_hole) holes++;
+            seen_used = 1;
+            in_hole = 0;
+        } else if (seen_used) {
+            in_hole = 1;
+        }
+    }
+    return holes;
+}
+
+/**
+ * vmem_access_time - Effective access time (EAT) in ns per access
+ * Fills 'time' (if not NULL) with the modeled time of the run so far, as
+ * the access path charged it. Disk reads are program-file and swap faults
+ * that missed the compressed tier and the writeback queue, plus read-ahead
+ * reads. Writes are charged per write call; with async writeback the
+ * flusher overlaps them with the accesses, so they count as background.
+ */
+double vmem_access_time(vmem_handle* mem_sim, vmem_time* time) {
+    vmem_stats snapshot;
+    vmem_time t;
+    
+    // The flusher charges its writes under the queue lock
+    writeback_pending(mem_sim, &snapshot, &t);
+    t.total = t.tlb + t.walk + t.mem + t.disk_read + t.disk_write + t.zswap;
+    
+    if (time) *time = t;
+    return snapshot.accesses ? t.total / snapshot.accesses : 0.0;
+}
+
+/**
+ * print_stats - Prints the simulator counters
+ * Shows accesses, faults by source, TLB and swap activity
+ */
+void print_stats(sim_database* mem_sim) {
+    // Read-only: queued writebacks are reported, not flushed
+    vmem_stats snapshot;
+    int pending = writeback_pending(mem_sim, &snapshot, NULL);
+    const vmem_stats* st = &snapshot;
+    printf("=== VMEM STATISTICS ===\n");
+    printf("Policy: %s\n", mem_sim->policy->name);
+    printf("Accesses: %ld\n", st->accesses);
+    printf("Page faults: %ld (program file: %ld, swap: %ld, new allocation: %ld)\n",
+           st->faults, st->faults_program,
+           st->faults_swap, st->faults_new);
+    printf("Evictions: %ld, Writebacks: %ld\n",
+           st->evictions, st->writebacks);
+    const long* sf = st->seg_faults;
+    const long* se = st->seg_evictions;
+    printf("Faults by segment: TEXT %ld, DATA %ld, BSS %ld, H/S %ld; "
+           "evictions: TEXT %ld, DATA %ld, BSS %ld, H/S %ld\n",
+           sf[PTE_SEG_TEXT], sf[PTE_SEG_DATA], sf[PTE_SEG_BSS], sf[PTE_SEG_HEAP_STACK],
+           se[PTE_SEG_TEXT], se[PTE_SEG_DATA], se[PTE_SEG_BSS], se[PTE_SEG_HEAP_STACK]);
+    if (mem_sim->ws) {
+        long peak;
+        long size = ws_size(mem_sim, &peak);
+        printf("Working set (last %d accesses): %ld pages, peak %ld\n",
+               mem_sim->ws_window, size, peak);
+    }
+    if (mem_sim->tlb.entries) {
+        long lookups = st->tlb_hits + st->tlb_misses;
+        printf("TLB hits: %ld, TLB misses: %ld (hit rate %.2f%%), Shootdowns: %ld\n",
+               st->tlb_hits, st->tlb_misses,
+               lookups ? 100.0 * st->tlb_hits / lookups : 0.0,
+               st->tlb_shootdowns);
+        if (mem_sim->tlb2.entries) {
+            printf("L2 TLB hits: %ld, L2 TLB misses: %ld\n",
+                   st->tlb2_hits, st->tlb2_misses);
+        }
+    }
+    printf("Swap outs: %ld, Swap ins: %ld\n",
+           st->swap_outs, st->swap_ins);
+    printf("Writeback (%s): %ld pages in %ld writes (%.2f pages/write), "
+           "%ld absorbed, %ld stalls (%.3f ms), %d queued\n",
+           mem_sim->wb_mode == WRITEBACK_ASYNC ? "async" :
+           mem_sim->wb_mode == WRITEBACK_BATCH ? "batch" : "sync",
+           st->wb_pages, st->wb_writes,
+           st->wb_writes ? (double)st->wb_pages / st->wb_writes : 0.0,
+           st->wb_absorbed, st->wb_stalls,
+           st->wb_stall_ns / 1e6, pending);
+    if (st->wb_errors) {
+        printf("Writeback errors: %ld writes failed, their pages stay queued\n", st->wb_errors);
+    }
+    if (mem_sim->readahead) {
+        printf("Read-ahead (max %d pages): %ld pages in %ld reads over %ld windows, "
+               "%ld useful, %ld wasted\n",
+               mem_sim->ra_max, st->ra_pages, st->ra_reads,
+               st->ra_windows, st->ra_useful, st->ra_wasted);
+    } else {
+        printf("Read-ahead: off\n");
+    }
+    if (mem_sim->zswap) {
+        printf("Compressed swap (%ld bytes, %ld used): %ld pages stored (ratio %.2f:1), "
+               "%ld rejected, %ld spilled to disk\n",
+               mem_sim->zswap_size, zswap_used(mem_sim), st->zswap_stores,
+               st->zswap_bytes_out ? (double)st->zswap_bytes_in / st->zswap_bytes_out : 0.0,
+               st->zswap_rejects, st->zswap_spills);
+        printf("Compressed swap hits: %ld/%ld swap faults (%.2f%%), "
+               "disk I/O avoided: %ld reads, %ld writes\n",
+               st->faults_zswap, st->faults_swap,
+               st->faults_swap ? 100.0 * st->faults_zswap / st->faults_swap : 0.0,
+               st->zswap_hits, st->zswap_stores - st->zswap_spills);
+    } else {
+        printf("Compressed swap: off\n");
+    }
+    printf("Page tables (%s): %ld bytes\n",
+           mem_sim->pt_type == PT_RADIX ? "radix" :
+           mem_sim->pt_type == PT_INVERTED ? "inverted" : "flat", st->pt_bytes);
+    vmem_time t;
+    double eat = vmem_access_time(mem_sim, &t);
+    printf("Modeled access time: %.1f ns, simulated time: %.3f ms\n", eat, t.total / 1e6);
+    printf("Modeled time by category: TLB %.3f ms, walks %.3f ms, memory %.3f ms, "
+           "disk reads %.3f ms, disk writes %.3f ms, zswap %.3f ms",
+           t.tlb / 1e6, t.walk / 1e6, t.mem / 1e6, t.disk_read / 1e6,
+           t.disk_write / 1e6, t.zswap / 1e6);
+    if (mem_sim->wb_mode == WRITEBACK_ASYNC) {
+        printf(" (+%.3f ms async writeback, overlapped)", t.background / 1e6);
+    }
+    printf("\n");
+    printf("Swap slots: %d/%d used (%s), Fragments: %d\n",
+           mem_sim->swap_slots_used, mem_sim->num_swap_slots,
+           mem_sim->swap_fit == SWAP_NEXT_FIT ? "next-fit" : "first-fit",
+           swap_fragments(mem_sim));
+    
+    // Per-process breakdown once several address spaces compete for frames
+    if (mem_sim->num_procs > 1) {
+        int* resident = (int*)calloc(mem_sim->num_procs, sizeof(int));
+        if (resident) {
+            for (int frame = 0; frame < mem_sim->num_frames; frame++) {
+                if (mem_sim->frame_asid[frame] >= 0) resident[mem_sim->frame_asid[frame]]++;
+            }
+        }
+        printf("ASID | Pages | Resident | Accesses | Faults | Fault rate | Evicted | Stolen | Program\n");
+        printf("-----|-------|----------|----------|--------|------------|---------|--------|--------\n");
+        for (int asid = 0; asid < mem_sim->num_procs; asid++) {
+            vmem_process* proc = mem_sim->procs[asid];
+            printf("%4d | %5lld | %8d | %8ld | %6ld | %9.2f%% | %7ld | %6ld | %s%s\n",
+                   asid, (long long)proc->num_pages, resident ? resident[asid] : 0,
+                   proc->accesses, proc->faults,
+                   proc->accesses ? 100.0 * proc->faults / proc->accesses : 0.0,
+                   proc->evictions, proc->stolen, proc->program_name,
+                   proc == mem_sim->proc ? " (current)" : "");
+        }
+        printf(" all |       | %8d | %8ld | %6ld | %9.2f%% | %7ld |        |\n",
+               mem_sim->num_frames - mem_sim->free_frame_count,
+               st->accesses, st->faults,
+               st->accesses ? 100.0 * st->faults / st->accesses : 0.0,
+               st->evictions);
+        free(resident);
+    }
+    printf("=======================\n\n");
+}
+
+/* ---- Dirty page writeback queue ---- */
+
+#define WB_FREE      0
+#define WB_QUEUED    1
+#define WB_IN_FLIGHT 2
+
+// A queued page and the swap slot it is headed for
+typedef struct {
+    int slot;
+    int entry;
+    int written;                  // Its run reached the swap file
+} wb_write;
+
+/**
+ * writeback_queue - Dirty victims waiting to be written to swap
+ * Evicted pages are copied into one of wb_high entries so their frame can
+ * be reused at once. Flushes sort the queued pages by swap slot and write
+ * each run of adjacent slots with one pwritev(). Pages whose write fails
+ * stay queued and are retried once the queue fills up or is drained. The
+ * lock guards everything below it; the flusher thread only exists in
+ * async mode.
+ */
+typedef struct writeback_queue {
+    char* data;                   // Entry -> page copy
+    int* slot;                    // Entry -> destination swap slot
+    unsigned char* state;         // Entry -> WB_FREE / WB_QUEUED / WB_IN_FLIGHT
+    int* free_entries;
+    int free_count;
+    int* queue;                   // Queued entries, unordered
+    int* queue_pos;               // Entry -> index in queue
+    int queued;
+    int in_flight;
+    int failed;                   // The last flush left pages queued; wait for new work
+    int* pending;                 // Swap slot -> entry, -1 if nothing queued
+    wb_write* batch;              // Scratch for one flush (one flusher at a time)
+    struct iovec* iov;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;          // Flusher: low watermark reached, drain or stop
+    pthread_cond_t done;          // Entries were written
+    pthread_t flusher;
+    int ready;                    // Lock and conditions are initialized
+    int running;
+    int drain;
+    int stop;
+} writeback_queue;
+
+static int compare_wb_write(const void* a, const void* b) {
+    return ((const wb_write*)a)->slot - ((const wb_write*)b)->slot;
+}
+
+/**
+ * writeback_flush - Writes every queued page, coalescing adjacent slots
+ * Called with the lock held; drops it while writing, so faults can keep
+ * queueing and reclaiming other pages in the meantime. A run that fails
+ * to write goes back on the queue, keeping its slot mapping, and sets
+ * 'failed'. In async mode the error is reported from the flusher thread.
+ */
+static void writeback_flush(sim_database* mem_sim, writeback_queue* wb) {
+    int n = wb->queued;
+    if (n == 0) return;
+
+    for (int i = 0; i < n; i++) {
+        int entry = wb->queue[i];
+        wb->state[entry] = WB_IN_FLIGHT;
+        wb->batch[i].slot = wb->slot[entry];
+        wb->batch[i].entry = entry;
+        wb->batch[i].written = 1;
+    }
+    wb->queued = 0;
+    wb->in_flight += n;
+    pthread_mutex_unlock(&wb->lock);
+
+    qsort(wb->batch, n, sizeof(wb_write), compare_wb_write);
+    long writes = 0, errors = 0;
+    for (int start = 0; start < n; ) {
+        int end = start + 1;
+        while (end < n && end - start < IOV_MAX &&
+               wb->batch[end].slot == wb->batch[end - 1].slot + 1) {
+            end++;
+        }
+
+        off_t offset = (off_t)wb->batch[start].slot * mem_sim->page_size;
+        if (mem_sim->swap_map) {
+            for (int i = start; i < end; i++) {
+                memcpy(mem_sim->swap_map + offset + (off_t)(i - start) * mem_sim->page_size,
+                       wb->data + (size_t)wb->batch[i].entry * mem_sim->page_size,
+                       mem_sim->page_size);
+            }
+        } else {
+            for (int i = start; i < end; i++) {
+                wb->iov[i - start].iov_base = wb->data + (size_t)wb->batch[i].entry * mem_sim->page_size;
+                wb->iov[i - start].iov_len = mem_sim->page_size;
+            }
+            if (pwritev(mem_sim->swapfile_fd, wb->iov, end - start, offset) !=
+                (ssize_t)(end - start) * mem_sim->page_size) {
+                vmem_error(mem_sim, "Error writing to swap file: %s (%d pages stay queued)",
+                           strerror(errno), end - start);
+                for (int i = start; i < end; i++) wb->batch[i].written = 0;
+                errors++;
+                start = end;
+                continue;
+            }
+        }
+        writes++;
+        start = end;
+    }
+
+    pthread_mutex_lock(&wb->lock);
+    long pages = 0;
+    for (int i = 0; i < n; i++) {
+        int entry = wb->batch[i].entry;
+        if (!wb->batch[i].written) {
+            wb->state[entry] = WB_QUEUED;
+            wb->queue_pos[entry] = wb->queued;
+            wb->queue[wb->queued++] = entry;
+            continue;
+        }
+        wb->pending[wb->batch[i].slot] = -1;
+        wb->state[entry] = WB_FREE;
+        wb->free_entries[wb->free_count++] = entry;
+        pages++;
+    }
+    wb->in_flight -= n;
+    wb->failed = errors > 0;
+    mem_sim->stats.wb_writes += writes;
+    mem_sim->stats.wb_pages += pages;
+    mem_sim->stats.wb_errors += errors;
+    if (mem_sim->wb_mode == WRITEBACK_ASYNC) {
+        mem_sim->time.background += writes * mem_sim->costs.disk_write;
+    } else {
+        mem_sim->time.disk_write += writes * mem_sim->costs.disk_write;
+    }
+    pthread_cond_broadcast(&wb->done);
+}
+
+// Background flusher: writes the queue whenever it reaches the low watermark
+static void* writeback_thread(void* arg) {
+    sim_database* mem_sim = (sim_database*)arg;
+    writeback_queue* wb = mem_sim->wb;
+
+    pthread_mutex_lock(&wb->lock);
+    while (!wb->stop) {
+        if (wb->queued > 0 && !wb->failed && (wb->queued >= mem_sim->wb_low || wb->drain)) {
+            writeback_flush(mem_sim, wb);
+            continue;
+        }
+        if (wb->drain && wb->in_flight == 0) {
+            wb->drain = 0;
+            pthread_cond_broadcast(&wb->done);
+        }
+        pthread_cond_wait(&wb->work, &wb->lock);
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return NULL;
+}
+
+int writeback_init(sim_database* mem_sim) {
+    if (mem_sim->wb_mode == WRITEBACK_ASYNC && mem_sim->wb_low > mem_sim->wb_high) {
+        vmem_error(mem_sim, "Error: wb_low (%d) is above wb_high (%d)",
+                    mem_sim->wb_low, mem_sim->wb_high);
+        return -1;
+    }
+
+    int n = mem_sim->wb_high;
+    writeback_queue* wb = (writeback_queue*)calloc(1, sizeof(writeback_queue));
+    if (!wb) {
+        vmem_error(mem_sim, "Error allocating writeback queue: %s", strerror(errno));
+        return -1;
+    }
+    mem_sim->wb = wb;
+
+    wb->data = (char*)malloc((size_t)n * mem_sim->page_size);
+    wb->slot = (int*)malloc(n * sizeof(int));
+    wb->state = (unsigned char*)calloc(n, 1);
+    wb->free_entries = (int*)malloc(n * sizeof(int));
+    wb->queue = (int*)malloc(n * sizeof(int));
+    wb->queue_pos = (int*)malloc(n * sizeof(int));
+    wb->pending = (int*)malloc((mem_sim->num_swap_slots + 1) * sizeof(int));
+    wb->batch = (wb_write*)malloc(n * sizeof(wb_write));
+    wb->iov = (struct iovec*)malloc((n < IOV_MAX ? n : IOV_MAX) * sizeof(struct iovec));
+    if (!wb->data || !wb->slot || !wb->state || !wb->free_entries || !wb->queue ||
+        !wb->queue_pos || !wb->pending || !wb->batch || !wb->iov) {
+        vmem_error(mem_sim, "Error allocating writeback queue: %s", strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < n; i++) wb->free_entries[i] = n - 1 - i;
+    wb->free_count = n;
+    for (int slot = 0; slot <= mem_sim->num_swap_slots; slot++) wb->pending[slot] = -1;
+
+    pthread_mutex_init(&wb->lock, NULL);
+    pthread_cond_init(&wb->work, NULL);
+    pthread_cond_init(&wb->done, NULL);
+    wb->ready = 1;
+    if (mem_sim->wb_mode == WRITEBACK_ASYNC) {
+        if (pthread_create(&wb->flusher, NULL, writeback_thread, mem_sim) != 0) {
+            vmem_error(mem_sim, "Error: Cannot start writeback thread, using batch writeback");
+            mem_sim->wb_mode = WRITEBACK_BATCH;
+        } else {
+            wb->running = 1;
+        }
+    }
+    return 0;
+}
+
+// Time spent blocked in the fault path, under the queue lock
+static void writeback_stall_end(sim_database* mem_sim, struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    mem_sim->stats.wb_stalls++;
+    mem_sim->stats.wb_stall_ns += (end.tv_sec - start->tv_sec) * 1000000000L +
+                                  (end.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * writeback_enqueue - Queues a dirty page for 'slot' instead of writing it now
+ * The fault only blocks when every entry is taken: batch mode then flushes
+ * in place, async mode waits for the flusher. Returns -1 if that flush
+ * failed and freed no entry, so the page has to keep its frame.
+ */
+int writeback_enqueue(sim_database* mem_sim, int slot, const char* page) {
+    writeback_queue* wb = mem_sim->wb;
+    pthread_mutex_lock(&wb->lock);
+
+    if (wb->free_count == 0) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        wb->failed = 0;
+        while (wb->free_count == 0 && !(wb->failed && wb->in_flight == 0)) {
+            if (wb->running) {
+                pthread_cond_signal(&wb->work);
+                pthread_cond_wait(&wb->done, &wb->lock);
+            } else {
+                writeback_flush(mem_sim, wb);
+            }
+        }
+        writeback_stall_end(mem_sim, &start);
+        if (wb->free_count == 0) {
+            pthread_mutex_unlock(&wb->lock);
+            return -1;
+        }
+    }
+
+    int entry = wb->free_entries[--wb->free_count];
+    memcpy(wb->data + (size_t)entry * mem_sim->page_size, page, mem_sim->page_size);
+    wb->slot[entry] = slot;
+    wb->state[entry] = WB_QUEUED;
+    wb->queue_pos[entry] = wb->queued;
+    wb->queue[wb->queued++] = entry;
+    wb->pending[slot] = entry;
+
+    if (wb->running && wb->queued >= mem_sim->wb_low) {
+        pthread_cond_signal(&wb->work);
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return 0;
+}
+
+/**
+ * writeback_reclaim - Serves a swap-in from the queue if the page is still there
+ * Returns 1 if 'dest' was filled from a queued copy (the write is dropped),
+ * 0 if the page must be read from swap. Waits if its write is in flight.
+ */
+int writeback_reclaim(sim_database* mem_sim, int slot, char* dest) {
+    writeback_queue* wb = mem_sim->wb;
+    int reclaimed = 0;
+    pthread_mutex_lock(&wb->lock);
+
+    int entry = wb->pending[slot];
+    if (entry != -1 && wb->state[entry] == WB_IN_FLIGHT) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (wb->pending[slot] != -1) {
+            pthread_cond_wait(&wb->done, &wb->lock);
+        }
+        writeback_stall_end(mem_sim, &start);
+        entry = -1;
+    }
+
+    if (entry != -1) {
+        memcpy(dest, wb->data + (size_t)entry * mem_sim->page_size, mem_sim->page_size);
+
+        // Unlink from the unordered queue by moving the last entry into its place
+        int last = wb->queue[--wb->queued];
+        wb->queue[wb->queue_pos[entry]] = last;
+        wb->queue_pos[last] = wb->queue_pos[entry];
+
+        wb->pending[slot] = -1;
+        wb->state[entry] = WB_FREE;
+        wb->free_entries[wb->free_count++] = entry;
+        mem_sim->stats.wb_absorbed++;
+        reclaimed = 1;
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return reclaimed;
+}
+
+/**
+ * writeback_pending - Pages queued or being written, without flushing them
+ * Also copies the counters into 'snapshot' (and the modeled time into
+ * 'time', if not NULL) under the queue lock, so they are consistent with
+ * the async flusher's updates.
+ */
+int writeback_pending(sim_database* mem_sim, vmem_stats* snapshot, vmem_time* time) {
+    writeback_queue* wb = mem_sim->wb;
+    if (!wb) {
+        *snapshot = mem_sim->stats;
+        if (time) *time = mem_sim->time;
+        return 0;
+    }
+    pthread_mutex_lock(&wb->lock);
+    *snapshot = mem_sim->stats;
+    if (time) *time = mem_sim->time;
+    int pending = wb->queued + wb->in_flight;
+    pthread_mutex_unlock(&wb->lock);
+    return pending;
+}
+
+// Copy of the page queued (or in flight) for 'slot'; 1 if there was one
+int writeback_peek(sim_database* mem_sim, int slot, char* dest) {
+    writeback_queue* wb = mem_sim->wb;
+    if (!wb) return 0;
+    pthread_mutex_lock(&wb->lock);
+    int entry = wb->pending[slot];
+    if (entry != -1) {
+        memcpy(dest, wb->data + (size_t)entry * mem_sim->page_size, mem_sim->page_size);
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return entry != -1;
+}
+
+// Write out everything queued and wait until no write is in flight; returns
+// the pages still queued because their write failed
+int writeback_drain(sim_database* mem_sim) {
+    writeback_queue* wb = mem_sim->wb;
+    if (!wb) return 0;
+
+    pthread_mutex_lock(&wb->lock);
+    wb->failed = 0;
+    if (wb->running) {
+        wb->drain = 1;
+        pthread_cond_signal(&wb->work);
+        while (wb->drain || wb->in_flight > 0) {
+            pthread_cond_wait(&wb->done, &wb->lock);
+        }
+    } else {
+        writeback_flush(mem_sim, wb);
+    }
+    int left = wb->queued;
+    pthread_mutex_unlock(&wb->lock);
+    return left;
+}
+
+// Forget the queued pages; their swap slots no longer hold anything of use
+static void writeback_discard(sim_database* mem_sim) {
+    writeback_queue* wb = mem_sim->wb;
+    if (!wb) return;
+
+    pthread_mutex_lock(&wb->lock);
+    while (wb->queued > 0) {
+        int entry = wb->queue[--wb->queued];
+        wb->pending[wb->slot[entry]] = -1;
+        wb->state[entry] = WB_FREE;
+        wb->free_entries[wb->free_count++] = entry;
+    }
+    wb->failed = 0;
+    pthread_mutex_unlock(&wb->lock);
+}
+
+// Flush, stop the flusher and free the queue
+void writeback_destroy(sim_database* mem_sim) {
+    writeback_queue* wb = mem_sim->wb;
+    if (!wb) return;
+
+    if (wb->ready) {
+        int lost = writeback_drain(mem_sim);
+        if (lost > 0) {
+            vmem_error(mem_sim, "Error: %d dirty pages could not be written to swap", lost);
+        }
+    }
+    if (wb->running) {
+        pthread_mutex_lock(&wb->lock);
+        wb->stop = 1;
+        pthread_cond_signal(&wb->work);
+        pthread_mutex_unlock(&wb->lock);
+        pthread_join(wb->flusher, NULL);
+    }
+    if (wb->ready) {
+        pthread_mutex_destroy(&wb->lock);
+        pthread_cond_destroy(&wb->work);
+        pthread_cond_destroy(&wb->done);
+    }
+
+    free(wb->data);
+    free(wb->slot);
+    free(wb->state);
+    free(wb->free_entries);
+    free(wb->queue);
+    free(wb->queue_pos);
+    free(wb->pending);
+    free(wb->batch);
+    free(wb->iov);
+    free(wb);
+    mem_sim->wb = NULL;
+}
+
+/**
+ * swap_open - Sizes and maps the swap file, on the first page that has to go there
+ * It is sized without being written: unused slots stay sparse holes, and
+ * the slot bitmap (not the file contents) says which slots are free. Runs
+ * that never swap out leave it empty.
+ */
+static int swap_open(sim_database* mem_sim) {
+    if (ftruncate(mem_sim->swapfile_fd, mem_sim->swap_size) != 0) {
+        vmem_error(mem_sim, "Error sizing swap file: %s", strerror(errno));
+        return -1;
+    }
+    
+    // Map the swap file so page transfers are plain memcpy
+    if (mem_sim->io_mode == VMEM_IO_MMAP && mem_sim->swap_size > 0) {
+        char* map = mmap(NULL, mem_sim->swap_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         mem_sim->swapfile_fd, 0);
+        if (map == MAP_FAILED) {
+            vmem_error(mem_sim, "Error mapping swap file: %s", strerror(errno));
+            return -1;
+        }
+        mem_sim->swap_map = map;
+    }
+    mem_sim->swap_sized = 1;
+    return 0;
+}
+
+// Write a page to its swap slot on disk, or leave it to the writeback queue
+static int write_swap_slot(sim_database* mem_sim, int swap_slot, const char* page) {
+    off_t swap_offset = (off_t)swap_slot * mem_sim->page_size;
+    if (!mem_sim->swap_sized && swap_open(mem_sim) != 0) {
+        return -1;
+    }
+    if (mem_sim->wb) {
+        return writeback_enqueue(mem_sim, swap_slot, page);
+    }
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (mem_sim->swap_map) {
+        memcpy(mem_sim->swap_map + swap_offset, page, mem_sim->page_size);
+    } else if (pwrite(mem_sim->swapfile_fd, page, mem_sim->page_size, swap_offset) != mem_sim->page_size) {
+        vmem_error(mem_sim, "Error writing to swap file: %s", strerror(errno));
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    // A synchronous write always stalls the fault
+    mem_sim->stats.wb_writes++;
+    mem_sim->time.disk_write += mem_sim->costs.disk_write;
+    mem_sim->stats.wb_pages++;
+    mem_sim->stats.wb_stalls++;
+    mem_sim->stats.wb_stall_ns += (end.tv_sec - start.tv_sec) * 1000000000L +
+                                  (end.tv_nsec - start.tv_nsec);
+    return 0;
+}
+
+/* ---- Compressed swap tier ---- */
+
+/**
+ * rle_compress - Byte-oriented run-length encoding of one page
+ * A control byte below 128 is followed by control+1 literal bytes; from 128
+ * up it repeats the next byte control-125 times (runs of 3 to 130). Returns
+ * the compressed length, or -1 if it would not fit in 'capacity' bytes.
+ */
+static int rle_compress(const unsigned char* src, int len, unsigned char* dst, int capacity) {
+    int in = 0, out = 0;
+    while (in < len) {
+        int run = 1;
+        while (in + run < len && run < 130 && src[in + run] == src[in]) run++;
+        if (run >= 3) {
+            if (out + 2 > capacity) return -1;
+            dst[out++] = (unsigned char)(run + 125);
+            dst[out++] = src[in];
+            in += run;
+            continue;
+        }
+        
+        // Literals up to the next run of three or more
+        int literals = 0;
+        while (in + literals < len && literals < 128 &&
+               !(in + literals + 2 < len && src[in + literals] == src[in + literals + 1] &&
+                 src[in + literals] == src[in + literals + 2])) {
+            literals++;
+        }
+        if (out + 1 + literals > capacity) return -1;
+        dst[out++] = (unsigned char)(literals - 1);
+        memcpy(dst + out, src + in, literals);
+        out += literals;
+        in += literals;
+    }
+    return out;
+}
+
+static void rle_decompress(const unsigned char* src, int len, unsigned char* dst, int page_size) {
+    int in = 0, out = 0;
+    while (in < len && out < page_size) {
+        int control = src[in++];
+        if (control >= 128) {
+            int run = control - 125;
+            if (run > page_size - out) run = page_size - out;
+            memset(dst + out, in < len ? src[in] : 0, run);
+            in++;
+            out += run;
+        } else {
+            int literals = control + 1;
+            if (literals > page_size - out) literals = page_size - out;
+            if (literals > len - in) literals = len - in;
+            memcpy(dst + out, src + in, literals);
+            in += literals;
+            out += literals;
+        }
+    }
+    memset(dst + out, 0, page_size - out);
+}
+
+/**
+ * zswap_tier - Compressed RAM cache in front of the swap file
+ * Dirty victims are compressed into entries keyed by their swap slot, which
+ * stays allocated so a spilled page has somewhere to go. When a new page
+ * would exceed the tier size, the least recently stored pages are written
+ * to their slots on disk. Only the simulator's own thread touches it.
+ */
+typedef struct zswap_tier {
+    unsigned char** data;         // Slot -> compressed page, NULL if not in the tier
+    int* length;                  // Slot -> compressed bytes
+    int* prev;                    // Slot -> LRU neighbours, most recent at the head
+    int* next;
+    int head;
+    int tail;
+    long used;                    // Compressed bytes held
+    unsigned char* scratch;       // One compressed page, or a page being spilled
+} zswap_tier;
+
+int zswap_init(sim_database* mem_sim) {
+    int n = mem_sim->num_swap_slots;
+    zswap_tier* tier = (zswap_tier*)calloc(1, sizeof(zswap_tier));
+    if (!tier) {
+        vmem_error(mem_sim, "Error allocating compressed swap: %s", strerror(errno));
+        return -1;
+    }
+    mem_sim->zswap = tier;
+    
+    tier->data = (unsigned char**)calloc(n + 1, sizeof(unsigned char*));
+    tier->length = (int*)calloc(n + 1, sizeof(int));
+    tier->prev = (int*)malloc((n + 1) * sizeof(int));
+    tier->next = (int*)malloc((n + 1) * sizeof(int));
+    tier->scratch = (unsigned char*)malloc(mem_sim->page_size);
+    if (!tier->data || !tier->length || !tier->prev || !tier->next || !tier->scratch) {
+        vmem_error(mem_sim, "Error allocating compressed swap: %s", strerror(errno));
+        return -1;
+    }
+    tier->head = -1;
+    tier->tail = -1;
+    return 0;
+}
+
+void zswap_destroy(sim_database* mem_sim) {
+    zswap_tier* tier = mem_sim->zswap;
+    if (!tier) return;
+    
+    if (tier->data) {
+        for (int slot = 0; slot < mem_sim->num_swap_slots; slot++) free(tier->data[slot]);
+    }
+    free(tier->data);
+    free(tier->length);
+    free(tier->prev);
+    free(tier->next);
+    free(tier->scratch);
+    free(tier);
+    mem_sim->zswap = NULL;
+}
+
+static void zswap_unlink(zswap_tier* tier, int slot) {
+    if (tier->prev[slot] != -1) tier->next[tier->prev[slot]] = tier->next[slot];
+    else tier->head = tier->next[slot];
+    if (tier->next[slot] != -1) tier->prev[tier->next[slot]] = tier->prev[slot];
+    else tier->tail = tier->prev[slot];
+}
+
+static void zswap_drop(zswap_tier* tier, int slot) {
+    zswap_unlink(tier, slot);
+    tier->used -= tier->length[slot];
+    free(tier->data[slot]);
+    tier->data[slot] = NULL;
+}
+
+/**
+ * zswap_store - Keeps a dirty victim bound for 'slot' in the tier
+ * Returns 0 if it was stored, 1 if it must go to disk: it does not
+ * compress, or could not be copied. Room is made by spilling the least
+ * recently stored pages to their swap slots; a spilled page leaves the
+ * tier only once it is written, and -1 means a spill write failed and
+ * nothing was stored.
+ */
+int zswap_store(sim_database* mem_sim, int slot, const char* page) {
+    zswap_tier* tier = mem_sim->zswap;
+    int len = rle_compress((const unsigned char*)page, mem_sim->page_size,
+                           tier->scratch, mem_sim->page_size - 1);
+    if (len < 0 || len > mem_sim->zswap_size) {
+        mem_sim->stats.zswap_rejects++;
+        return 1;
+    }
+    unsigned char* copy = (unsigned char*)malloc(len);
+    if (!copy) return 1;
+    memcpy(copy, tier->scratch, len);
+    
+    // Spill from the cold end; the scratch buffer is free again
+    while (tier->used + len > mem_sim->zswap_size) {
+        int victim = tier->tail;
+        rle_decompress(tier->data[victim], tier->length[victim], tier->scratch, mem_sim->page_size);
+        if (write_swap_slot(mem_sim, victim, (const char*)tier->scratch) != 0) {
+            free(copy);
+            return -1;
+        }
+        zswap_drop(tier, victim);
+        mem_sim->stats.zswap_spills++;
+    }
+    
+    tier->data[slot] = copy;
+    tier->length[slot] = len;
+    tier->used += len;
+    tier->prev[slot] = -1;
+    tier->next[slot] = tier->head;
+    if (tier->head != -1) tier->prev[tier->head] = slot;
+    tier->head = slot;
+    if (tier->tail == -1) tier->tail = slot;
+    
+    mem_sim->stats.zswap_stores++;
+    mem_sim->time.zswap += mem_sim->costs.zswap;
+    mem_sim->stats.zswap_bytes_in += mem_sim->page_size;
+    mem_sim->stats.zswap_bytes_out += len;
+    return 0;
+}
+
+// Compressed bytes the tier holds now
+long zswap_used(sim_database* mem_sim) {
+    return mem_sim->zswap ? mem_sim->zswap->used : 0;
+}
+
+/**
+ * zswap_load - Serves a swap-in from the tier if the page is there
+ * Returns 1 if 'dest' was filled, 0 if the page must be read from disk.
+ * The entry is dropped unless 'keep' is set (print swap only looks).
+ */
+int zswap_load(sim_database* mem_sim, int slot, char* dest, int keep) {
+    zswap_tier* tier = mem_sim->zswap;
+    if (!tier || slot < 0 || slot >= mem_sim->num_swap_slots || !tier->data[slot]) return 0;
+    
+    rle_decompress(tier->data[slot], tier->length[slot], (unsigned char*)dest, mem_sim->page_size);
+    if (!keep) {
+        zswap_drop(tier, slot);
+        mem_sim->stats.zswap_hits++;
+        mem_sim->time.zswap += mem_sim->costs.zswap;
+    }
+    return 1;
+}
+
+// Helper function to save page to swap; -1 (the page keeps its frame) if it could not be
+int save_page_to_swap(sim_database* mem_sim, vmem_process* proc, int64_t page_num) {
+    // Claim a free slot in swap (first-fit or next-fit, per swapfit=)
+    int swap_slot = find_free_swap_slot(mem_sim);
+    if (swap_slot == -1) {
+        vmem_error(mem_sim, "Error: Swap file full!");
+        return -1;
+    }
+    
+    // Get frame content
+    page_descriptor* pd = find_descriptor(mem_sim, proc, page_num);
+    int frame_num = pd->frame_swap;
+    char* frame_start = mem_sim->main_memory + (frame_num * mem_sim->page_size);
+    
+    // Keep it compressed in RAM if the tier takes it, else write it to swap
+    int rc = mem_sim->zswap ? zswap_store(mem_sim, swap_slot, frame_start) : 1;
+    if (rc > 0) rc = write_swap_slot(mem_sim, swap_slot, frame_start);
+    if (rc != 0) {
+        release_swap_slot(mem_sim, swap_slot);
+        return -1;
+    }
+    mem_sim->stats.swap_outs++;
+    
+    // Update page table to remember swap location
+    pd->frame_swap = swap_slot;
+    return 0;
+}
+
+/**
+ * evict_page - Frees the frame of a page chosen by the replacement policy
+ * Returns the frame, or -1 if there is no victim or it is dirty and could
+ * not be saved (swap full, write error): that page then stays resident and
+ * goes back to the policy, and the fault needing the frame fails.
+ */
+int evict_page(sim_database* mem_sim) {
+    int frame_to_free = mem_sim->policy->select_victim(mem_sim);
+    if (frame_to_free == -1) {
+        vmem_error(mem_sim, "Error: No page to evict!");
+        return -1;
+    }
+    int64_t oldest_page = mem_sim->frame_owner[frame_to_free];
+    vmem_process* owner = mem_sim->procs[mem_sim->frame_asid[frame_to_free]];
+    page_descriptor* pd = find_descriptor(mem_sim, owner, oldest_page);
+    
+    // Simulated CPUs may still write the page through their TLBs: unmap it
+    // everywhere first, so D is final when it is read below
+    if (mem_sim->unmap_hook) {
+        mem_sim->unmap_hook(mem_sim, pd, owner->asid, oldest_page);
+    }
+    
+    // If page is dirty and not TEXT, save to swap
+    if (pd->D == 1 && pd->P == 0) {  // Not read-only
+        if (save_page_to_swap(mem_sim, owner, oldest_page) != 0) {
+            pd->V = 1;
+            mem_sim->policy->on_insert(mem_sim, frame_to_free);
+            return -1;
+        }
+        if (mem_sim->num_procs > 1) {
+            vmem_log(mem_sim, "Page replacement: Evicting page %lld of process %d to swap\n",
+                     (long long)oldest_page, owner->asid);
+        } else {
+            vmem_log(mem_sim, "Page replacement: Evicting page %lld to swap\n", (long long)oldest_page);
+        }
+        mem_sim->stats.writebacks++;
+    }
+    
+    mem_sim->stats.evictions++;
+    mem_sim->stats.seg_evictions[pd->seg]++;
+    owner->evictions++;
+    if (owner != mem_sim->proc) {
+        owner->stolen++;
+    }
+    if (mem_sim->frame_prefetched[frame_to_free]) {
+        mem_sim->frame_prefetched[frame_to_free] = 0;
+        mem_sim->stats.ra_wasted++;
+        owner->ra_size /= 2;
+    }
+    
+    // Mark page as not in memory; a clean page needs no descriptor any more
+    pd->V = 0;
+    pd->A = 0;
+    release_descriptor(mem_sim, owner, oldest_page);
+    mem_sim->frame_owner[frame_to_free] = -1;
+    mem_sim->frame_asid[frame_to_free] = -1;
+    
+    // Remove from TLB - IMPORTANT: remove the evicted page from TLB
+    remove_from_tlb(mem_sim, owner->asid, oldest_page);
+    
+    return frame_to_free;
+}
+
+// Helper function to load page from program file
+void load_page_from_program(sim_database* mem_sim, vmem_process* proc, int64_t page_num,
+                            char* dest, off_t base_offset) {
+    off_t file_offset = base_offset + page_num * mem_sim->page_size;
+    
+    // Mapped program: copy what the file has and zero-fill past its end
+    if (proc->program_map) {
+        size_t available = 0;
+        if ((size_t)file_offset < proc->program_map_size) {
+            available = proc->program_map_size - file_offset;
+            if (available > (size_t)mem_sim->page_size) available = mem_sim->page_size;
+            memcpy(dest, proc->program_map + file_offset, available);
+        }
+        memset(dest + available, 0, mem_sim->page_size - available);
+        return;
+    }
+    
+    if (lseek(proc->program_fd, file_offset, SEEK_SET) == -1) {
+        vmem_error(mem_sim, "Error seeking in file: %s", strerror(errno));
+        return;
+    }
+    
+    ssize_t bytes_read = read(proc->program_fd, dest, mem_sim->page_size);
+    if (bytes_read != mem_sim->page_size) {
+        if (bytes_read == -1) {
+            vmem_error(mem_sim, "Error reading from file: %s", strerror(errno));
+        }
+        // Fill rest with zeros if we read less than page_size
+        if (bytes_read > 0 && bytes_read < mem_sim->page_size) {
+            memset(dest + bytes_read, 0, mem_sim->page_size - bytes_read);
+        }
+    }
+}
+
+// Helper function to load page from swap
+void load_page_from_swap(sim_database* mem_sim, vmem_process* proc, int64_t page_num, char* dest) {
+    int swap_page = find_descriptor(mem_sim, proc, page_num)->frame_swap;
+    off_t swap_offset = (off_t)swap_page * mem_sim->page_size;
+    
+    if (zswap_load(mem_sim, swap_page, dest, 0)) {
+        // Compressed in RAM: no disk read at all
+        mem_sim->stats.faults_zswap++;
+    } else if (mem_sim->wb && writeback_reclaim(mem_sim, swap_page, dest)) {
+        // Still queued: served from the queued copy, its write is dropped
+    } else if (mem_sim->swap_map) {
+        memcpy(dest, mem_sim->swap_map + swap_offset, mem_sim->page_size);
+        mem_sim->time.disk_read += mem_sim->costs.disk_read;
+    } else if (pread(mem_sim->swapfile_fd, dest, mem_sim->page_size, swap_offset) != mem_sim->page_size) {
+        vmem_error(mem_sim, "Error reading from swap file: %s", strerror(errno));
+        return;
+    } else {
+        mem_sim->time.disk_read += mem_sim->costs.disk_read;
+    }
+    mem_sim->stats.swap_ins++;
+    
+    // The page is back in memory - its slot can be reused.
+    // It stays dirty, so it is written out again if evicted.
+    release_swap_slot(mem_sim, swap_page);
+}
+
+/* ---- Read-ahead on sequential faults ---- */
+
+#define RA_INIT_PAGES 4           // Window opened by the first sequential fault
+
+// Where a non-resident page's contents come from
+#define RA_ZERO 0                 // Zero-filled, nothing to read
+#define RA_TEXT 1                 // Program file, TEXT part
+#define RA_DATA 2                 // Program file, DATA part
+#define RA_SWAP 3                 // Swap slot
+
+static int ra_source(sim_database* mem_sim, vmem_process* proc, int64_t page_num,
+                     const page_descriptor* pd) {
+    int text_pages = (proc->text_size + mem_sim->page_size - 1) / mem_sim->page_size;
+    int data_pages = (proc->data_size + mem_sim->page_size - 1) / mem_sim->page_size;
+    
+    if (page_num < text_pages) return RA_TEXT;
+    if (pd && pd->D == 1) return RA_SWAP;
+    if (page_num < text_pages + data_pages) return RA_DATA;
+    return RA_ZERO;
+}
+
+// Reads 'count' program file pages from 'file_offset' into the window's frames
+static long readahead_program(sim_database* mem_sim, vmem_process* proc, int count,
+                              off_t file_offset) {
+    int page_size = mem_sim->page_size;
+    
+    // Mapped program: the window is one run of copies out of the mapping
+    if (proc->program_map) {
+        for (int i = 0; i < count; i++) {
+            char* dest = mem_sim->main_memory + (size_t)mem_sim->ra_frames[i] * page_size;
+            load_page_from_program(mem_sim, proc, i, dest, file_offset);
+        }
+        return 1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        mem_sim->ra_iov[i].iov_base = mem_sim->main_memory + (size_t)mem_sim->ra_frames[i] * page_size;
+        mem_sim->ra_iov[i].iov_len = page_size;
+    }
+    ssize_t bytes = preadv(proc->program_fd, mem_sim->ra_iov, count, file_offset);
+    if (bytes == -1) {
+        vmem_error(mem_sim, "Error reading from file: %s", strerror(errno));
+        bytes = 0;
+    }
+    
+    // Zero-fill whatever lies past the end of the file
+    for (int i = 0; i < count; i++) {
+        ssize_t filled = bytes - (ssize_t)i * page_size;
+        if (filled < 0) filled = 0;
+        if (filled < page_size) {
+            memset((char*)mem_sim->ra_iov[i].iov_base + filled, 0, page_size - filled);
+        }
+    }
+    return 1;
+}
+
+// Reads the window's pages back from swap, one read per run of adjacent slots
+static long readahead_swap(sim_database* mem_sim, vmem_process* proc, int64_t first, int count) {
+    int page_size = mem_sim->page_size;
+    long reads = 0;
+    
+    // Pages in the compressed tier or the writeback queue are served from there
+    for (int i = 0; i < count; i++) {
+        char* dest = mem_sim->main_memory + (size_t)mem_sim->ra_frames[i] * page_size;
+        mem_sim->ra_slots[i] = find_descriptor(mem_sim, proc, first + i)->frame_swap;
+        if (zswap_load(mem_sim, mem_sim->ra_slots[i], dest, 0) ||
+            (mem_sim->wb && writeback_reclaim(mem_sim, mem_sim->ra_slots[i], dest))) {
+            mem_sim->ra_slots[i] = -1;
+        }
+    }
+    
+    for (int start = 0; start < count; ) {
+        if (mem_sim->ra_slots[start] == -1) {
+            start++;
+            continue;
+        }
+        int end = start + 1;
+        while (end < count && mem_sim->ra_slots[end] != -1 &&
+               mem_sim->ra_slots[end] == mem_sim->ra_slots[end - 1] + 1) {
+            end++;
+        }
+        
+        off_t offset = (off_t)mem_sim->ra_slots[start] * page_size;
+        for (int i = start; i < end; i++) {
+            char* dest = mem_sim->main_memory + (size_t)mem_sim->ra_frames[i] * page_size;
+            if (mem_sim->swap_map) {
+                memcpy(dest, mem_sim->swap_map + offset + (off_t)(i - start) * page_size, page_size);
+            } else {
+                mem_sim->ra_iov[i - start].iov_base = dest;
+                mem_sim->ra_iov[i - start].iov_len = page_size;
+            }
+        }
+        if (!mem_sim->swap_map &&
+            preadv(mem_sim->swapfile_fd, mem_sim->ra_iov, end - start, offset) !=
+            (ssize_t)(end - start) * page_size) {
+            vmem_error(mem_sim, "Error reading from swap file: %s", strerror(errno));
+        }
+        reads++;
+        start = end;
+    }
+    
+    // Back in memory: the slots can be reused, the pages stay dirty
+    for (int i = 0; i < count; i++) {
+        release_swap_slot(mem_sim, find_descriptor(mem_sim, proc, first + i)->frame_swap);
+        mem_sim->stats.swap_ins++;
+    }
+    return reads;
+}
+
+/**
+ * readahead_fault - Loads the pages after a sequential fault ahead of their use
+ * Called on every fault once the faulting page holds its frame and before
+ * it is loaded, so prefetching can never evict it. A fault on the page just past the previous fault (or
+ * past the last window) is sequential: the window opens at RA_INIT_PAGES
+ * and doubles up to ra_max, while any other fault closes it. The window
+ * stops at the first page that is resident or comes from somewhere else,
+ * and never takes more than a quarter of the frames. Prefetched pages skip
+ * the TLB; their first access counts them as useful, and evicting one
+ * untouched counts it as wasted and halves its process's window.
+ */
+void readahead_fault(sim_database* mem_sim, vmem_process* proc, int64_t page_num) {
+    if (page_num != proc->ra_next) {
+        proc->ra_next = page_num + 1;
+        proc->ra_size = 0;
+        return;
+    }
+    proc->ra_size = proc->ra_size ? proc->ra_size * 2 : RA_INIT_PAGES;
+    if (proc->ra_size > mem_sim->ra_max) proc->ra_size = mem_sim->ra_max;
+    
+    int limit = proc->ra_size;
+    if (limit > mem_sim->num_frames / 4) limit = mem_sim->num_frames / 4;
+    int source = ra_source(mem_sim, proc, page_num, find_descriptor(mem_sim, proc, page_num));
+    int64_t first = page_num + 1;
+    int count = 0;
+    while (source != RA_ZERO && count < limit && first + count < proc->num_pages) {
+        page_descriptor* pd = find_descriptor(mem_sim, proc, first + count);
+        if ((pd && pd->V) || ra_source(mem_sim, proc, first + count, pd) != source) break;
+        count++;
+    }
+    proc->ra_next = first + count;
+    
+    // Take every frame before reading, so the window cannot evict itself.
+    // Each page's fault reaches the policy before its victim is chosen.
+    for (int i = 0; i < count; i++) {
+        if (mem_sim->policy->on_fault) {
+            mem_sim->policy->on_fault(mem_sim, first + i);
+        }
+        int frame = find_free_frame(mem_sim);
+        if (frame == -1) frame = evict_page(mem_sim);
+        if (frame == -1) {
+            count = i;
+            break;
+        }
+        mem_sim->ra_frames[i] = frame;
+    }
+    if (count == 0) return;
+    
+    vmem_log(mem_sim, "Read-ahead: Loading pages %lld-%lld from %s\n",
+             (long long)first, (long long)(first + count - 1),
+             source == RA_SWAP ? "swap" : "program file");
+    int text_pages = (proc->text_size + mem_sim->page_size - 1) / mem_sim->page_size;
+    long reads;
+    if (source == RA_TEXT) {
+        reads = readahead_program(mem_sim, proc, count, (off_t)first * mem_sim->page_size);
+    } else if (source == RA_DATA) {
+        reads = readahead_program(mem_sim, proc, count,
+                                  proc->text_size + (off_t)(first - text_pages) * mem_sim->page_size);
+    } else {
+        reads = readahead_swap(mem_sim, proc, first, count);
+    }
+    mem_sim->stats.ra_windows++;
+    mem_sim->stats.ra_pages += count;
+    mem_sim->stats.ra_reads += reads;
+    mem_sim->time.disk_read += reads * mem_sim->costs.disk_read;
+    
+    // Map the pages and hand them to the replacement policy like faulted ones
+    for (int i = 0; i < count; i++) {
+        int frame = mem_sim->ra_frames[i];
+        page_descriptor* pd = get_descriptor(mem_sim, proc, first + i);
+        if (!pd) {
+            // No room for a descriptor: give the frame back unused
+            mem_sim->free_frames[mem_sim->free_frame_count++] = frame;
+            continue;
+        }
+        mem_sim->frame_owner[frame] = first + i;
+        mem_sim->frame_asid[frame] = proc->asid;
+        mem_sim->frame_prefetched[frame] = 1;
+        pte_map(pd, frame, 0);
+        mem_sim->policy->on_insert(mem_sim, frame);
+    }
+}
+
+/* ---- Working set and time-series snapshots ---- */
+
+/**
+ * ws_tracker - Distinct pages referenced in the last 'window' accesses
+ * A ring holds the page of each access in the window; a chained hash maps
+ * every page in it to the index of its latest access. When an access
+ * leaves the window, its page leaves the set unless it was used again
+ * since, so each access costs two lookups and the table never holds more
+ * than 'window' entries.
+ */
+typedef struct ws_tracker {
+    int window;
+    int64_t* ring_page;           // Access index % window -> page
+    int* ring_asid;               // ...and its address space
+    int64_t* page;                // Entry -> page
+    int* asid;                    // Entry -> address space
+    long* last;                   // Entry -> index of the page's latest access
+    int* chain;                   // Entry -> next entry in the same bucket
+    int* buckets;                 // Hash bucket -> first entry, -1 if empty
+    int mask;
+    int* free_entries;
+    int free_count;
+    long size;                    // Pages in the working set now
+    long peak;
+} ws_tracker;
+
+int ws_init(sim_database* mem_sim) {
+    int n = mem_sim->ws_window;
+    ws_tracker* ws = (ws_tracker*)calloc(1, sizeof(ws_tracker));
+    if (!ws) {
+        vmem_error(mem_sim, "Error allocating working set tracker: %s", strerror(errno));
+        return -1;
+    }
+    mem_sim->ws = ws;
+    
+    int buckets = 16;
+    while (buckets < n && buckets < (1 << 30)) buckets *= 2;
+    ws->window = n;
+    ws->ring_page = (int64_t*)malloc(n * sizeof(int64_t));
+    ws->ring_asid = (int*)malloc(n * sizeof(int));
+    ws->page = (int64_t*)malloc(n * sizeof(int64_t));
+    ws->asid = (int*)malloc(n * sizeof(int));
+    ws->last = (long*)malloc(n * sizeof(long));
+    ws->chain = (int*)malloc(n * sizeof(int));
+    ws->free_entries = (int*)malloc(n * sizeof(int));
+    ws->buckets = (int*)malloc(buckets * sizeof(int));
+    if (!ws->ring_page || !ws->ring_asid || !ws->page || !ws->asid || !ws->last ||
+        !ws->chain || !ws->free_entries || !ws->buckets) {
+        vmem_error(mem_sim, "Error allocating working set tracker: %s", strerror(errno));
+        return -1;
+    }
+    ws->mask = buckets - 1;
+    for (int i = 0; i < n; i++) ws->free_entries[i] = n - 1 - i;
+    ws->free_count = n;
+    for (int i = 0; i < buckets; i++) ws->buckets[i] = -1;
+    return 0;
+}
+
+void ws_destroy(sim_database* mem_sim) {
+    ws_tracker* ws = mem_sim->ws;
+    if (!ws) return;
+    free(ws->ring_page);
+    free(ws->ring_asid);
+    free(ws->page);
+    free(ws->asid);
+    free(ws->last);
+    free(ws->chain);
+    free(ws->free_entries);
+    free(ws->buckets);
+    free(ws);
+    mem_sim->ws = NULL;
+}
+
+static int* ws_bucket(ws_tracker* ws, int asid, int64_t page_num) {
+    uint64_t key = (uint64_t)page_num * 0x9E3779B97F4A7C15ULL + (uint64_t)asid * 0xC2B2AE3D27D4EB4FULL;
+    return &ws->buckets[(key >> 32) & ws->mask];
+}
+
+// Record access number 'now' (0-based) to a page
+static void ws_access(ws_tracker* ws, int asid, int64_t page_num, long now) {
+    int slot = (int)(now % ws->window);
+    
+    // The access leaving the window takes its page along if it was the latest use
+    if (now >= ws->window) {
+        int* link = ws_bucket(ws, ws->ring_asid[slot], ws->ring_page[slot]);
+        while (*link != -1 && (ws->page[*link] != ws->ring_page[slot] ||
+                               ws->asid[*link] != ws->ring_asid[slot])) {
+            link = &ws->chain[*link];
+        }
+        int entry = *link;
+        if (entry != -1 && ws->last[entry] == now - ws->window) {
+            *link = ws->chain[entry];
+            ws->free_entries[ws->free_count++] = entry;
+            ws->size--;
+        }
+    }
+    
+    int* head = ws_bucket(ws, asid, page_num);
+    int entry = *head;
+    while (entry != -1 && (ws->page[entry] != page_num || ws->asid[entry] != asid)) {
+        entry = ws->chain[entry];
+    }
+    if (entry == -1) {
+        entry = ws->free_entries[--ws->free_count];
+        ws->page[entry] = page_num;
+        ws->asid[entry] = asid;
+        ws->chain[entry] = *head;
+        *head = entry;
+        if (++ws->size > ws->peak) ws->peak = ws->size;
+    }
+    ws->last[entry] = now;
+    ws->ring_page[slot] = page_num;
+    ws->ring_asid[slot] = asid;
+}
+
+// Working set size now and its peak, 0 when not tracked
+long ws_size(sim_database* mem_sim, long* peak) {
+    if (peak) *peak = mem_sim->ws ? mem_sim->ws->peak : 0;
+    return mem_sim->ws ? mem_sim->ws->size : 0;
+}
+
+/**
+ * write_snapshot - Emits one row of the access time series
+ * Counters are cumulative; the fault rate covers the accesses since the
+ * previous snapshot. The output file is opened on the first row, so
+ * simulators that never reach one (or sweeps, which turn them off) leave
+ * no file behind.
+ */
+void write_snapshot(sim_database* mem_sim) {
+    const vmem_stats* st = &mem_sim->stats;
+    const vmem_stats* prev = &mem_sim->snapshot_last;
+    
+    vmem_flush(mem_sim);
+    if (!mem_sim->snapshot_out) {
+        if (strcmp(mem_sim->snapshot_path, "-") == 0) {
+            mem_sim->snapshot_out = stdout;
+        } else if (!(mem_sim->snapshot_out = fopen(mem_sim->snapshot_path, "w"))) {
+            vmem_error(mem_sim, "Error opening snapshot file: %s", strerror(errno));
+            mem_sim->snapshot_every = 0;
+            return;
+        }
+        if (!mem_sim->snapshot_jsonl) {
+            fprintf(mem_sim->snapshot_out,
+                    "accesses,faults,fault_rate,text_faults,data_faults,bss_faults,heap_stack_faults,"
+                    "tlb_hits,tlb_misses,evictions,swap_ins,swap_outs,writebacks,working_set,resident\n");
+        }
+    }
+    
+    long accesses = st->accesses - prev->accesses;
+    double fault_rate = accesses ? (double)(st->faults - prev->faults) / accesses : 0.0;
+    long working_set = ws_size(mem_sim, NULL);
+    int resident = mem_sim->num_frames - mem_sim->free_frame_count;
+    
+    if (mem_sim->snapshot_jsonl) {
+        fprintf(mem_sim->snapshot_out,
+                "{\"accesses\": %ld, \"faults\": %ld, \"fault_rate\": %.6f, \"text_faults\": %ld, "
+                "\"data_faults\": %ld, \"bss_faults\": %ld, \"heap_stack_faults\": %ld, "
+                "\"tlb_hits\": %ld, \"tlb_misses\": %ld, \"evictions\": %ld, \"swap_ins\": %ld, "
+                "\"swap_outs\": %ld, \"writebacks\": %ld, \"working_set\": %ld, \"resident\": %d}\n",
+                st->accesses, st->faults, fault_rate, st->seg_faults[PTE_SEG_TEXT],
+                st->seg_faults[PTE_SEG_DATA], st->seg_faults[PTE_SEG_BSS],
+                st->seg_faults[PTE_SEG_HEAP_STACK], st->tlb_hits, st->tlb_misses, st->evictions,
+                st->swap_ins, st->swap_outs, st->writebacks, working_set, resident);
+    } else {
+        fprintf(mem_sim->snapshot_out, "%ld,%ld,%.6f,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%d\n",
+                st->accesses, st->faults, fault_rate, st->seg_faults[PTE_SEG_TEXT],
+                st->seg_faults[PTE_SEG_DATA], st->seg_faults[PTE_SEG_BSS],
+                st->seg_faults[PTE_SEG_HEAP_STACK], st->tlb_hits, st->tlb_misses, st->evictions,
+                st->swap_ins, st->swap_outs, st->writebacks, working_set, resident);
+    }
+    if (mem_sim->snapshot_out == stdout) fflush(stdout);
+    mem_sim->snapshot_last = *st;
+}
+
+// Final row for accesses since the last snapshot, then close the output
+void finish_snapshots(sim_database* mem_sim) {
+    if (mem_sim->snapshot_every && mem_sim->stats.accesses != mem_sim->snapshot_last.accesses) {
+        write_snapshot(mem_sim);
+    }
+    if (mem_sim->snapshot_out && mem_sim->snapshot_out != stdout) {
+        fclose(mem_sim->snapshot_out);
+    }
+    mem_sim->snapshot_out = NULL;
+    mem_sim->snapshot_every = 0;
+}
+
+/**
+ * translate_page - Makes a page of 'proc' resident and returns its frame
+ * One counted access: TLB, then page table, then a page fault that loads
+ * the page from the program file, swap or zeroes. Returns -1 if the page
+ * cannot be given a descriptor, or a frame (see evict_page).
+ */
+int translate_page(sim_database* mem_sim, vmem_process* proc, int64_t page_num) {
+    if (mem_sim->snapshot_every && mem_sim->stats.accesses % mem_sim->snapshot_every == 0 &&
+        mem_sim->stats.accesses != mem_sim->snapshot_last.accesses) {
+        write_snapshot(mem_sim);
+    }
+    if (mem_sim->ws) {
+        ws_access(mem_sim->ws, proc->asid, page_num, mem_sim->stats.accesses);
+    }
+    mem_sim->stats.accesses++;
+    proc->accesses++;
+    mem_sim->time.mem += mem_sim->costs.mem;
+    
+    // 1. Check TLB first
+    if (mem_sim->tlb.entries) {
+        int tlb_frame = check_tlb(mem_sim, page_num);
+        if (tlb_frame != -1) {
+            // TLB hit!
+            vmem_log(mem_sim, "TLB Hit: Page %lld -> Frame %d\n", (long long)page_num, tlb_frame);
+            mem_sim->policy->on_access(mem_sim, tlb_frame);
+            return tlb_frame;
+        }
+        
+        // TLB miss
+        vmem_log(mem_sim, "TLB Miss: Page %lld\n", (long long)page_num);
+    }
+    mem_sim->time.walk += mem_sim->costs.walk;
+    // 2. Check if page is already in memory (page table lookup)
+    page_descriptor* pd = find_descriptor(mem_sim, proc, page_num);
+    if (pd && pd->V == 1) {
+        // Page is in memory - add to TLB
+        int frame_num = pd->frame_swap;
+        pd->A = 1;
+        add_to_tlb(mem_sim, page_num, frame_num);
+        
+        // First access to a read-ahead page (they are never in the TLB)
+        if (mem_sim->frame_prefetched[frame_num]) {
+            mem_sim->frame_prefetched[frame_num] = 0;
+            mem_sim->stats.ra_useful++;
+        }
+        
+        mem_sim->policy->on_access(mem_sim, frame_num);
+        return frame_num;
+    }
+    
+    // 3. Page fault - need to load the page
+    mem_sim->stats.faults++;
+    proc->faults++;
+    if (mem_sim->policy->on_fault) {
+        mem_sim->policy->on_fault(mem_sim, page_num);
+    }
+    
+    // Find a free frame or select one to evict
+    int frame_to_use = find_free_frame(mem_sim);
+    if (frame_to_use == -1) {
+        // No free frame, ask the replacement policy for a victim
+        frame_to_use = evict_page(mem_sim);
+        if (frame_to_use == -1) return -1;
+    }
+    
+    // The frame is out of the policy's hands until on_insert, so the
+    // read-ahead window cannot evict it
+    if (mem_sim->readahead) {
+        readahead_fault(mem_sim, proc, page_num);
+    }
+    
+    // Untouched pages of a radix or inverted table get their descriptor now
+    pd = get_descriptor(mem_sim, proc, page_num);
+    if (!pd) {
+        mem_sim->free_frames[mem_sim->free_frame_count++] = frame_to_use;
+        return -1;
+    }
+    mem_sim->stats.seg_faults[pd->seg]++;
+    
+    // Now print the page fault message after eviction is done
+    vmem_log(mem_sim, "Page fault: Loading page %lld from ", (long long)page_num);
+    
+    // 4. Load the page content based on its type
+    char* frame_start = mem_sim->main_memory + (frame_to_use * mem_sim->page_size);
+    
+    if (pd->seg == PTE_SEG_TEXT) {
+        // TEXT page - always load from program file
+        vmem_log(mem_sim, "program file\n");
+        mem_sim->stats.faults_program++;
+        mem_sim->time.disk_read += mem_sim->costs.disk_read;
+        load_page_from_program(mem_sim, proc, page_num, frame_start, 0);
+    }
+    else if (pd->D == 1) {
+        // Page was modified before - load from swap
+        vmem_log(mem_sim, "swap\n");
+        mem_sim->stats.faults_swap++;
+        load_page_from_swap(mem_sim, proc, page_num, frame_start);
+    }
+    else if (pd->seg == PTE_SEG_DATA) {
+        // DATA page - load from program file
+        vmem_log(mem_sim, "program file\n");
+        mem_sim->stats.faults_program++;
+        mem_sim->time.disk_read += mem_sim->costs.disk_read;
+        off_t file_offset = proc->text_size;
+        load_page_from_program(mem_sim, proc, page_num - text_page_count(mem_sim, proc),
+                               frame_start, file_offset);
+    }
+    else {
+        // BSS or HEAP/STACK page - initialize with zeros
+        vmem_log(mem_sim, "new allocation\n");
+        mem_sim->stats.faults_new++;
+        memset(frame_start, 0, mem_sim->page_size);
+    }
+    
+    // 5. Update page table and the inverse frame table
+    pte_map(pd, frame_to_use, 1);
+    mem_sim->frame_owner[frame_to_use] = page_num;
+    mem_sim->frame_asid[frame_to_use] = proc->asid;
+    
+    // 6. Add to TLB
+    add_to_tlb(mem_sim, page_num, frame_to_use);
+    
+    // Let the replacement policy start tracking the new page
+    mem_sim->policy->on_insert(mem_sim, frame_to_use);
+    
+    return frame_to_use;
+}
+
+// Whether a write to the page must be refused: TEXT segments are read-only,
+// and pages without a descriptor have not been touched and are read-only only in TEXT
+int page_read_only(sim_database* mem_sim, vmem_process* proc, int64_t page_num) {
+    page_descriptor* pd = find_descriptor(mem_sim, proc, page_num);
+    return pd ? pd->P == 1 : page_num < text_page_count(mem_sim, proc);
+}
+
+/**
+ * vmem_access - Loads or stores one byte at a virtual address of the current process
+ * A load fills *value, a store writes it and marks the page dirty (it is
+ * saved to swap when evicted). Returns VMEM_OK or the reason it failed.
+ */
+int vmem_access(vmem_handle* mem_sim, int64_t address, int op, char* value) {
+    vmem_process* proc = mem_sim->proc;
+    
+    // 1. Check if address is valid
+    if (address < 0 || address >= (proc->num_pages * mem_sim->page_size)) {
+        return VMEM_ERR_RANGE;
+    }
+    
+    // 2. Calculate page number and offset, and check write permissions
+    int64_t page_num = address / mem_sim->page_size;
+    int offset = address % mem_sim->page_size;
+    if (op == VMEM_STORE && page_read_only(mem_sim, proc, page_num)) {
+        return VMEM_ERR_READONLY;
+    }
+    
+    // 3. Bring the page into memory (handles all the page fault logic)
+    int frame_num = translate_page(mem_sim, proc, page_num);
+    if (frame_num == -1) return VMEM_ERR_FAULT;
+    
+    // 4. Access the data
+    char* byte = &mem_sim->main_memory[frame_num * mem_sim->page_size + offset];
+    if (op == VMEM_STORE) {
+        *byte = *value;
+        find_descriptor(mem_sim, proc, page_num)->D = 1;
+    } else {
+        *value = *byte;
+    }
+    return VMEM_OK;
+}
+
+// Main load function: the byte at 'address', or '\0' (after reporting why)
+char load(sim_database* mem_sim, int64_t address) {
+    char value = '\0';
+    if (vmem_access(mem_sim, address, VMEM_LOAD, &value) == VMEM_ERR_RANGE) {
+        vmem_error(mem_sim, "Error: Invalid address %lld (out of range)", (long long)address);
+    }
+    return value;
+}
+
+/**
+ * store - Writes one byte at a virtual address of the current process
+ * Returns 0 on success, -1 (after reporting why) for addresses out of range,
+ * read-only TEXT pages and pages that could not be loaded.
+ */
+int store(sim_database* mem_sim, int64_t address, char value) {
+    int rc = vmem_access(mem_sim, address, VMEM_STORE, &value);
+    if (rc == VMEM_ERR_RANGE) {
+        vmem_error(mem_sim, "Error: Invalid address %lld (out of range)", (long long)address);
+    } else if (rc == VMEM_ERR_READONLY) {
+        vmem_error(mem_sim, "Error: Invalid write operation to read-only segment at address %lld",
+                    (long long)address);
+    }
+    return rc == VMEM_OK ? 0 : -1;
+}
+
+/* ---- Bulk range operations ---- */
+
+// Checks that [address, address + length) lies inside the current process
+static int check_range(sim_database* mem_sim, int64_t address, int64_t length) {
+    int64_t space = mem_sim->proc->num_pages * mem_sim->page_size;
+    if (address < 0 || length < 0 || address > space || length > space - address) {
+        vmem_error(mem_sim, "Error: Invalid range %lld+%lld (out of range)",
+                    (long long)address, (long long)length);
+        return -1;
+    }
+    return 0;
+}
+
+// A write range is refused as a whole if it covers any read-only page
+static int check_writable(sim_database* mem_sim, int64_t address, int64_t length) {
+    if (check_range(mem_sim, address, length) != 0) return -1;
+    if (length == 0) return 0;
+    
+    int64_t last = (address + length - 1) / mem_sim->page_size;
+    for (int64_t page = address / mem_sim->page_size; page <= last; page++) {
+        if (page_read_only(mem_sim, mem_sim->proc, page)) {
+            int64_t at = page * mem_sim->page_size;
+            vmem_error(mem_sim, "Error: Invalid write operation to read-only segment at address %lld",
+                        (long long)(at > address ? at : address));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Translates the page holding 'address' once and returns the frame bytes
+// from 'address' on; writes mark the page dirty
+static char* range_bytes(sim_database* mem_sim, int64_t address, int write) {
+    vmem_process* proc = mem_sim->proc;
+    int64_t page_num = address / mem_sim->page_size;
+    int frame_num = translate_page(mem_sim, proc, page_num);
+    if (frame_num == -1) return NULL;
+    if (write) find_descriptor(mem_sim, proc, page_num)->D = 1;
+    return mem_sim->main_memory + frame_num * mem_sim->page_size + address % mem_sim->page_size;
+}
+
+// Bytes from 'address' to the end of its page, at most 'length'
+static int64_t page_chunk(int64_t address, int64_t length, int page_size) {
+    int64_t chunk = page_size - address % page_size;
+    return chunk < length ? chunk : length;
+}
+
+/**
+ * copy_chunk - Next piece of a copy that stays within one source page and
+ * one destination page. 'left' bytes remain at 'src' (to go to 'dest');
+ * forward copies take them from the front, backward copies (overlap with
+ * dest above src) from the back.
+ */
+int64_t copy_chunk(int64_t dest, int64_t src, int64_t left, int page_size, int backward) {
+    if (!backward) {
+        int64_t chunk = page_chunk(src, left, page_size);
+        return page_chunk(dest, chunk, page_size);
+    }
+    int64_t src_room = (src + left - 1) % page_size + 1;
+    int64_t dest_room = (dest + left - 1) % page_size + 1;
+    int64_t chunk = src_room < dest_room ? src_room : dest_room;
+    return chunk < left ? chunk : left;
+}
+
+// Reads 'length' bytes at 'address' into 'dest'; 0 on success, -1 on error
+int load_range(sim_database* mem_sim, int64_t address, char* dest, int64_t length) {
+    if (check_range(mem_sim, address, length) != 0) return -1;
+    
+    while (length > 0) {
+        int64_t chunk = page_chunk(address, length, mem_sim->page_size);
+        const char* bytes = range_bytes(mem_sim, address, 0);
+        if (!bytes) return -1;
+        memcpy(dest, bytes, chunk);
+        dest += chunk;
+        address += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+// Writes 'length' bytes from 'src' at 'address'; nothing is written if any
+// page of the range is read-only
+int store_range(sim_database* mem_sim, int64_t address, const char* src, int64_t length) {
+    if (check_writable(mem_sim, address, length) != 0) return -1;
+    
+    while (length > 0) {
+        int64_t chunk = page_chunk(address, length, mem_sim->page_size);
+        char* bytes = range_bytes(mem_sim, address, 1);
+        if (!bytes) return -1;
+        memcpy(bytes, src, chunk);
+        src += chunk;
+        address += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+// Fills 'length' bytes at 'address' with 'value'
+int memset_range(sim_database* mem_sim, int64_t address, char value, int64_t length) {
+    if (check_writable(mem_sim, address, length) != 0) return -1;
+    
+    while (length > 0) {
+        int64_t chunk = page_chunk(address, length, mem_sim->page_size);
+        char* bytes = range_bytes(mem_sim, address, 1);
+        if (!bytes) return -1;
+        memset(bytes, value, chunk);
+        address += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+/**
+ * copy_range - Copies 'length' bytes from 'src' to 'dest' in the current process
+ * Overlapping ranges behave like memmove. Each piece goes through a page
+ * sized buffer, since faulting in the destination page may evict the source.
+ */
+int copy_range(sim_database* mem_sim, int64_t dest, int64_t src, int64_t length) {
+    if (check_range(mem_sim, src, length) != 0 || check_writable(mem_sim, dest, length) != 0) {
+        return -1;
+    }
+    if (length == 0) return 0;
+    
+    char* buffer = (char*)malloc(mem_sim->page_size);
+    if (!buffer) {
+        vmem_error(mem_sim, "Error allocating copy buffer: %s", strerror(errno));
+        return -1;
+    }
+    
+    int backward = dest > src && dest < src + length;
+    int rc = 0;
+    for (int64_t left = length; left > 0; ) {
+        int64_t start = backward ? 0 : length - left;   // Bytes left: [start, start + left)
+        int64_t chunk = copy_chunk(dest + start, src + start, left, mem_sim->page_size, backward);
+        int64_t offset = backward ? left - chunk : start;
+        const char* from = range_bytes(mem_sim, src + offset, 0);
+        if (!from) {
+            rc = -1;
+            break;
+        }
+        memcpy(buffer, from, chunk);
+        char* to = range_bytes(mem_sim, dest + offset, 1);
+        if (!to) {
+            rc = -1;
+            break;
+        }
+        memcpy(to, buffer, chunk);
+        left -= chunk;
+    }
+    free(buffer);
+    return rc;
+}
+
+void clear_system(sim_database* mem_sim) {
+    if (!mem_sim) return;
+    
+    // Finish queued writebacks while the swap file is still open; pages
+    // still in the compressed tier are dropped with the simulation
+    zswap_destroy(mem_sim);
+    writeback_destroy(mem_sim);
+    ws_destroy(mem_sim);
+    if (mem_sim->snapshot_out && mem_sim->snapshot_out != stdout) {
+        fclose(mem_sim->snapshot_out);
+    }
+    
+    // Free every address space
+    for (int asid = 0; asid < mem_sim->num_procs; asid++) {
+        free_process(mem_sim->procs[asid]);
+    }
+    free(mem_sim->procs);
+    inverted_destroy(mem_sim);
+    
+    // Free main memory, writing out any batched messages first
+    free(mem_sim->main_memory);
+    if (mem_sim->out_buf) {
+        vmem_flush(mem_sim);
+        free(mem_sim->out_buf);
+    }
+    
+    // Unmap and close the swap file
+    if (mem_sim->swap_map) {
+        munmap(mem_sim->swap_map, mem_sim->swap_size);
+    }
+    if (mem_sim->swapfile_fd >= 0) {
+        close(mem_sim->swapfile_fd);
+    }
+    
+    // Free the frame manager and swap allocator
+    free(mem_sim->free_frames);
+    free(mem_sim->frame_owner);
+    free(mem_sim->frame_asid);
+    free(mem_sim->frame_prefetched);
+    if (mem_sim->policy_state) {
+        mem_sim->policy->destroy(mem_sim);
+    }
+    free(mem_sim->swap_bitmap);
+    free(mem_sim->ra_frames);
+    free(mem_sim->ra_slots);
+    free(mem_sim->ra_iov);
+    
+    // Free the TLB levels
+    free(mem_sim->tlb.entries);
+    free(mem_sim->tlb2.entries);
+    
+    // Free the main structure
+    free(mem_sim);
+}
+/* ---- Checkpoint and restore ---- */
+
+#define CKPT_MAGIC   "VMCK"
+#define CKPT_VERSION 4
+
+/**
+ * ckpt_header - First bytes of a checkpoint image
+ * Images hold raw host structures, so they are only meant to be restored
+ * by the same build on the same machine. The settings that size the
+ * simulator's tables must match the simulator they are restored into.
+ */
+typedef struct {
+    char magic[4];
+    int version;
+    uint64_t image_bytes;         // Whole file, checked before anything is restored
+    int page_size;
+    int memory_size;
+    int swap_size;
+    int tlb_sets, tlb_ways;
+    int tlb2_sets, tlb2_ways;
+    int pt_type;
+    int ws_window;
+    int readahead;
+    long zswap_size;
+    char policy[32];
+    int num_procs;
+    int current;                  // ASID of the current process
+} ckpt_header;
+
+// A process's layout and counters; its page table follows
+typedef struct {
+    char program_name[256];
+    int text_size;
+    int data_size;
+    int bss_size;
+    int64_t heap_stack_size;
+    int64_t num_pages;
+    long accesses;
+    long faults;
+    long evictions;
+    long stolen;
+    int64_t ra_next;
+    int ra_size;
+} ckpt_process;
+
+static void ckpt_fill_header(sim_database* mem_sim, ckpt_header* h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, CKPT_MAGIC, 4);
+    h->version = CKPT_VERSION;
+    h->page_size = mem_sim->page_size;
+    h->memory_size = mem_sim->memory_size;
+    h->swap_size = mem_sim->swap_size;
+    h->tlb_sets = mem_sim->tlb.sets;
+    h->tlb_ways = mem_sim->tlb.ways;
+    h->tlb2_sets = mem_sim->tlb2.sets;
+    h->tlb2_ways = mem_sim->tlb2.ways;
+    h->pt_type = mem_sim->pt_type;
+    h->ws_window = mem_sim->ws ? mem_sim->ws_window : 0;
+    h->readahead = mem_sim->readahead;
+    h->zswap_size = mem_sim->zswap_size;
+    snprintf(h->policy, sizeof(h->policy), "%s", mem_sim->policy->name);
+    h->num_procs = mem_sim->num_procs;
+    h->current = mem_sim->proc->asid;
+}
+
+// Leaves of a radix tree as (first page, descriptors) records
+static void ckpt_radix_leaves(ckpt_io* io, void* node, int level, int64_t base) {
+    if (!node) return;
+    if (level == 0) {
+        ckpt_bytes(io, &base, sizeof(base));
+        ckpt_bytes(io, node, PT_RADIX_FANOUT * sizeof(page_descriptor));
+        return;
+    }
+    for (int i = 0; i < PT_RADIX_FANOUT; i++) {
+        ckpt_radix_leaves(io, ((void**)node)[i], level - 1,
+                          base | ((int64_t)i << (level * PT_RADIX_BITS)));
+    }
+}
+
+static void ckpt_page_table(sim_database* mem_sim, ckpt_io* io, vmem_process* proc) {
+    if (mem_sim->pt_type == PT_FLAT) {
+        ckpt_bytes(io, proc->page_table, proc->num_pages * sizeof(page_descriptor));
+        return;
+    }
+    if (mem_sim->pt_type != PT_RADIX) return;  // The inverted table is shared
+    
+    int64_t base = -1;
+    if (io->out) {
+        ckpt_radix_leaves(io, proc->pt_root, proc->pt_levels - 1, 0);
+        ckpt_bytes(io, &base, sizeof(base));
+        return;
+    }
+    free_page_table(proc);
+    for (;;) {
+        ckpt_bytes(io, &base, sizeof(base));
+        if (io->failed || base == -1) break;
+        page_descriptor* leaf = (base >= 0 && base < proc->num_pages && !(base & (PT_RADIX_FANOUT - 1))) ?
+                                radix_walk(mem_sim, proc, base, 1) : NULL;
+        if (!leaf) {
+            io->failed = 1;
+            break;
+        }
+        ckpt_bytes(io, leaf, PT_RADIX_FANOUT * sizeof(page_descriptor));
+    }
+}
+
+static void ckpt_inverted(sim_database* mem_sim, ckpt_io* io) {
+    inverted_table* ipt = mem_sim->ipt;
+    ckpt_bytes(io, ipt->pte, ipt->capacity * sizeof(page_descriptor));
+    ckpt_bytes(io, ipt->page, ipt->capacity * sizeof(int64_t));
+    ckpt_bytes(io, ipt->asid, ipt->capacity * sizeof(int));
+    ckpt_bytes(io, ipt->chain, ipt->capacity * sizeof(int));
+    ckpt_bytes(io, ipt->free_entries, ipt->capacity * sizeof(int));
+    ckpt_bytes(io, ipt->buckets, (ipt->mask + 1) * sizeof(int));
+    ckpt_bytes(io, &ipt->free_count, sizeof(ipt->free_count));
+}
+
+// Used swap slots in slot order; free slots are not stored
+static void ckpt_swap(sim_database* mem_sim, ckpt_io* io, char* page) {
+    int words = (mem_sim->num_swap_slots + 63) / 64;
+    ckpt_bytes(io, mem_sim->swap_bitmap, words * sizeof(uint64_t));
+    ckpt_bytes(io, &mem_sim->swap_slots_used, sizeof(mem_sim->swap_slots_used));
+    ckpt_bytes(io, &mem_sim->swap_hint, sizeof(mem_sim->swap_hint));
+    ckpt_bytes(io, &mem_sim->swap_cursor, sizeof(mem_sim->swap_cursor));
+    
+    for (int slot = 0; slot < mem_sim->num_swap_slots && !io->failed; slot++) {
+        if (!(mem_sim->swap_bitmap[slot / 64] >> (slot % 64) & 1)) continue;
+        off_t offset = (off_t)slot * mem_sim->page_size;
+        if (!io->out && !mem_sim->swap_sized && swap_open(mem_sim) != 0) {
+            io->failed = 1;
+            break;
+        }
+        if (mem_sim->swap_map) {
+            ckpt_bytes(io, mem_sim->swap_map + offset, mem_sim->page_size);
+        } else if (io->out) {
+            if (pread(mem_sim->swapfile_fd, page, mem_sim->page_size, offset) != mem_sim->page_size) {
+                memset(page, 0, mem_sim->page_size);  // Never written: a sparse hole
+            }
+            ckpt_bytes(io, page, mem_sim->page_size);
+        } else {
+            ckpt_bytes(io, page, mem_sim->page_size);
+            if (!io->failed && pwrite(mem_sim->swapfile_fd, page, mem_sim->page_size, offset) !=
+                                   mem_sim->page_size) {
+                vmem_error(mem_sim, "Error writing to swap file: %s", strerror(errno));
+                io->failed = 1;
+            }
+        }
+    }
+}
+
+// The compressed tier: LRU links, then each stored page from the most recent
+static void ckpt_zswap(sim_database* mem_sim, ckpt_io* io) {
+    zswap_tier* tier = mem_sim->zswap;
+    int n = mem_sim->num_swap_slots + 1;
+    if (!io->out) {
+        for (int slot = 0; slot < n; slot++) {
+            free(tier->data[slot]);
+            tier->data[slot] = NULL;
+        }
+    }
+    ckpt_bytes(io, tier->length, n * sizeof(int));
+    ckpt_bytes(io, tier->prev, n * sizeof(int));
+    ckpt_bytes(io, tier->next, n * sizeof(int));
+    ckpt_bytes(io, &tier->head, sizeof(tier->head));
+    ckpt_bytes(io, &tier->tail, sizeof(tier->tail));
+    ckpt_bytes(io, &tier->used, sizeof(tier->used));
+    
+    for (int slot = tier->head; slot != -1 && !io->failed; slot = tier->next[slot]) {
+        if (slot < 0 || slot >= n || tier->length[slot] <= 0 ||
+            tier->length[slot] >= mem_sim->page_size) {
+            io->failed = 1;
+            break;
+        }
+        if (!io->out && !(tier->data[slot] = (unsigned char*)malloc(tier->length[slot]))) {
+            io->failed = 1;
+            break;
+        }
+        ckpt_bytes(io, tier->data[slot], tier->length[slot]);
+    }
+}
+
+static void ckpt_ws(sim_database* mem_sim, ckpt_io* io) {
+    ws_tracker* ws = mem_sim->ws;
+    int n = ws->window;
+    ckpt_bytes(io, ws->ring_page, n * sizeof(int64_t));
+    ckpt_bytes(io, ws->ring_asid, n * sizeof(int));
+    ckpt_bytes(io, ws->page, n * sizeof(int64_t));
+    ckpt_bytes(io, ws->asid, n * sizeof(int));
+    ckpt_bytes(io, ws->last, n * sizeof(long));
+    ckpt_bytes(io, ws->chain, n * sizeof(int));
+    ckpt_bytes(io, ws->buckets, (ws->mask + 1) * sizeof(int));
+    ckpt_bytes(io, ws->free_entries, n * sizeof(int));
+    ckpt_bytes(io, &ws->free_count, sizeof(ws->free_count));
+    ckpt_bytes(io, &ws->size, sizeof(ws->size));
+    ckpt_bytes(io, &ws->peak, sizeof(ws->peak));
+}
+
+/**
+ * ckpt_state - The image after its header and process records
+ * Page tables, frame tables, TLBs, policy state, swap slots and their
+ * contents, the compressed tier, the working set and the counters, then
+ * main memory on a page boundary so restores can map it in place.
+ */
+static void ckpt_state(sim_database* mem_sim, ckpt_io* io, char* page) {
+    for (int asid = 0; asid < mem_sim->num_procs; asid++) {
+        ckpt_page_table(mem_sim, io, mem_sim->procs[asid]);
+    }
+    if (mem_sim->ipt) ckpt_inverted(mem_sim, io);
+    
+    int n = mem_sim->num_frames;
+    ckpt_bytes(io, mem_sim->free_frames, n * sizeof(int));
+    ckpt_bytes(io, &mem_sim->free_frame_count, sizeof(mem_sim->free_frame_count));
+    ckpt_bytes(io, mem_sim->frame_owner, n * sizeof(int64_t));
+    ckpt_bytes(io, mem_sim->frame_asid, n * sizeof(int));
+    ckpt_bytes(io, mem_sim->frame_prefetched, n);
+    
+    ckpt_bytes(io, mem_sim->tlb.entries,
+               (size_t)mem_sim->tlb.sets * mem_sim->tlb.ways * sizeof(tlb_entry));
+    ckpt_bytes(io, mem_sim->tlb2.entries,
+               (size_t)mem_sim->tlb2.sets * mem_sim->tlb2.ways * sizeof(tlb_entry));
+    ckpt_bytes(io, &mem_sim->access_clock, sizeof(mem_sim->access_clock));
+    
+    mem_sim->policy->serialize(mem_sim, io);
+    ckpt_swap(mem_sim, io, page);
+    if (mem_sim->zswap) ckpt_zswap(mem_sim, io);
+    if (mem_sim->ws) ckpt_ws(mem_sim, io);
+    ckpt_bytes(io, &mem_sim->stats, sizeof(mem_sim->stats));
+    ckpt_bytes(io, &mem_sim->time, sizeof(mem_sim->time));
+    ckpt_bytes(io, &mem_sim->snapshot_last, sizeof(mem_sim->snapshot_last));
+    
+    ckpt_bytes(io, mem_sim->main_memory, mem_sim->memory_size);
+}
+
+/**
+ * checkpoint_system - Writes the whole simulator state to an image file
+ * Queued writebacks are flushed first, so the swap contents are complete.
+ * The image is written next to 'path' and renamed over it once complete,
+ * so a failed checkpoint leaves any older image intact.
+ * Returns 0 on success, -1 (after reporting why) on failure.
+ */
+int checkpoint_system(sim_database* mem_sim, const char* path) {
+    if (writeback_drain(mem_sim) > 0) {
+        vmem_error(mem_sim, "Error: Dirty pages could not be written to swap, checkpoint not taken");
+        return -1;
+    }
+    
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+        vmem_error(mem_sim, "Error: Checkpoint path too long: %s", path);
+        return -1;
+    }
+    FILE* out = fopen(tmp_path, "wb");
+    char* page = (char*)malloc(mem_sim->page_size);
+    if (!out || !page) {
+        vmem_error(mem_sim, "Error creating checkpoint: %s", strerror(errno));
+        if (out) fclose(out);
+        free(page);
+        return -1;
+    }
+    
+    ckpt_io io = {out, NULL, 0, 0, 0};
+    ckpt_header header;
+    ckpt_fill_header(mem_sim, &header);
+    ckpt_bytes(&io, &header, sizeof(header));
+    for (int asid = 0; asid < mem_sim->num_procs; asid++) {
+        vmem_process* proc = mem_sim->procs[asid];
+        ckpt_process rec;
+        memset(&rec, 0, sizeof(rec));
+        memcpy(rec.program_name, proc->program_name, sizeof(rec.program_name));
+        rec.text_size = proc->text_size;
+        rec.data_size = proc->data_size;
+        rec.bss_size = proc->bss_size;
+        rec.heap_stack_size = proc->heap_stack_size;
+        rec.num_pages = proc->num_pages;
+        rec.accesses = proc->accesses;
+        rec.faults = proc->faults;
+        rec.evictions = proc->evictions;
+        rec.stolen = proc->stolen;
+        rec.ra_next = proc->ra_next;
+        rec.ra_size = proc->ra_size;
+        ckpt_bytes(&io, &rec, sizeof(rec));
+    }
+    ckpt_state(mem_sim, &io, page);
+    free(page);
+    
+    // The size goes into the header last
+    header.image_bytes = io.pos;
+    if (!io.failed && (fseek(out, 0, SEEK_SET) != 0 ||
+                       fwrite(&header, sizeof(header), 1, out) != 1)) {
+        io.failed = 1;
+    }
+    if (fclose(out) != 0) io.failed = 1;
+    if (io.failed || rename(tmp_path, path) != 0) {
+        vmem_error(mem_sim, "Error: Cannot write checkpoint %s", path);
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Refuse images whose tables would not fit this simulator
+static int ckpt_check_header(sim_database* mem_sim, const ckpt_header* image, size_t size,
+                             const char* path) {
+    ckpt_header own;
+    ckpt_fill_header(mem_sim, &own);
+    
+    const char* mismatch = NULL;
+    if (size < sizeof(*image) || memcmp(image->magic, CKPT_MAGIC, 4) != 0 ||
+        image->version != CKPT_VERSION || image->image_bytes != size) mismatch = "format";
+    else if (image->page_size != own.page_size) mismatch = "page size";
+    else if (image->memory_size != own.memory_size) mismatch = "memory size";
+    else if (image->swap_size != own.swap_size) mismatch = "swap size";
+    else if (image->tlb_sets != own.tlb_sets || image->tlb_ways != own.tlb_ways ||
+             image->tlb2_sets != own.tlb2_sets || image->tlb2_ways != own.tlb2_ways) mismatch = "tlb";
+    else if (image->pt_type != own.pt_type) mismatch = "pagetable";
+    else if (image->ws_window != own.ws_window) mismatch = "ws_window";
+    else if (image->readahead != own.readahead) mismatch = "readahead";
+    else if (image->zswap_size != own.zswap_size) mismatch = "zswap";
+    else if (strncmp(image->policy, own.policy, sizeof(own.policy)) != 0) mismatch = "policy";
+    else if (image->num_procs < own.num_procs || image->current < 0 ||
+             image->current >= image->num_procs) mismatch = "processes";
+    
+    if (mismatch) {
+        vmem_error(mem_sim, "Error: Checkpoint %s does not match this simulator (%s)", path, mismatch);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * restore_system - Replaces the simulator state with a checkpoint image
+ * The image is mapped only while it is parsed: main memory is copied out of
+ * it, so the restored simulator shares nothing with the file and a later
+ * checkpoint may overwrite it. Processes spawned after the simulator was
+ * created are spawned again.
+ */
+int restore_system(sim_database* mem_sim, const char* path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        vmem_error(mem_sim, "Error opening checkpoint: %s", strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    char* image = (st.st_size > 0) ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (image == MAP_FAILED) {
+        vmem_error(mem_sim, "Error: Cannot map checkpoint %s", path);
+        close(fd);
+        return -1;
+    }
+    
+    ckpt_io io = {NULL, image, st.st_size, 0, 0};
+    ckpt_header header;
+    ckpt_bytes(&io, &header, sizeof(header));
+    if (io.failed || ckpt_check_header(mem_sim, &header, st.st_size, path) != 0) {
+        munmap(image, st.st_size);
+        close(fd);
+        return -1;
+    }
+    
+    // Processes: those already here must be the same programs, the rest are spawned
+    int rc = 0;
+    for (int asid = 0; asid < header.num_procs && rc == 0; asid++) {
+        ckpt_process rec;
+        ckpt_bytes(&io, &rec, sizeof(rec));
+        rec.program_name[sizeof(rec.program_name) - 1] = '\0';
+        vmem_process* proc = (asid < mem_sim->num_procs) ? mem_sim->procs[asid] :
+            create_process(mem_sim, rec.program_name, rec.text_size, rec.data_size,
+                           rec.bss_size, rec.heap_stack_size, rec.num_pages);
+        if (io.failed || !proc || strcmp(proc->program_name, rec.program_name) != 0 ||
+            proc->text_size != rec.text_size || proc->data_size != rec.data_size ||
+            proc->bss_size != rec.bss_size || proc->num_pages != rec.num_pages) {
+            vmem_error(mem_sim, "Error: Checkpoint %s process %d does not match this simulator",
+                        path, asid);
+            rc = -1;
+            break;
+        }
+        proc->accesses = rec.accesses;
+        proc->faults = rec.faults;
+        proc->evictions = rec.evictions;
+        proc->stolen = rec.stolen;
+        proc->ra_next = rec.ra_next;
+        proc->ra_size = rec.ra_size;
+    }
+    
+    // Writes still queued belong to the state being replaced
+    writeback_drain(mem_sim);
+    writeback_discard(mem_sim);
+    char* page = (char*)malloc(mem_sim->page_size);
+    if (rc == 0 && page) {
+        ckpt_state(mem_sim, &io, page);
+        rc = io.failed ? -1 : 0;
+        if (rc != 0) {
+            vmem_error(mem_sim, "Error: Checkpoint %s is damaged; the simulator state is incomplete", path);
+        }
+    } else if (rc == 0) {
+        vmem_error(mem_sim, "Error restoring checkpoint: %s", strerror(errno));
+        rc = -1;
+    }
+    free(page);
+    
+    if (rc == 0) mem_sim->proc = mem_sim->procs[header.current];
+    
+    munmap(image, st.st_size);
+    close(fd);
+    return rc;
+}
+
+/* ---- Library interface ---- */
+
+// Copies the event counters under the writeback lock, so an async flusher's
+// updates are never seen half done
+void vmem_get_stats(vmem_handle* handle, vmem_stats* stats) {
+    writeback_pending(handle, stats, NULL);
+}
+
+// Flushes pending writebacks and releases everything the handle owns
+void vmem_destroy(vmem_handle* handle) {
+    clear_system(handle);
+}
+
+const char* vmem_strerror(int status) {
+    switch (status) {
+        case VMEM_OK:           return "Success";
+        case VMEM_ERR_CONFIG:   return "Invalid configuration";
+        case VMEM_ERR_RANGE:    return "Address out of range";
+        case VMEM_ERR_READONLY: return "Write to read-only segment";
+        case VMEM_ERR_FAULT:    return "Page could not be loaded";
+        default:                return "Unknown error";
+    }
+}
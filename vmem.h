@@ -0,0 +1,128 @@
+/**
+ * vmem.h - Embeddable virtual memory simulator
+ * Every simulation is one handle: nothing is shared between handles, so
+ * several can run side by side, each on its own thread. Accesses return
+ * status codes; nothing is printed: per-access messages (with
+ * config.verbose) and error details go to the config's callbacks.
+ *
+ *     vmem_config config = {"prog.exe", "swap.swp", 4096, 4096, 4096, 16384,
+ *                           256, 128, 4096, 8192, "policy=clock tlb=64", 0};
+ *     vmem_handle* vm;
+ *     if (vmem_create(&config, &vm) == VMEM_OK) {
+ *         char value = 'x';
+ *         vmem_access(vm, 8192, VMEM_STORE, &value);
+ *         vmem_destroy(vm);
+ *     }
+ */
+#ifndef VMEM_H
+#define VMEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Status codes
+#define VMEM_OK            0
+#define VMEM_ERR_CONFIG   -1      // Invalid settings, or a file or buffer could not be set up
+#define VMEM_ERR_RANGE    -2      // Address outside the address space
+#define VMEM_ERR_READONLY -3      // Store to a read-only (TEXT) page
+#define VMEM_ERR_FAULT    -4      // The page could not be given a frame or a descriptor
+
+// Access types
+#define VMEM_LOAD  0
+#define VMEM_STORE 1
+
+/**
+ * vmem_config - Layout of process 0 and the simulated machine
+ * The same fields, in the same order, as a script's init line; 'options'
+ * takes that line's optional "key=value ..." settings (NULL for defaults).
+ */
+typedef struct {
+    const char* program;          // Backs TEXT and DATA pages
+    const char* swap;             // Created (or truncated) as a sparse file
+    int text_size;
+    int data_size;
+    int bss_size;
+    int64_t heap_stack_size;
+    int page_size;
+    int64_t num_pages;            // Size of the address space in pages
+    int memory_size;
+    int swap_size;
+    const char* options;
+    int verbose;                  // Per-access messages (TLB hits, faults) to 'message'
+    
+    // Diagnostics, dropped when NULL. 'message' gets batched per-access text;
+    // 'error' gets one line (no newline) per error. With wb=async, failed
+    // queued writes are reported from the writeback thread, possibly while
+    // vmem_access runs, so 'error' must be safe to call from another thread
+    void (*message)(void* data, const char* text, size_t length);
+    void (*error)(void* data, const char* text);
+    void* callback_data;
+} vmem_config;
+
+// Simulator event counters
+typedef struct {
+    long accesses;
+    long faults;
+    long faults_program;          // TEXT/DATA pages read from the program file
+    long faults_swap;             // Dirty pages read back from swap
+    long faults_new;              // BSS/heap/stack pages zero-filled
+    long faults_zswap;            // Swap faults served by the compressed tier
+    long evictions;
+    long writebacks;
+    long swap_outs;
+    long swap_ins;
+    long tlb_hits;
+    long tlb_misses;
+    long tlb2_hits;
+    long tlb2_misses;
+    long tlb_shootdowns;
+    long wb_writes;               // Write calls issued for dirty pages
+    long wb_pages;                // Pages those calls wrote
+    long wb_absorbed;             // Queued pages faulted back before being written
+    long wb_stalls;               // Faults that waited on a write
+    long wb_stall_ns;             // Time faults spent waiting on writes
+    long wb_errors;               // Queued writes that failed; their pages stay queued
+    long ra_windows;              // Sequential faults that read ahead
+    long ra_pages;                // Pages loaded ahead of their first access
+    long ra_reads;                // Read calls (or mapped runs) that loaded them
+    long ra_useful;               // Prefetched pages accessed before eviction
+    long ra_wasted;               // Prefetched pages evicted without an access
+    long pt_bytes;                // Host memory held by page tables
+    long zswap_stores;            // Dirty victims kept compressed in RAM
+    long zswap_rejects;           // ...that did not compress and went to disk
+    long zswap_hits;              // Swap-ins served by the tier (faults and read-ahead)
+    long zswap_spills;            // Tier pages written to disk to make room
+    long zswap_bytes_in;          // Page bytes stored in the tier
+    long zswap_bytes_out;         // ...and what they compressed to
+    long seg_faults[4];           // Faults by segment (PTE_SEG_TEXT ... PTE_SEG_HEAP_STACK)
+    long seg_evictions[4];        // Evictions by segment of the victim
+} vmem_stats;
+
+/**
+ * vmem_time - Modeled time of a run in ns, by category
+ * Charged as each access runs: its TLB lookups and one memory reference,
+ * plus a page table walk if it missed every TLB level; faults add their
+ * disk reads and evictions their writes. Latencies come from the cost_*
+ * options in force when the step ran.
+ */
+typedef struct {
+    double tlb;
+    double walk;
+    double mem;
+    double disk_read;
+    double disk_write;
+    double zswap;
+    double total;                 // Sum of the above: simulated time of the run
+    double background;            // Async writeback, overlapped with accesses (not in total)
+} vmem_time;
+
+typedef struct sim_database vmem_handle;
+
+int vmem_create(const vmem_config* config, vmem_handle** handle);
+int vmem_access(vmem_handle* handle, int64_t address, int op, char* value);
+void vmem_get_stats(vmem_handle* handle, vmem_stats* stats);
+double vmem_access_time(vmem_handle* handle, vmem_time* time);
+void vmem_destroy(vmem_handle* handle);
+const char* vmem_strerror(int status);
+
+#endif
@@ -0,0 +1,294 @@
+/**
+ * vmem_internal.h - Simulator internals shared by vmem.c and the shell's vmem tools
+ * Embedders use vmem.h only; the script runner, sweeps, mrc, gen, bench
+ * and smp drive the same structures directly.
+ */
+#ifndef VMEM_INTERNAL_H
+#define VMEM_INTERNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "vmem.h"
+
+/**
+ * page_descriptor - Packed page table entry
+ * Flags, segment and the frame-or-slot field share one 64-bit word, so a
+ * 512-entry radix leaf fills a 4 KB page. Building with -DVMEM_PTE32 packs
+ * it into 32 bits instead, which limits frames and swap slots to 2^25.
+ */
+#ifdef VMEM_PTE32
+typedef uint32_t pte_bits;
+typedef int32_t pte_field;
+#define PTE_FRAME_BITS 26
+#else
+typedef uint64_t pte_bits;
+typedef int64_t pte_field;
+#define PTE_FRAME_BITS 58
+#endif
+#define PTE_FRAME_MAX ((int64_t)1 << (PTE_FRAME_BITS - 1))  // Frames or slots it can address
+
+#define PTE_SEG_TEXT       0
+#define PTE_SEG_DATA       1
+#define PTE_SEG_BSS        2
+#define PTE_SEG_HEAP_STACK 3
+
+typedef struct {
+    pte_bits V : 1;               // Valid: the page is in a frame
+    pte_bits D : 1;               // Dirty: its contents live in swap once evicted
+    pte_bits P : 1;               // Permission (1=read-only, 0=read-write)
+    pte_bits A : 1;               // Accessed through the page table since its fault
+    pte_bits seg : 2;             // PTE_SEG_*
+    pte_field frame_swap : PTE_FRAME_BITS;  // Frame if V, swap slot if D, else -1 or stale
+} page_descriptor;
+
+// Page I/O backends for the program and swap files
+#define VMEM_IO_SYSCALL 0         // pread/pwrite per page
+#define VMEM_IO_MMAP    1         // memcpy to/from mapped files
+
+// Swap slot allocation policies
+#define SWAP_FIRST_FIT 0
+#define SWAP_NEXT_FIT  1
+
+// Page table organisations
+#define PT_FLAT     0             // One descriptor per page, allocated up front
+#define PT_RADIX    1             // Radix tree of 512-entry nodes, built on first touch
+#define PT_INVERTED 2             // One hash table for every process, sized by frames and swap
+
+// Dirty page writeback modes
+#define WRITEBACK_SYNC  0         // Write each victim inside the fault
+#define WRITEBACK_BATCH 1         // Queue victims, flush coalesced runs when full
+#define WRITEBACK_ASYNC 2         // Queue victims, a flusher thread writes them
+
+
+/**
+ * replacement_policy - Page replacement algorithm plugged in behind load()
+ * Policies track resident frames only. on_fault runs at the start of every
+ * page fault and before each read-ahead page is inserted, select_victim is called only when no frame is free and must
+ * return a resident frame that it has dropped from its own bookkeeping.
+ * serialize passes every piece of the state to ckpt_bytes() for checkpoints.
+ */
+struct sim_database;
+struct ckpt_io;
+typedef struct {
+    const char* name;
+    int  (*init)(struct sim_database* mem_sim);
+    void (*destroy)(struct sim_database* mem_sim);
+    void (*on_fault)(struct sim_database* mem_sim, int64_t page_num);   // optional
+    void (*on_insert)(struct sim_database* mem_sim, int frame);
+    void (*on_access)(struct sim_database* mem_sim, int frame);
+    int  (*select_victim)(struct sim_database* mem_sim);
+    void (*serialize)(struct sim_database* mem_sim, struct ckpt_io* io);
+} replacement_policy;
+
+
+typedef struct {
+    int64_t page_number;
+    uint64_t timestamp;
+    int frame_number;
+    unsigned asid : 31;           // Address space the translation belongs to
+    unsigned valid : 1;
+} tlb_entry;
+
+// One level of a set-associative TLB: sets * ways entries, set after set
+typedef struct {
+    tlb_entry* entries;
+    int sets;
+    int ways;
+} tlb_level;
+
+/**
+ * vmem_process - One simulated address space
+ * Each process has its own program file, segments and page table; all of
+ * them share the frames in main_memory and the swap file. The ASID is the
+ * process's index in sim_database.procs and tags its TLB entries.
+ */
+typedef struct {
+    int asid;
+    char program_name[256];
+    page_descriptor* page_table;  // PT_FLAT: one descriptor per page
+    void* pt_root;                // PT_RADIX: top node, NULL until the first touch
+    int pt_levels;                // PT_RADIX: depth of the tree
+    int program_fd;
+    char* program_map;            // Read-only mapping of the program file
+    size_t program_map_size;
+    int text_size;
+    int data_size;
+    int bss_size;
+    int64_t heap_stack_size;
+    int64_t num_pages;            // Size of the address space; may be sparse
+    
+    long accesses;
+    long faults;
+    long evictions;               // Pages of this process that were evicted
+    long stolen;                  // ...to make room for another process
+    
+    int64_t ra_next;              // Fault on this page continues a sequential run
+    int ra_size;                  // Current read-ahead window in pages (0: none yet)
+} vmem_process;
+
+// Modeled latencies in ns, set with the cost_* init options
+typedef struct {
+    double tlb;                   // L1 TLB lookup
+    double tlb2;                  // L2 TLB lookup after an L1 miss
+    double mem;                   // The access's own memory reference
+    double walk;                  // Page table walk after a miss in every TLB level
+    double disk_read;             // Reading a page (or a read-ahead run) from disk
+    double disk_write;            // One write call to swap (a coalesced run in batch mode)
+    double zswap;                 // Compressing or decompressing a page in RAM
+} vmem_costs;
+
+typedef struct sim_database {
+    vmem_process** procs;         // Address spaces, indexed by ASID
+    int num_procs;
+    vmem_process* proc;           // Current process
+    int swapfile_fd;              // Created empty by vmem_create()
+    int swap_sized;               // Set once the first swap-out sized (and mapped) it
+    char swap_path[256];
+    int io_mode;                  // VMEM_IO_MMAP or VMEM_IO_SYSCALL
+    char* swap_map;               // Shared mapping of the swap file
+    char* main_memory;            
+    
+    tlb_level tlb;                // First-level TLB (no entries when disabled)
+    tlb_level tlb2;               // Optional second-level TLB
+    
+    int page_size;
+    int memory_size;
+    int swap_size;
+    int num_frames;
+    int tlb_size;
+    int tlb_ways;
+    int tlb2_size;
+    int tlb2_ways;
+    
+    int* free_frames;             // Stack of unused frame numbers
+    int free_frame_count;
+    int64_t* frame_owner;         // Frame -> page currently loaded there (-1 if free)
+    int* frame_asid;              // Frame -> ASID of that page
+    uint64_t access_clock;        // Logical time for TLB timestamps
+    
+    int pt_type;                  // PT_FLAT, PT_RADIX or PT_INVERTED
+    struct inverted_table* ipt;   // Shared table for PT_INVERTED
+    
+    const replacement_policy* policy;
+    void* policy_state;
+    uint64_t policy_seed;         // Seed for the random policy
+    int quiet;                    // Suppress per-access messages
+    char* out_buf;                // Per-access messages batched for one callback
+    size_t out_len;
+    void (*message)(void* data, const char* text, size_t length);
+    void (*error)(void* data, const char* text);
+    void* callback_data;
+    
+    uint64_t* swap_bitmap;        // One bit per swap slot, set when in use
+    int num_swap_slots;
+    int swap_slots_used;
+    int swap_hint;                // First-fit: no free slot below this index
+    int swap_cursor;              // Next-fit: where the last search stopped
+    int swap_fit;                 // SWAP_FIRST_FIT or SWAP_NEXT_FIT
+    
+    int wb_mode;                  // WRITEBACK_SYNC, _BATCH or _ASYNC
+    int wb_low;                   // Async: the flusher starts at this many queued pages
+    int wb_high;                  // Queue capacity: full queues flush (batch) or stall (async)
+    struct writeback_queue* wb;   // Queued dirty victims (NULL for sync writeback)
+    
+    long zswap_size;              // Compressed swap tier capacity in bytes (0: off)
+    struct zswap_tier* zswap;
+    
+    int readahead;                // Read ahead on sequential faults
+    int ra_max;                   // Largest read-ahead window in pages
+    unsigned char* frame_prefetched;  // Frame -> read ahead and not accessed since
+    int* ra_frames;               // Scratch for one window: frames,
+    int* ra_slots;                // ...swap slots still to read (-1 once loaded)
+    struct iovec* ra_iov;         // ...and the preadv() vector
+    
+    long snapshot_every;          // Emit a time-series row every N accesses (0: off)
+    int snapshot_jsonl;           // Rows as JSON lines instead of CSV
+    char snapshot_path[64];       // Where rows go, "-" for stdout
+    FILE* snapshot_out;           // Opened at the first row
+    vmem_stats snapshot_last;     // Counters at the previous row
+    int ws_window;                // Working-set window in accesses (0: not tracked)
+    vmem_costs costs;
+    struct ws_tracker* ws;
+    
+    // Called by evict_page() before the victim's D bit is read, e.g. to shoot
+    // it down from the TLBs of simulated CPUs (vmem smp); NULL when unused
+    void (*unmap_hook)(struct sim_database* mem_sim, page_descriptor* pd, int asid, int64_t page_num);
+    void* hook_data;
+    
+    vmem_stats stats;
+    vmem_time time;               // Modeled time, charged step by step as accesses run
+} sim_database;
+
+sim_database* init_system(char* script_path);
+char load(sim_database* mem_sim, int64_t address);
+int store(sim_database* mem_sim, int64_t address, char value);
+void clear_system(sim_database* mem_sim);
+int checkpoint_system(sim_database* mem_sim, const char* path);
+int restore_system(sim_database* mem_sim, const char* path);
+int text_page_count(sim_database* mem_sim, vmem_process* proc);
+int translate_page(sim_database* mem_sim, vmem_process* proc, int64_t page_num);
+int page_read_only(sim_database* mem_sim, vmem_process* proc, int64_t page_num);
+int64_t copy_chunk(int64_t dest, int64_t src, int64_t left, int page_size, int backward);
+int load_range(sim_database* mem_sim, int64_t address, char* dest, int64_t length);
+int store_range(sim_database* mem_sim, int64_t address, const char* src, int64_t length);
+int memset_range(sim_database* mem_sim, int64_t address, char value, int64_t length);
+int copy_range(sim_database* mem_sim, int64_t dest, int64_t src, int64_t length);
+const replacement_policy* find_policy(const char* name);
+int find_free_frame(sim_database* mem_sim);
+int find_free_swap_slot(sim_database* mem_sim);
+void release_swap_slot(sim_database* mem_sim, int slot);
+int swap_fragments(sim_database* mem_sim);
+int parse_init_options(sim_database* mem_sim, const char* options);
+void print_memory(sim_database* mem_sim);
+void print_swap(sim_database* mem_sim);
+void print_page_table(sim_database* mem_sim);
+void print_tlb(sim_database* mem_sim);
+void print_stats(sim_database* mem_sim);
+int writeback_init(sim_database* mem_sim);
+int writeback_enqueue(sim_database* mem_sim, int slot, const char* page);
+int writeback_reclaim(sim_database* mem_sim, int slot, char* dest);
+int writeback_pending(sim_database* mem_sim, vmem_stats* snapshot, vmem_time* time);
+int writeback_peek(sim_database* mem_sim, int slot, char* dest);
+int writeback_drain(sim_database* mem_sim);
+void writeback_destroy(sim_database* mem_sim);
+int zswap_init(sim_database* mem_sim);
+int zswap_store(sim_database* mem_sim, int slot, const char* page);
+int zswap_load(sim_database* mem_sim, int slot, char* dest, int keep);
+long zswap_used(sim_database* mem_sim);
+void zswap_destroy(sim_database* mem_sim);
+int ws_init(sim_database* mem_sim);
+void ws_destroy(sim_database* mem_sim);
+long ws_size(sim_database* mem_sim, long* peak);
+void write_snapshot(sim_database* mem_sim);
+void finish_snapshots(sim_database* mem_sim);
+void vmem_log(sim_database* mem_sim, const char* fmt, ...);
+void vmem_flush(sim_database* mem_sim);
+void vmem_error(sim_database* mem_sim, const char* fmt, ...);
+void vmem_print_message(void* data, const char* text, size_t length);
+void vmem_print_error(void* data, const char* text);
+vmem_process* create_process(sim_database* mem_sim, const char* exe_file_name,
+                             int text_size, int data_size, int bss_size,
+                             int64_t heap_stack_size, int64_t num_pages);
+void free_process(vmem_process* proc);
+int switch_process(sim_database* mem_sim, int asid);
+page_descriptor* find_descriptor(sim_database* mem_sim, vmem_process* proc, int64_t page_num);
+page_descriptor* get_descriptor(sim_database* mem_sim, vmem_process* proc, int64_t page_num);
+void release_descriptor(sim_database* mem_sim, vmem_process* proc, int64_t page_num);
+int inverted_init(sim_database* mem_sim);
+void inverted_destroy(sim_database* mem_sim);
+int save_page_to_swap(sim_database* mem_sim, vmem_process* proc, int64_t page_num);
+int evict_page(sim_database* mem_sim);
+void load_page_from_program(sim_database* mem_sim, vmem_process* proc, int64_t page_num,
+                            char* dest, off_t base_offset);
+void load_page_from_swap(sim_database* mem_sim, vmem_process* proc, int64_t page_num, char* dest);
+void readahead_fault(sim_database* mem_sim, vmem_process* proc, int64_t page_num);
+int init_tlb_level(sim_database* mem_sim, tlb_level* level, int entries, int ways);
+int tlb_level_lookup(uint64_t* clock, tlb_level* level, int asid, int64_t page_num);
+void tlb_level_insert(uint64_t* clock, tlb_level* level, int asid, int64_t page_num, int frame_num);
+int tlb_level_invalidate(tlb_level* level, int asid, int64_t page_num);
+int check_tlb(sim_database* mem_sim, int64_t page_num);
+void add_to_tlb(sim_database* mem_sim, int64_t page_num, int frame_num);
+void remove_from_tlb(sim_database* mem_sim, int asid, int64_t page_num);
+
+#endif
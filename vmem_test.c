@@ -0,0 +1,247 @@
+/**
+ * vmem_test.c - Checks the simulator through vmem.h alone
+ * Builds without the shell or vmem_internal.h, so it also shows that the
+ * public header is enough to embed the library:
+ *
+ *     gcc -o vmem_test vmem_test.c vmem.c -lpthread -D_GNU_SOURCE
+ *
+ * Every check prints one line; the exit status is the number that failed.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "vmem.h"
+
+#define PROGRAM_FILE "vmem_test.prog"
+#define SWAP_FILE    "vmem_test.swp"
+
+// What the callbacks received
+typedef struct {
+    size_t message_bytes;
+    int errors;
+    char last_error[256];
+} diagnostics;
+
+static int failures = 0;
+
+static void check(int ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+    if (!ok) failures++;
+}
+
+static void on_message(void* data, const char* text, size_t length) {
+    (void)text;
+    ((diagnostics*)data)->message_bytes += length;
+}
+
+static void on_error(void* data, const char* text) {
+    diagnostics* d = (diagnostics*)data;
+    d->errors++;
+    snprintf(d->last_error, sizeof(d->last_error), "%s", text);
+}
+
+// 64-byte TEXT and DATA, each byte its own offset
+static int write_program(void) {
+    FILE* f = fopen(PROGRAM_FILE, "wb");
+    if (!f) return -1;
+    for (int i = 0; i < 128; i++) fputc(i, f);
+    return fclose(f);
+}
+
+// A small machine: 16-byte pages, 4 frames, 16 swap slots
+static vmem_config small_config(diagnostics* d, const char* options) {
+    vmem_config config = {PROGRAM_FILE, SWAP_FILE, 64, 64, 32, 96, 16, 16, 64, 256, options, 0,
+                          on_message, on_error, d};
+    return config;
+}
+
+static void test_config_errors(void) {
+    diagnostics d = {0};
+    vmem_config config = small_config(&d, "policy=bogus");
+    vmem_handle* vm;
+    check(vmem_create(&config, &vm) == VMEM_ERR_CONFIG && vm == NULL, "unknown policy is refused");
+    check(d.errors == 1 && strstr(d.last_error, "bogus") != NULL, "the reason reaches the error callback");
+
+    memset(&d, 0, sizeof(d));
+    config = small_config(&d, "tlb=8x");
+    check(vmem_create(&config, &vm) == VMEM_ERR_CONFIG && d.errors == 1, "trailing junk in a number is refused");
+
+    memset(&d, 0, sizeof(d));
+    config = small_config(&d, "policy=random seed=12ab");
+    check(vmem_create(&config, &vm) == VMEM_ERR_CONFIG && strstr(d.last_error, "seed") != NULL,
+          "a malformed seed is refused");
+
+    memset(&d, 0, sizeof(d));
+    config = small_config(&d, NULL);
+    config.page_size = 0;
+    check(vmem_create(&config, &vm) == VMEM_ERR_CONFIG, "zero page size is refused");
+
+    memset(&d, 0, sizeof(d));
+    config = small_config(&d, NULL);
+    config.swap = "no_such_directory/vmem_test.swp";
+    check(vmem_create(&config, &vm) == VMEM_ERR_CONFIG && d.errors == 1,
+          "a swap file that cannot be created is refused at once");
+
+    config = small_config(NULL, "policy=bogus");
+    config.error = NULL;
+    check(vmem_create(&config, &vm) == VMEM_ERR_CONFIG, "errors without a callback are dropped");
+}
+
+static void test_accesses(void) {
+    diagnostics d = {0};
+    vmem_config config = small_config(&d, "policy=clock tlb=4");
+    vmem_handle* vm;
+    if (vmem_create(&config, &vm) != VMEM_OK) {
+        check(0, "create a small simulator");
+        return;
+    }
+
+    char value = 0;
+    check(vmem_access(vm, 70, VMEM_LOAD, &value) == VMEM_OK && value == 70, "DATA loads from the program");
+    value = 'x';
+    check(vmem_access(vm, 3, VMEM_STORE, &value) == VMEM_ERR_READONLY, "TEXT is read-only");
+    check(vmem_access(vm, 256, VMEM_LOAD, &value) == VMEM_ERR_RANGE, "loads past the end are refused");
+
+    // Three times the frames: every page is evicted to swap and read back
+    int ok = 1;
+    for (int64_t a = 64; a < 256; a += 5) {
+        value = (char)(a * 3);
+        if (vmem_access(vm, a, VMEM_STORE, &value) != VMEM_OK) ok = 0;
+    }
+    for (int64_t a = 64; a < 256; a += 5) {
+        if (vmem_access(vm, a, VMEM_LOAD, &value) != VMEM_OK || value != (char)(a * 3)) ok = 0;
+    }
+    check(ok, "stores survive eviction to swap");
+
+    vmem_stats stats;
+    vmem_get_stats(vm, &stats);
+    check(stats.accesses == 1 + 2 * 39 && stats.swap_outs > 0 && stats.swap_ins > 0,
+          "counters see every accepted access and the swap traffic");
+    vmem_time time;
+    check(vmem_access_time(vm, &time) > 0.0 && time.disk_read > 0.0 && time.disk_write > 0.0,
+          "modeled time charges disk reads and writes");
+    check(d.message_bytes == 0 && d.errors == 0, "quiet handle reports nothing");
+    vmem_destroy(vm);
+
+    config.verbose = 1;
+    if (vmem_create(&config, &vm) != VMEM_OK) {
+        check(0, "create a verbose simulator");
+        return;
+    }
+    vmem_access(vm, 70, VMEM_LOAD, &value);
+    vmem_destroy(vm);
+    check(d.message_bytes > 0, "verbose messages reach the message callback");
+}
+
+// Four frames and two swap slots cannot hold twelve dirty pages: the
+// stores that need a frame fail, and every page stored before keeps its data
+static void test_swap_full(void) {
+    diagnostics d = {0};
+    vmem_config config = small_config(&d, NULL);
+    config.swap_size = 32;
+    vmem_handle* vm;
+    if (vmem_create(&config, &vm) != VMEM_OK) {
+        check(0, "create a simulator with two swap slots");
+        return;
+    }
+
+    int stored[16] = {0};
+    int refused = 0;
+    for (int page = 4; page < 16; page++) {
+        char value = (char)('A' + page);
+        int rc = vmem_access(vm, page * 16 + 1, VMEM_STORE, &value);
+        if (rc == VMEM_OK) stored[page] = 1;
+        else if (rc == VMEM_ERR_FAULT) refused++;
+    }
+    check(refused > 0 && d.errors > 0, "stores fail once swap is full");
+
+    int intact = 1;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int page = 4; page < 16; page++) {
+            char value = 0;
+            if (stored[page] && vmem_access(vm, page * 16 + 1, VMEM_LOAD, &value) == VMEM_OK &&
+                value != (char)('A' + page)) {
+                intact = 0;
+            }
+        }
+    }
+    check(intact, "pages stored before swap filled up keep their data");
+
+    vmem_stats stats;
+    vmem_get_stats(vm, &stats);
+    check(stats.swap_outs - stats.swap_ins <= 2, "no more pages in swap than it has slots");
+    vmem_destroy(vm);
+}
+
+// A swap file that cannot be sized: pages the compressed tier fails to
+// spill must stay in it, so no accepted store ever loads back wrong
+static void test_zswap_spill_fails(void) {
+    diagnostics d = {0};
+    vmem_config config = small_config(&d, "zswap=12");
+    config.swap = "/dev/full";
+    vmem_handle* vm;
+    if (vmem_create(&config, &vm) != VMEM_OK) {
+        check(0, "create a simulator with an unwritable swap file");
+        return;
+    }
+
+    int stored[16] = {0};
+    int refused = 0;
+    for (int page = 8; page < 16; page++) {
+        char value = (char)('A' + page);
+        int rc = vmem_access(vm, page * 16 + 1, VMEM_STORE, &value);
+        if (rc == VMEM_OK) stored[page] = 1;
+        else if (rc == VMEM_ERR_FAULT) refused++;
+    }
+    check(refused > 0 && d.errors > 0, "stores fail once the tier cannot spill");
+
+    int intact = 1;
+    for (int page = 8; page < 16; page++) {
+        char value = 0;
+        if (stored[page] && vmem_access(vm, page * 16 + 1, VMEM_LOAD, &value) == VMEM_OK &&
+            value != (char)('A' + page)) {
+            intact = 0;
+        }
+    }
+    check(intact, "a page whose spill failed keeps its data");
+    vmem_destroy(vm);
+}
+
+// Handles share nothing: the same addresses hold different data
+static void test_two_handles(void) {
+    diagnostics d = {0};
+    vmem_config a_config = small_config(&d, NULL);
+    vmem_config b_config = small_config(&d, NULL);
+    b_config.swap = SWAP_FILE ".b";
+    vmem_handle* a;
+    vmem_handle* b;
+    if (vmem_create(&a_config, &a) != VMEM_OK || vmem_create(&b_config, &b) != VMEM_OK) {
+        check(0, "create two simulators");
+        return;
+    }
+    char x = 'a', y = 'b';
+    vmem_access(a, 100, VMEM_STORE, &x);
+    vmem_access(b, 100, VMEM_STORE, &y);
+    vmem_access(a, 100, VMEM_LOAD, &x);
+    vmem_access(b, 100, VMEM_LOAD, &y);
+    check(x == 'a' && y == 'b', "two handles keep their own memory");
+    vmem_destroy(a);
+    vmem_destroy(b);
+    unlink(SWAP_FILE ".b");
+}
+
+int main(void) {
+    if (write_program() != 0) {
+        perror("Error writing " PROGRAM_FILE);
+        return 1;
+    }
+    test_config_errors();
+    test_accesses();
+    test_swap_full();
+    test_zswap_spill_fails();
+    test_two_handles();
+    unlink(PROGRAM_FILE);
+    unlink(SWAP_FILE);
+    printf("%d failed\n", failures);
+    return failures;
+}